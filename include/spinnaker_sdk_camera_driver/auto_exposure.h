@@ -0,0 +1,71 @@
+#ifndef AUTO_EXPOSURE_HEADER
+#define AUTO_EXPOSURE_HEADER
+
+#include "std_include.h"
+#include "kernels.h"
+#include "frame.h"
+
+using namespace cv;
+using namespace std;
+
+namespace acquisition {
+
+    // Brightness of the metered part of a frame, 16 bins of 16 levels
+    struct ExposureStats {
+        uint32_t hist[16];
+        uint64_t sum;
+        uint64_t count;
+
+        ExposureStats() : sum(0), count(0) { memset(hist, 0, sizeof(hist)); }
+        double mean() const { return count ? double(sum)/count : 0; }
+    };
+
+    struct AutoExposureSettings {
+        double target;          // mean grey level aimed at, 0-255
+        Rect2d roi;             // metering region, fractions of the frame
+        double speed;           // share of the (log) error corrected per frame, 0-1
+        double min_exposure;    // us
+        double max_exposure;    // us, gain only rises past it
+        double max_gain;        // dB
+        double clip_limit;      // share of clipped pixels that forces the exposure down
+        int stride;             // rows skipped between metered rows
+        int settle;             // frames skipped after a change, when the chunks don't carry the exposure
+    };
+
+    // Software auto exposure/gain of one camera. The frame is metered on
+    // every stride-th row of its ROI, the exposure x gain product moves by
+    // speed x log2(target/mean) and is split into exposure first (less
+    // noise), gain once the exposure hits its maximum. Unlike the camera's
+    // own loop it converges in a few frames and meters where it is told to.
+    // The metered frame may have been exposed a few sets before the last
+    // setting was written (pipelined trigger, pipeline mode): the update
+    // starts from the exposure and gain in its chunk data, or without them
+    // waits 'settle' frames after every change.
+    class AutoExposure {
+
+    public:
+
+        AutoExposure(const AutoExposureSettings& settings, double exposure_us, double gain_db);
+
+        static ExposureStats meter(const Mat& frame, const Rect2d& roi, int stride);
+
+        // True when the exposure or gain changed and must be written
+        bool update(const ExposureStats& stats, const FrameMetadata& meta);
+        ExposureStats meter(const Mat& frame) { return meter(frame, settings_.roi, settings_.stride); }
+
+        double exposure() { return exposure_; }
+        double gain() { return gain_; }
+        const AutoExposureSettings& settings() { return settings_; }
+
+    private:
+
+        AutoExposureSettings settings_;
+        double exposure_;
+        double gain_;
+        int settle_;            // frames still to skip
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef BANDWIDTH_PLANNER_HEADER
+#define BANDWIDTH_PLANNER_HEADER
+
+#include "std_include.h"
+
+using namespace std;
+
+namespace acquisition {
+
+    // What one camera asks of the bus, and what the plan grants it
+    struct LinkDemand {
+        string id;
+        int width;
+        int height;
+        double bytes_per_pixel;
+        double fps;
+        int binning;                // applied by the plan on top of width x height
+        int64_t link_speed;         // bytes/s, 0 if unknown
+        int64_t limit_min;          // DeviceLinkThroughputLimit range
+        int64_t limit_max;
+
+        // Filled in by the plan
+        int64_t throughput_limit;
+        vector<string> downgrades;
+
+        double required() const { return width*height*bytes_per_pixel*fps/(binning*binning); }
+    };
+
+    // Fits the cameras sharing a host controller into its bandwidth budget.
+    // Each camera needs width x height x bytes/pixel x fps (+ headroom); when
+    // the sum doesn't fit, downgrades are applied in the given order, each
+    // one repeatedly to the most demanding camera first, until it does:
+    //   format  - packed/16 bit formats down to 8 bit
+    //   binning - double the binning, up to 4
+    //   fps     - lower the (common) rate to what fits
+    // Every camera is then capped at its share with DeviceLinkThroughputLimit
+    // so none of them can starve the others.
+    class BandwidthPlanner {
+
+    public:
+
+        BandwidthPlanner(double budget_bytes_per_s, double headroom = 0.1);
+
+        void add(const LinkDemand& demand) { cams_.push_back(demand); }
+
+        // False if the demand can't fit even after every allowed downgrade
+        bool plan(const vector<string>& downgrade_order);
+
+        const vector<LinkDemand>& cameras() { return cams_; }
+        double total();
+        void log();
+
+    private:
+
+        bool fits();
+        bool fits(const LinkDemand& cam);
+        bool downgrade(string step);
+
+        vector<LinkDemand> cams_;
+        double budget_;
+        double headroom_;
+
+    };
+
+}
+
+#endif
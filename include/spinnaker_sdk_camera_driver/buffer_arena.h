@@ -0,0 +1,73 @@
+#ifndef BUFFER_ARENA_HEADER
+#define BUFFER_ARENA_HEADER
+
+#include "std_include.h"
+#include "frame_pool.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace acquisition {
+
+    // Acquisition buffers owned by the pipeline and handed to the Spinnaker
+    // stream with SetUserBuffers(). One contiguous, pinned (mlock) region is
+    // mapped per camera, on hugepages when available, and carved into page
+    // aligned slices of one payload each. The driver then never allocates
+    // stream memory itself and the footprint per camera is exactly
+    // buffer_count * aligned payload size.
+    // A camera's region is remapped only when its payload or buffer count
+    // changes. The previous region stays mapped, since the stream still
+    // points at it, until the new one was handed over (release_previous) or
+    // could not be (restore_previous).
+    class BufferArena {
+
+    public:
+
+        BufferArena(bool use_hugepages = true);
+        ~BufferArena();
+
+        // (Re)maps the region of camera `cam` for `count` buffers of `payload`
+        // bytes. False leaves the current region as it was.
+        bool reserve(int cam, size_t payload, int count);
+        void release_previous(int cam);
+        void restore_previous(int cam);
+        void release(int cam);
+        void release_all();
+
+        // The accessors of one camera are for the thread reserving it, the
+        // footprint totals can be read from anywhere
+        void** buffers(int cam) { return &regions_[cam].slices[0]; }
+        int buffer_count(int cam) { return cam < regions_.size() ? regions_[cam].slices.size() : 0; }
+        size_t buffer_size(int cam) { return cam < regions_.size() ? regions_[cam].slice : 0; }
+        size_t footprint(int cam);
+        size_t total_footprint();
+        bool is_huge(int cam) { return regions_[cam].huge; }
+        bool is_pinned(int cam) { return regions_[cam].pinned; }
+
+    private:
+
+        struct Region {
+            void* ptr;
+            size_t size;
+            bool huge;
+            bool pinned;
+            size_t slice;               // page aligned payload
+            vector<void*> slices;
+
+            Region() : ptr(NULL), size(0), huge(false), pinned(false), slice(0) {}
+        };
+
+        void ensure_slot(int cam);
+        static void unmap(Region& r);
+
+        bool USE_HUGEPAGES_;
+        vector<Region> regions_;
+        vector<Region> previous_;       // still with the stream until released
+        boost::mutex mutex_;            // guards the regions
+
+    };
+
+}
+
+#endif
@@ -3,6 +3,9 @@
 
 #include "std_include.h"
 #include "serialization.h"
+#include "frame_pool.h"
+#include "frame.h"
+#include "kernels.h"
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/filesystem.hpp>
 
@@ -14,6 +17,13 @@ using namespace std;
 
 namespace acquisition {
 
+    // A host demosaicing algorithm: Spinnaker's, or OpenCV's when cv_code >= 0
+    struct DemosaicAlgorithm {
+        string name;
+        ColorProcessingAlgorithm spinnaker;
+        int cv_code;
+    };
+
     class Camera {
 
     public:
@@ -23,27 +33,60 @@ namespace acquisition {
 
         void init();
         void deinit();
+        // Same camera on a new device handle, after it came back on the bus
+        void reset(CameraPtr);
         void begin_acquisition();
         void end_acquisition();
 
         ImagePtr grab_frame();
         Mat grab_mat_frame();
+        Mat convert_to_mat(ImagePtr);
+        // size: output size the conversion may resample to on the way (YCbCr)
+        Mat convert_image(ImagePtr, Size size = Size());
+        Mat resize_output(Mat);
+        // ROS encoding of an image convert_image returned
+        string ros_encoding(const Mat&);
         string get_time_stamp();
+        int64_t get_raw_time_stamp() { return timestamp_; }
         int get_frame_id();
+        // Chunk data of the last grabbed frame
+        FrameMetadata get_metadata() { return metadata_; }
 
         void setEnumValue(string, string);
         void setIntValue(string, int);
         void setFloatValue(string, float);
         void setBoolValue(string, bool);
+        bool setReverse(string axis, bool on);
+        bool setGamma(double gamma);
+        bool bayer_format();
+        double getFloatValue(string);
+        int64_t getIntValue(string);
+        string getEnumValue(string);
+        bool hasEnumEntry(string, string);
+        bool getIntRange(string, int64_t&, int64_t&);
+        int64_t latch_timestamp();
 
         void trigger();
         
         void setISPEnable();
+        static double benchmark_host_debayer(int width, int height);
+        static double benchmark_demosaic(int width, int height, const DemosaicAlgorithm& algorithm);
+        // Every host demosaicing algorithm, best quality first
+        static vector<DemosaicAlgorithm> demosaic_algorithms();
+        static bool demosaic_algorithm(string name, DemosaicAlgorithm& algorithm);
+        static void demosaic(const Mat& bayer, Mat& bgr, const DemosaicAlgorithm& algorithm);
         void setFREnable();
         void setPixelFormat(gcstring formatPic);
         void exposureTest();
         void setResolutionPixels(int width, int height);
+        Rect setROI(Rect roi);
         void setBufferSize(int numBuf);
+        void setUserBuffers(void** buffers, int count, size_t size);
+        bool setBufferHandling(string mode);
+        bool enableChunks(const vector<string>& chunks);
+        bool setExposureSequence(double short_us, double long_us);
+        void setExposureGain(double exposure_us, double gain_db);
+        int64_t get_payload_size();
         void adcBitDepth(gcstring bitDep);
         void targetGreyValueTest();
 
@@ -64,20 +107,60 @@ namespace acquisition {
         void make_master() { MASTER_ = true; ROS_DEBUG_STREAM( "camera " << get_id() << " set as master"); }
         bool is_master() { return MASTER_; }
         void set_color(bool flag) { COLOR_ = flag; }
+        void set_frame_pool(FramePool* pool) { frame_pool_ = pool; }
+        // Size convert_to_mat resizes to, 0 keeps the full resolution. Safe
+        // to call while converting.
+        void set_output_size(int width, int height);
+        Size output_size();
+        // 4096 entry table packed formats are tone mapped to 8 bit with, NULL keeps 16 bit
+        void set_tone_map(const uchar* lut) { tone_lut_ = lut; }
+        // 256 entry curve applied by finish_colors(), empty for none. Safe
+        // to call while frames are being converted.
+        void set_tone_curve(const vector<uchar>& curve);
+        // Q12 BGR color matrix (kernels::color_matrix) applied by
+        // finish_colors() before the curve, empty for none. Safe to call
+        // while converting.
+        void set_color_matrix(const vector<short>& matrix);
+        // Color matrix and tone curve of a converted frame, once it is at
+        // its output resolution
+        Mat finish_colors(const Mat& img, bool in_place = false);
+        void set_grab_timeout(uint64_t ms) { GET_NEXT_IMAGE_TIMEOUT_ = ms; }
+        // Set before acquiring, not while frames are being converted
+        void set_demosaic(const DemosaicAlgorithm& algorithm) { demosaic_ = algorithm; }
+        // YCbCr422_8 frames are published as sent instead of converted to BGR
+        void set_publish_yuv(bool flag) { PUBLISH_YUV_ = flag; }
         
     private:
 
-        Mat convert_to_mat(ImagePtr);
-        
+        static int packed_bits(PixelFormatEnums format);
+        Mat unpack_image(ImagePtr, int bits);
+        Mat convert_yuv(ImagePtr, Size size);
+
         CameraPtr pCam_;
         int64_t timestamp_;
         int frameID_;
         int lastFrameID_;
+        FrameMetadata metadata_;
+        bool CHUNKS_;
+        // looked up once, written every few frames by the auto exposure
+        CFloatPtr exposure_node_;
+        CFloatPtr gain_node_;
 
         bool COLOR_;
+        bool PUBLISH_YUV_;
+        DemosaicAlgorithm demosaic_;
+        boost::shared_ptr<const Size> output_size_;   // swapped atomically, empty for none
         bool MASTER_;
         uint64_t GET_NEXT_IMAGE_TIMEOUT_;
 
+        // not owned, outlives the camera (see Capture::frame_pool_)
+        FramePool* frame_pool_;
+        // not owned either, see Capture::tone_lut_
+        const uchar* tone_lut_;
+        // swapped atomically, converting threads keep the table they loaded
+        boost::shared_ptr<const vector<uchar> > tone_curve_;
+        boost::shared_ptr<const vector<short> > color_matrix_;
+
     };
 
 }
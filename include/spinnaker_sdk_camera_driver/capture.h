@@ -4,6 +4,17 @@
 #include "std_include.h"
 #include "serialization.h"
 #include "camera.h"
+#include "frame_pool.h"
+#include "buffer_arena.h"
+#include "memory_governor.h"
+#include "frame.h"
+#include "thread_pool.h"
+#include "pipeline.h"
+#include "bandwidth_planner.h"
+#include "command_queue.h"
+#include "auto_exposure.h"
+#include "demosaic_tuner.h"
+#include "color_correction.h"
 
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/filesystem.hpp>
@@ -15,6 +26,7 @@
 #include <provider_vision/spinnaker_camConfig.h>
 
 #include "provider_vision/SpinnakerImageNames.h"
+#include "provider_vision/FrameMetadata.h"
 
 #include <sstream>
 #include <image_transport/image_transport.h>
@@ -26,6 +38,30 @@ using namespace cv;
 using namespace std;
 
 namespace acquisition {
+
+    // A named region of one camera, published on its own topic
+    struct RoiStream {
+        string name;
+        Rect rect;          // sensor coordinates, zero width/height = the whole sensor
+        double scale;       // applied to the crop before publishing
+        image_transport::Publisher pub;
+    };
+
+    // Mounting correction, applied in this order: mirror the columns, mirror
+    // the rows, transpose. Covers every mirror and quarter turn.
+    struct Orientation {
+        bool flip_x;
+        bool flip_y;
+        bool transpose;
+
+        Orientation() : flip_x(false), flip_y(false), transpose(false) {}
+        bool any() const { return flip_x || flip_y || transpose; }
+    };
+
+    struct ToneCurve {
+        double gamma;       // out = in^(1/gamma)
+        double contrast;    // around mid grey, after the gamma
+    };
     
     class Capture {
 
@@ -39,6 +75,7 @@ namespace acquisition {
         
         void init_array();
         void init_cameras(bool);
+        void init_camera(int, bool);
         void start_acquisition();
         void end_acquisition();
         void deinit_cameras();
@@ -46,14 +83,17 @@ namespace acquisition {
         void run();
         void run_soft_trig();
         void run_mt();
+        void run_pipeline();
         void publish_to_ros(int, char**, float);
 
         void read_parameters();
         std::string todays_date();
 
         
-        void write_queue_to_disk(queue<ImagePtr>*, int);
-        void acquire_images_to_queue(vector<queue<ImagePtr>>*);
+        void write_queued_frame(deque<ImagePtr>*, int);
+        void acquire_images_to_queue(vector<deque<ImagePtr>>*);
+
+        FramePoolStats frame_pool_stats() { return frame_pool_ ? frame_pool_->stats() : FramePoolStats(); }
     
     private:
 
@@ -62,15 +102,101 @@ namespace acquisition {
         void create_cam_directories();
         void save_mat_frames(int);
         void save_binary_frames(int);
+        void write_mat_frame(string, Mat);
+        void write_binary_frame(string, Mat);
         void get_mat_images();
+        void convert_frame(int);
+        void trigger_all();
+        void calibrate_clocks();
+        void measure_skew();
+        void log_sync_stats();
+        void schedule_trigger_phases();
+        void apply_trigger_phase(int cam);
+        void plan_bandwidth();
+        void apply_link_plan(int cam);
+        double bytes_per_pixel(int cam);
+        void choose_color_processing();
+        void tune_demosaic();
+        string pixel_format();
+        void reserve_user_buffers();
+        bool reserve_user_buffers(int cam);
+        void set_grab_timeouts();
+        void set_grab_timeout(int cam);
+        double frame_rate(int cam);
+        ImagePtr grab_watched(int cam);
+        bool streaming(int cam);
+        bool is_stalled(int cam);
+        void isolate_camera(int cam);
+        void recover_camera(int cam);
+        void restore_cameras(bool rearm);
+        void resync_frame_ids();
+        int frame_id(int cam) { return cams[cam].get_frame_id() + frame_id_offsets_[cam]; }
+        void queue_command(CameraCommand command);
+        void apply_commands(bool rearm);
+        void apply_command(const CameraCommand& command);
+        void remember_command(const CameraCommand& command);
+        void flush_pipeline(int cam);
+        void set_trigger_mode(int cam, string mode);
+        void load_rois();
+        void apply_sensor_rois();
+        void extract_rois(int cam, const Mat& full, vector<Mat>& rois);
+        void apply_orientation();
+        void apply_orientation(int cam);
+        Mat resize_oriented(int cam, const Mat& img, Size size, int interpolation = INTER_LINEAR);
+        pair<Mat, Mat> orientation_maps(int cam, const Orientation& o, Size src, Size dst);
+        bool stage_rois(Frame&);
+        bool stage_hdr(Frame&);
+        bool hdr_is_long(int cam, const FrameMetadata& meta);
+        void fuse_hdr();
+        void fuse_frame(int cam);
+        Mat fuse_exposures(const Mat& short_exp, const Mat& long_exp);
+        void load_auto_exposure();
+        void load_tone_curves();
+        void apply_tone_curve();
+        void apply_tone_curve(int cam);
+        void meter_frame(int cam, const Mat& frame, const FrameMetadata& meta, bool oriented);
+        Orientation sensor_orientation(int cam);
+        void load_color_correction();
+        void apply_color_correction();
+        void observe_colors(int cam, const Mat& frame);
+        bool stage_wb(Frame&);
+        void apply_auto_exposure();
+        bool stage_ae(Frame&);
+        double peak_bandwidth(const vector<int>& cams, const vector<double>& starts);
+        bool due(int cam) { return rate_divisors_[cam] <= 1 || tick_ % rate_divisors_[cam] == 0; }
+        void log_frame_rates();
         void update_grid();
+        void update_grid_rows(int, int);
         void export_to_ROS();
+        void publish_frame(int, const Frame&);
+        void publish_loop();
+        void hand_off(int cam, const Frame&);
+        void build_pipelines();
+        Pipeline::StageFn make_stage(int, string, XmlRpc::XmlRpcValue&);
+        bool stage_convert(Frame&);
+        bool stage_resize(Frame&, Size);
+        bool stage_rectify(Frame&);
+        bool stage_encode(Frame&);
+        bool stage_publish(Frame&);
+        bool stage_record(Frame&);
+        bool stage_handoff(Frame&);
+
         void dynamicReconfigureCallback(provider_vision::spinnaker_camConfig &config, uint32_t level);
 
         float mem_usage();
+
+        void register_memory_components();
+        size_t frame_pool_usage();
+        size_t recording_queues_usage();
+        size_t shed_recording_queues(size_t);
+        size_t image_names_usage();
+        size_t publish_buffers_usage();
     
         SystemPtr system_;    
         CameraList camList_;
+        // declared ahead of every Mat member so it is destroyed after them
+        boost::shared_ptr<FramePool> frame_pool_;
+        boost::shared_ptr<BufferArena> buffer_arena_;
         vector<acquisition::Camera> cams;
         vector<string> cam_ids_;
         vector<string> cam_names_;
@@ -79,7 +205,32 @@ namespace acquisition {
         vector<CameraPtr> pCams_;
         vector<ImagePtr> pResultImages_;
         vector<Mat> frames_;
+        vector< vector<Mat> > roi_frames_;
+        vector< vector<RoiStream> > roi_streams_;
+        vector<Rect> sensor_rois_;          // what the sensor reads out, per camera
+
+        // Mounting orientation per camera, and what is left of it for the
+        // host once the sensor mirrored what it could
+        map<string, string> orientation_param_;
+        vector<Orientation> orientations_;
+        vector<Orientation> host_orientations_;     // guarded by orient_mutex_
+        vector<map<vector<int>, pair<Mat, Mat> > > orient_maps_;
+        vector<bool> resize_stages_;                // the pipeline orients in its resize stage
+        boost::mutex orient_mutex_;
+        vector<boost::shared_ptr<FrameHandoff> > handoffs_;
+        vector<Mat> display_frames_;
+        int display_consumer_;
+        int publish_consumer_;
         vector<string> time_stamps_;
+        vector<FrameMetadata> metadata_;
+        vector<string> trigger_modes_;      // software, hardware or off, per camera
+
+        // A camera with divisor N is triggered on every Nth tick of the master schedule
+        map<string, int> rate_divisors_param_;
+        vector<int> rate_divisors_;
+        vector<bool> fresh_;                // grabbed in the last set
+        uint64_t tick_;
+        CommandQueue command_queue_;
         vector< vector<Mat> > mem_frames_;
         vector<vector<double>> intrinsic_coeff_vec_;
         vector<vector<double>> distortion_coeff_vec_;
@@ -92,12 +243,94 @@ namespace acquisition {
 
         time_t time_now_;
         double grab_time_, save_time_, toMat_time_, save_mat_time_, export_to_ROS_time_, achieved_time_;
+        double sensor_max_fps_;
+        double sensor_fps_read_time_;   // when sensor_max_fps_ was last read
+        ros::Time trigger_stamp_;       // host time of the pending software trigger, zero if none
+        string sync_mode_;
+
+        // Camera clock minus host clock (ns), to compare timestamps across cameras
+        vector<int64_t> clock_offsets_;
+        double clock_calibration_time_;
+        bool clock_latch_failed_;       // no TimestampLatch, skew is not measured
+        double skew_sum_, skew_max_;
+        int skew_count_;
+
+        // Trigger phases within the frame period, and what they are based on
+        double stagger_max_offset_us_;
+        vector<double> trigger_offsets_;    // s
+        vector<double> readout_times_;      // s
+        vector<int64_t> payload_bytes_;
+        double peak_bw_sum_, peak_bw_max_;
+
+        double usb_budget_mb_;
+        string color_processing_;
+        double isp_cpu_threshold_;
+        bool PUBLISH_YUV_;
+        bool KERNEL_SELF_CHECK_;
+        string demosaic_;               // default, auto or an algorithm name
+        double demosaic_cpu_budget_;    // share of the free CPU auto may spend
+        bool DEMOSAIC_RETUNE_;
+        string demosaic_cache_;
+        vector<string> bandwidth_downgrades_;
+        vector<LinkDemand> link_plan_;  // what plan_bandwidth() settled on
+
+        // Packed 10/12 bit acquisition, and the optional map down to 8 bit
+        int bit_depth_;
+        string tone_map_;
+        double tone_map_gamma_;
+        vector<uchar> tone_lut_;
+
+        // Short/long exposure pairs fused into one frame
+        double hdr_short_exposure_;     // us
+        double hdr_long_exposure_;      // us
+        int hdr_knee_;
+        vector<Mat> hdr_short_;         // waiting for its long exposure
+        vector<char> hdr_alternate_;    // no sequencer, ExposureTime written per trigger
+        vector<char> hdr_next_long_;
+        vector<int> hdr_parity_;
+        double hdr_fuse_time_;
+        int hdr_fused_;
+        boost::mutex hdr_mutex_;
+
+        // Software auto exposure, metered on the converted frames and written
+        // between frames
+        vector<AutoExposureSettings> ae_settings_;
+        vector<boost::shared_ptr<AutoExposure> > auto_exposures_;
+        vector<bool> ae_pending_;
+        boost::mutex ae_mutex_;
+
+        // Per camera gamma/contrast, on the camera or in the conversion pass
+        vector<ToneCurve> tone_curves_;
+
+        // Per camera white balance/color matrix, applied last in the
+        // conversion pass; gray world gains learnt from the converted frames
+        vector<boost::shared_ptr<ColorCorrection> > color_corrections_;
+
+        // Stall watchdog: a camera missing frames is taken out of the set and
+        // brought back in the background, the others keep streaming
+        double watchdog_periods_;       // grab timeout, in frame periods
+        int watchdog_misses_;           // missed frames in a row before recovery
+        vector<char> stalled_;          // all three guarded by watchdog_mutex_
+        vector<char> resync_;           // recovered, frame ID to be realigned
+        vector<CameraPtr> recovered_;   // back on the bus, to be restored
+        vector<vector<CameraCommand> > runtime_commands_;  // written since launch, again on restore
+        vector<int> misses_;
+        vector<int> frame_id_offsets_;
+        boost::mutex watchdog_mutex_;
+        boost::thread_group recovery_threads_;
 
         int nframes_;
         float init_delay_;
         int skip_num_;
         float master_fps_;
         int binning_;
+        int frame_pool_max_mb_;
+        int user_buffer_count_;
+        int memory_budget_mb_;
+        int worker_threads_;
+        int row_band_;
+        map<string, int> memory_priorities_;
+        map<string, int> memory_limits_mb_;
         bool color_;
         string dump_img_;
         string ext_;
@@ -124,6 +357,21 @@ namespace acquisition {
         bool EXPORT_TO_ROS_;
         bool MAX_RATE_SAVE_;
         bool PUBLISH_CAM_INFO_;
+        bool ASYNC_PUBLISH_;
+        bool PIPELINED_TRIGGER_;
+        bool HARDWARE_SYNC_;
+        bool FREE_RUN_;
+        bool STAGGER_TRIGGERS_;
+        bool BANDWIDTH_PLAN_;
+        bool CHUNK_DATA_;
+        bool HDR_;
+        bool AUTO_EXPOSURE_;
+        bool WATCHDOG_;
+        bool PIPELINE_;
+        bool FRAME_POOL_;
+        bool FRAME_POOL_HUGEPAGES_;
+        bool USER_BUFFERS_;
+        bool USER_BUFFERS_HUGEPAGES_;
 
         // grid view related variables
         bool GRID_CREATED_;
@@ -139,6 +387,7 @@ namespace acquisition {
         ros::Publisher acquisition_pub;
         //vector<ros::Publisher> camera_image_pubs;
         vector<image_transport::CameraPublisher> camera_image_pubs;
+        vector<ros::Publisher> metadata_pubs;
         //vector<ros::Publisher> camera_info_pubs;
 
 		
@@ -146,6 +395,20 @@ namespace acquisition {
         vector<sensor_msgs::CameraInfoPtr> cam_info_msgs;
         provider_vision::SpinnakerImageNames mesg;
         boost::mutex queue_mutex_;  
+        vector<deque<ImagePtr> > image_queues_;
+        vector<int> dropped_frames_;
+        vector<int> written_frames_;
+        TaskGroup write_group_;
+        boost::shared_ptr<WorkStealingPool> worker_pool_;
+        vector<boost::shared_ptr<Pipeline> > pipelines_;
+        vector<pair<Mat, Mat> > rect_maps_;
+        boost::shared_ptr<MemoryGovernor> memory_governor_;
+        boost::thread publish_thread_;
+        // img_msgs is written by whichever thread publishes and read by the
+        // memory governor; publish_pending_ wakes the async publisher
+        boost::mutex publish_mutex_;
+        boost::condition_variable publish_cond_;
+        bool publish_pending_;
     };
 
 }
@@ -0,0 +1,53 @@
+#ifndef COLOR_CORRECTION_HEADER
+#define COLOR_CORRECTION_HEADER
+
+#include "std_include.h"
+#include "kernels.h"
+
+using namespace cv;
+using namespace std;
+
+namespace acquisition {
+
+    struct ColorCorrectionSettings {
+        bool gray_world;        // gains estimated from the frames, else fixed
+        double gains[3];        // b, g, r: the fixed ones, or where gray world starts
+        double matrix[9];       // 3x3 after the gains, RGB, row major
+        int every;              // frames between gray world updates
+        int stride;             // rows and columns skipped when sampling
+        double speed;           // share of the (log) error corrected per update, 0-1
+        double max_gain;
+    };
+
+    // Per channel gains then a 3x3 color matrix, folded into one matrix the
+    // conversion applies (kernels::color_matrix) before the tone curve. With
+    // gray world, one frame in 'every' is sampled on a sparse grid and the
+    // gains move so that its unclipped pixels average to grey: underwater,
+    // red comes up and the blue-green cast goes. The frames sampled are the
+    // converted ones before any correction; the gains move toward the ones
+    // that would make them grey a share at a time, like the auto exposure.
+    class ColorCorrection {
+
+    public:
+
+        ColorCorrection(const ColorCorrectionSettings& settings);
+
+        // True when the gains moved and matrix() must be handed over again
+        bool observe(const Mat& frame);
+
+        // Q12, BGR order, gains folded in
+        vector<short> matrix() const;
+        const double* gains() const { return gains_; }
+        const ColorCorrectionSettings& settings() const { return settings_; }
+
+    private:
+
+        ColorCorrectionSettings settings_;
+        double gains_[3];
+        int frames_;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef COMMAND_QUEUE_HEADER
+#define COMMAND_QUEUE_HEADER
+
+#include "std_include.h"
+
+#include <set>
+
+using namespace std;
+
+namespace acquisition {
+
+    // One setting change for one camera, written to the camera between frames
+    struct CameraCommand {
+
+        enum Kind { ENUM, FLOAT, INT, BOOL, OUTPUT_SIZE, TRIGGER, TONE_CURVE };
+
+        int cam;
+        Kind kind;
+        string node;        // GenICam node, or what OUTPUT_SIZE / TRIGGER / TONE_CURVE set
+        string text;        // ENUM entry, TRIGGER mode
+        double value;       // FLOAT, INT, BOOL, TONE_CURVE
+        int width, height;  // OUTPUT_SIZE
+        bool restart;       // only writable with acquisition stopped
+
+        CameraCommand(int cam_, Kind kind_, string node_, bool restart_ = false)
+            : cam(cam_), kind(kind_), node(node_), value(0), width(0), height(0), restart(restart_) {}
+    };
+
+    // Filled from the dynamic reconfigure (spinner) thread, drained by the
+    // acquisition loop when no GetNextImage is pending. A later write to the
+    // same node of the same camera replaces the earlier one, so a slider
+    // dragged across many values costs one node write.
+    class CommandQueue {
+
+    public:
+
+        void push(const CameraCommand& command) {
+            boost::mutex::scoped_lock lock(mutex_);
+            commands_.push_back(command);
+        }
+
+        // Everything queued so far, in order, latest write per node only
+        vector<CameraCommand> take() {
+            vector<CameraCommand> commands;
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                commands.swap(commands_);
+            }
+
+            vector<CameraCommand> batch;
+            set<pair<int, string> > seen;
+            for (int i = commands.size()-1; i >= 0; i--)
+                if (seen.insert(make_pair(commands[i].cam, commands[i].node)).second)
+                    batch.push_back(commands[i]);
+            reverse(batch.begin(), batch.end());
+            return batch;
+        }
+
+        bool empty() {
+            boost::mutex::scoped_lock lock(mutex_);
+            return commands_.empty();
+        }
+
+    private:
+
+        vector<CameraCommand> commands_;
+        boost::mutex mutex_;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef DEMOSAIC_TUNER_HEADER
+#define DEMOSAIC_TUNER_HEADER
+
+#include "std_include.h"
+#include "camera.h"
+
+using namespace std;
+
+namespace acquisition {
+
+    // Picks the best quality host demosaicing algorithm that fits a CPU
+    // budget. Every algorithm is timed once per host and frame size; the
+    // timings and the pick are kept in a YAML file keyed by host name, so
+    // later starts only redo the pick (the rate or the budget may differ).
+    class DemosaicTuner {
+
+    public:
+
+        DemosaicTuner(string cache_path);
+
+        // One camera demosaiced on the host
+        void add(int width, int height, double fps);
+
+        // Best quality algorithm whose frames take at most `cores` CPU cores
+        // in total, the cheapest one when none fits. retune times again
+        // what the cache already holds.
+        string tune(double cores, bool retune);
+        void log();
+
+    private:
+
+        struct Demand {
+            int width;
+            int height;
+            double fps;
+        };
+        typedef map<string, double> Timings;    // seconds per frame by algorithm
+
+        Timings& timings(int width, int height, bool retune);
+        double cost(const string& algorithm);   // cores needed by every camera
+        void load();
+        void save();
+
+        string path_;
+        string host_;
+        vector<Demand> demands_;
+        // host -> "WxH" -> timings, and host -> pick, as in the cache file
+        map<string, map<string, Timings> > cache_;
+        map<string, string> choices_;
+        string choice_;
+        double cores_;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef FRAME_HEADER
+#define FRAME_HEADER
+
+#include "std_include.h"
+#include "triple_buffer.h"
+
+#include <boost/shared_ptr.hpp>
+
+using namespace cv;
+using namespace std;
+
+namespace acquisition {
+
+    // Per frame values sent by the camera as GenICam chunk data, exact for
+    // that frame and free of any control transfer
+    struct FrameMetadata {
+        bool valid;             // false when chunks are off or unreadable
+        int64_t frame_id;
+        uint64_t timestamp;     // camera clock, ns
+        double exposure_time;   // us
+        double gain;            // dB
+        double black_level;
+
+        FrameMetadata() : valid(false), frame_id(-1), timestamp(0), exposure_time(0), gain(0), black_level(0) {}
+    };
+
+    // One processed image of one camera as it travels through the node.
+    // `image` shares its pixels, copying a Frame never copies the image.
+    struct Frame {
+        Mat image;
+        string time_stamp;      // camera timestamp, as used for file names
+        int frame_id;
+        ros::Time stamp;        // host time of the frame set
+        uint64_t seq;
+        int cam;                // index in Capture::cams
+        FrameMetadata meta;
+        vector<Mat> rois;       // ROI streams cut from this frame, see Capture::roi_streams_
+
+        Spinnaker::ImagePtr raw;    // acquired buffer, until converted
+        boost::shared_ptr<vector<uchar> > encoded;    // image encoded for recording, if any
+        string filename;            // where the recorder writes it
+
+        Frame() : frame_id(-1), seq(0), cam(-1) {}
+    };
+
+    // Latest-frame handoff of one camera. The capture side publishes every
+    // frame without waiting; each consumer (display, publisher, ...) owns a
+    // triple buffer and reads the most recent complete frame at its own pace.
+    // Consumers must be added before the capture starts publishing.
+    class FrameHandoff {
+
+    public:
+
+        FrameHandoff() : seq_(0) {}
+
+        int add_consumer() {
+            consumers_.push_back(boost::shared_ptr<TripleBuffer<Frame> >(new TripleBuffer<Frame>()));
+            return consumers_.size() - 1;
+        }
+
+        int num_consumers() { return consumers_.size(); }
+
+        // Producer side, called from the capture thread only
+        void publish(Frame frame) {
+            frame.seq = ++seq_;
+            for (int i=0; i<consumers_.size(); i++)
+                consumers_[i]->publish(frame);
+        }
+
+        // Consumer side, true if `out` is a frame this consumer hasn't seen yet
+        bool latest(int consumer, Frame& out) { return consumers_[consumer]->latest(out); }
+
+    private:
+
+        vector<boost::shared_ptr<TripleBuffer<Frame> > > consumers_;
+        uint64_t seq_;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef FRAME_POOL_HEADER
+#define FRAME_POOL_HEADER
+
+#include "std_include.h"
+
+#include <map>
+#include <vector>
+#include <utility>
+
+using namespace cv;
+using namespace std;
+
+namespace acquisition {
+
+#if CV_VERSION_MAJOR >= 4
+    typedef cv::AccessFlag MatAccessFlag;
+#else
+    typedef int MatAccessFlag;
+#endif
+
+    // Counters describing the state of a FramePool, see FramePool::stats()
+    struct FramePoolStats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t returned;
+        uint64_t dropped;
+        size_t resident_bytes;  // bytes held by the pool, free or in use
+        size_t in_use_bytes;    // bytes currently owned by live Mats
+        size_t huge_bytes;      // part of resident_bytes backed by hugepages
+    };
+
+    // cv::MatAllocator recycling image buffers keyed by (size, type).
+    // Blocks are cache-line aligned, blocks of a page or more are page aligned
+    // and, if requested, mapped on hugepages. Freed blocks go back to a per
+    // key free list instead of the system allocator, so the frame pipeline
+    // settles on a fixed working set after the first few frames.
+    class FramePool : public MatAllocator {
+
+    public:
+
+        FramePool(bool use_hugepages = false, size_t max_resident_mb = 0);
+        ~FramePool();
+
+        UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           MatAccessFlag flags, UMatUsageFlags usageFlags) const;
+        bool allocate(UMatData* u, MatAccessFlag accessflags, UMatUsageFlags usageFlags) const;
+        void deallocate(UMatData* u) const;
+
+        FramePoolStats stats() const;
+        size_t trim(size_t bytes_to_free);
+        void log_stats(string name) const;
+
+        // Page level helpers, shared with the acquisition buffer arena
+        static void* map_block(size_t size, bool use_hugepages, bool* is_huge);
+        static void unmap_block(void* ptr, size_t size, bool is_huge);
+        static size_t page_size();
+        static size_t hugepage_size();
+
+    private:
+
+        typedef pair<size_t, int> PoolKey;
+
+        struct Block {
+            void* ptr;
+            size_t size;    // mapped size, may be rounded up from the requested size
+            bool huge;
+        };
+
+        Block take_block(size_t size, int type) const;
+        void release_block(const Block&) const;
+
+        bool USE_HUGEPAGES_;
+        size_t max_resident_bytes_;
+
+        mutable boost::mutex mutex_;
+        mutable map<PoolKey, vector<Block> > free_blocks_;
+        mutable map<void*, pair<PoolKey, Block> > used_blocks_;
+        mutable FramePoolStats stats_;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef KERNELS_HEADER
+#define KERNELS_HEADER
+
+#include "std_include.h"
+
+using namespace std;
+
+namespace acquisition {
+
+    // Row kernels for the pixel formats Spinnaker leaves to the host. Each one
+    // has a scalar version and, where the CPU has it, SSE2/SSSE3/AVX2 (x86)
+    // or NEON (arm) ones. The best one the CPU runs is picked when the
+    // library loads, so one binary runs on the dev machines and on the
+    // boards alike.
+    namespace kernels {
+
+        // Mono12p / BayerRG12p: 2 pixels in 3 bytes, least significant bits
+        // first. The 16 bit output is MSB aligned (v << 4), so it displays
+        // and scales like any other 16 bit image.
+        void unpack12p(const uchar* src, ushort* dst, size_t pixels);
+
+        // Mono10p / BayerRG10p: 4 pixels in 5 bytes, same bit order, output << 6
+        void unpack10p(const uchar* src, ushort* dst, size_t pixels);
+
+        // Unpacks one row of the given depth (10 or 12 bits)
+        void unpack_row(int bits, const uchar* src, ushort* dst, size_t pixels);
+
+        // 16 bit to 8 bit through a 4096 entry table indexed by v >> 4
+        void apply_tone_lut(const ushort* src, uchar* dst, size_t pixels, const uchar* lut);
+
+        // 8 bit to 8 bit through a 256 entry table, in place when src == dst
+        void apply_lut8(const uchar* src, uchar* dst, size_t bytes, const uchar* lut);
+
+        // YCbCr422_8 (Y0 Cb Y1 Cr, full range BT.601 as the camera ISP sends
+        // it) to BGR8. Chroma is read per pair of pixels, so src holds
+        // 2*((pixels + 1)/2) pairs of bytes.
+        void yuv422_to_bgr(const uchar* src, uchar* dst, size_t pixels);
+
+        // BGR8 through a 3x3 matrix (Q12, row major, BGR order: out b =
+        // m[0] b + m[1] g + m[2] r), in place when src == dst. Each product
+        // is rounded to 1/16 of a level, so |m| < 8.
+        void color_matrix(const uchar* src, uchar* dst, size_t pixels, const short* m);
+
+        // Exposure fusion of a short/long pair, byte by byte (any channel
+        // count). The long exposure is kept up to `knee` and hands over to the
+        // short one linearly until it clips at 255, so shadows come from the
+        // long frame and glare from the short one. knee in [0, 254].
+        void fuse_exposures(const uchar* short_exp, const uchar* long_exp, uchar* dst, size_t bytes, int knee);
+
+        // Adds the bytes to a 16 bin histogram (v >> 4) and their sum
+        void histogram16(const uchar* src, size_t bytes, uint32_t* hist, uint64_t& sum);
+
+        // Tone curves: "linear" keeps the top 8 bits, "gamma" brightens the
+        // shadows with 1/gamma, where most of a dark underwater scene sits
+        bool make_tone_lut(string curve, double gamma, vector<uchar>& lut);
+
+        // 256 entry tone curve: gamma (out = in^(1/gamma)), then contrast
+        // around mid grey
+        bool make_curve_lut(double gamma, double contrast, vector<uchar>& lut);
+
+        // Instruction set the unpack kernels run with: "ssse3", "neon" or "scalar"
+        string simd_name();
+
+        // Variant picked per kernel, "unpack12p ssse3, unpack10p ssse3, ..."
+        string selected();
+
+        // Runs every variant this CPU supports against the scalar one on
+        // random rows of every tail length. A variant differing in any byte
+        // is added to failures and its kernel falls back to the scalar one.
+        // Not thread safe, call before the kernels are in use.
+        bool self_check(vector<string>& failures);
+
+    }
+
+}
+
+#endif
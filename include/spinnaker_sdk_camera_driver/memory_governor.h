@@ -0,0 +1,76 @@
+#ifndef MEMORY_GOVERNOR_HEADER
+#define MEMORY_GOVERNOR_HEADER
+
+#include "std_include.h"
+
+#include <boost/function.hpp>
+#include "provider_vision/MemoryUsage.h"
+
+using namespace std;
+
+namespace acquisition {
+
+    // Single memory budget shared by every buffering component of the node
+    // (driver buffers, frame pool, writer queues, publish buffers, ...).
+    // Components register a usage probe and, if they can give memory back, a
+    // shed callback. When the total crosses the high watermark of the budget
+    // (or the system itself runs low), components are asked to shed in
+    // ascending priority order until usage is back under the low watermark.
+    class MemoryGovernor {
+
+    public:
+
+        // Returns the bytes currently held by a component
+        typedef boost::function<size_t()> UsageFn;
+        // Asked to free at least the given number of bytes, returns what it freed
+        typedef boost::function<size_t(size_t)> ShedFn;
+
+        MemoryGovernor(ros::NodeHandle nh, size_t budget_bytes, float high_watermark = 0.9, float low_watermark = 0.75);
+
+        void register_component(string name, int priority, UsageFn usage, ShedFn shed = ShedFn(), size_t limit = 0);
+        void set_priority(string name, int priority);
+        void set_max_system_usage(float usage) { max_system_usage_ = usage; }
+        void set_period(double seconds) { period_ = seconds; }
+
+        // Polls every component, enforces the budget and publishes the usage.
+        // Cheap to call every frame, the work is done at most once per period.
+        void update(bool force = false);
+
+        size_t total_usage();
+        size_t budget() { return budget_; }
+
+        // Fraction of system memory in use, from /proc/meminfo
+        static float system_usage();
+
+    private:
+
+        struct Component {
+            string name;
+            int priority;
+            UsageFn usage;
+            ShedFn shed;
+            size_t limit;
+            size_t last_usage;
+            uint64_t shed_bytes;
+        };
+
+        size_t shed(size_t bytes_to_free);
+        void publish(float sys_usage);
+
+        vector<Component> components_;
+        boost::mutex mutex_;
+
+        size_t budget_;
+        float high_watermark_;
+        float low_watermark_;
+        float max_system_usage_;
+        double period_;
+        double last_update_;
+
+        ros::Publisher usage_pub_;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef PIPELINE_HEADER
+#define PIPELINE_HEADER
+
+#include "std_include.h"
+#include "frame.h"
+
+#include <map>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+using namespace std;
+
+namespace acquisition {
+
+    // Bounded FIFO between two pipeline stages. When full, a push either
+    // drops the oldest entry (live stages, latest frame matters) or blocks
+    // the producer (recording, every frame matters).
+    template <typename T>
+    class BoundedQueue {
+
+    public:
+
+        BoundedQueue(int capacity = 2, bool drop_oldest = true)
+            : capacity_(max(capacity, 1)), drop_oldest_(drop_oldest), closed_(false) {}
+
+        // Returns false if an entry had to be dropped, `dropped` receives it
+        bool push(const T& item, T* dropped = NULL) {
+            boost::mutex::scoped_lock lock(mutex_);
+            bool ok = true;
+            if (drop_oldest_) {
+                if (items_.size() >= capacity_) {
+                    if (dropped)
+                        *dropped = items_.front();
+                    items_.pop_front();
+                    ok = false;
+                }
+            } else {
+                while (items_.size() >= capacity_ && !closed_)
+                    not_full_.wait(lock);
+            }
+            items_.push_back(item);
+            not_empty_.notify_one();
+            return ok;
+        }
+
+        // Blocks until an entry is available, false once closed and drained
+        bool pop(T& item) {
+            boost::mutex::scoped_lock lock(mutex_);
+            while (items_.empty() && !closed_)
+                not_empty_.wait(lock);
+            if (items_.empty())
+                return false;
+            item = items_.front();
+            items_.pop_front();
+            not_full_.notify_one();
+            return true;
+        }
+
+        void close() {
+            boost::mutex::scoped_lock lock(mutex_);
+            closed_ = true;
+            not_empty_.notify_all();
+            not_full_.notify_all();
+        }
+
+        int size() {
+            boost::mutex::scoped_lock lock(mutex_);
+            return items_.size();
+        }
+
+    private:
+
+        deque<T> items_;
+        int capacity_;
+        bool drop_oldest_;
+        bool closed_;
+        boost::mutex mutex_;
+        boost::condition_variable not_empty_;
+        boost::condition_variable not_full_;
+
+    };
+
+    struct StageStats {
+        uint64_t processed;
+        uint64_t dropped;       // dropped at the input queue
+        uint64_t rejected;      // the stage returned false
+        double total_time;      // seconds
+        int queued;
+    };
+
+    // Processing graph of one camera. Every stage owns a bounded input queue
+    // and a thread, so consecutive frames are in different stages at the same
+    // time and the throughput is that of the slowest stage rather than the
+    // sum of all of them. Stages without an input edge receive the frames
+    // pushed into the pipeline; a stage output is handed to all of its
+    // successors (fan-out shares the pixels, stages must assign a new Mat
+    // rather than write into the one they received). The acquired buffer
+    // (Frame::raw) has a single owner: it only goes to the first source and
+    // the first successor, and is released wherever the frame stops.
+    class Pipeline {
+
+    public:
+
+        // Returns false to stop the frame at this stage
+        typedef boost::function<bool(Frame&)> StageFn;
+
+        Pipeline(string name);
+        ~Pipeline();
+
+        void add_stage(string name, StageFn fn, int queue_size = 2, bool drop_oldest = true);
+        bool connect(string from, string to);
+
+        void start();
+
+        // Closes the sources, then every stage once all of its inputs have
+        // finished and its queue is drained, so no frame is lost in between
+        void stop();
+
+        // Feeds the source stages, never blocks on a dropping queue
+        void push(const Frame& frame);
+
+        // Blocks until every acquired buffer pushed so far was converted or
+        // released, so the camera's stream can be stopped or its buffers
+        // freed. The caller must not push meanwhile.
+        void wait_raw_released();
+
+        string name() { return name_; }
+        string describe();
+        map<string, StageStats> stats();
+        void log_stats();
+
+    private:
+
+        struct Stage {
+            string name;
+            StageFn fn;
+            boost::shared_ptr<BoundedQueue<Frame> > input;
+            vector<int> next;
+            bool has_input;
+            int inputs;             // predecessors still running, see stop()
+            StageStats stats;
+        };
+
+        void stage_loop(int id);
+        void stage_done(int id);
+        void release_raw(Frame& frame);
+        void raw_released();
+        void forward(int id, const Frame& frame);
+        void enqueue(int id, const Frame& frame);
+        int find(string name);
+        bool reaches(int from, int to);
+
+        string name_;
+        vector<boost::shared_ptr<Stage> > stages_;
+        boost::thread_group threads_;
+        boost::mutex stats_mutex_;
+        bool running_;
+
+        int raw_frames_;        // acquired buffers in the graph, guarded by raw_mutex_
+        boost::mutex raw_mutex_;
+        boost::condition_variable raw_cond_;
+
+    };
+
+}
+
+#endif
@@ -10,6 +10,8 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/highgui/highgui_c.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
 
 // ROS
 #include <ros/ros.h>
@@ -40,6 +42,8 @@
 #include <string>
 
 #include <queue> 
+#include <deque>
+#include <algorithm>
 #include <boost/thread.hpp>
 
 #include <unistd.h>
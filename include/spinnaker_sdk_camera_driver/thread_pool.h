@@ -0,0 +1,118 @@
+#ifndef THREAD_POOL_HEADER
+#define THREAD_POOL_HEADER
+
+#include "std_include.h"
+
+#include <map>
+#include <atomic>
+#include <exception>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+using namespace std;
+
+namespace acquisition {
+
+    // Counts outstanding tasks so a caller can wait for a batch of them, and
+    // keeps the first exception one of them threw for the waiter
+    class TaskGroup {
+
+    public:
+
+        TaskGroup() : pending_(0) {}
+        // Blocks until the tasks still pointing at the group are done, when
+        // its owner unwinds before wait()
+        ~TaskGroup();
+
+        void add() { pending_++; }
+        void done();
+        void fail(std::exception_ptr error);
+        bool finished();
+        // Blocks until finished() or the timeout elapsed
+        void wait_for(int timeout_us);
+        // Throws the first failure again, once, and forgets it
+        void rethrow();
+
+    private:
+
+        std::atomic<int> pending_;
+        std::exception_ptr error_;
+        boost::mutex mutex_;
+        boost::condition_variable cond_;
+
+    };
+
+    struct TaskStats {
+        uint64_t count;
+        uint64_t stolen;
+        double total_time;  // seconds
+        double max_time;
+    };
+
+    // Work-stealing executor shared by all cameras. Every worker owns a deque:
+    // it pops its own work LIFO (cache warm) and steals FIFO from the others
+    // when it runs dry, so per camera batches spread over whatever cores are
+    // free instead of being pinned to one thread per camera.
+    class WorkStealingPool {
+
+    public:
+
+        typedef boost::function<void()> Task;
+        typedef boost::function<void(int, int)> RowTask;
+
+        WorkStealingPool(int num_threads = 0);
+        ~WorkStealingPool();
+
+        void submit(Task task, string tag = "", TaskGroup* group = NULL);
+
+        // Waits for the group, running its queued tasks on the calling thread
+        // meanwhile so waiting from inside a task can't deadlock the pool.
+        // Other tasks are left to the workers. Throws the first exception
+        // a task of the group threw, once they are all done.
+        void wait(TaskGroup& group);
+
+        // Runs fn(row_begin, row_end) over [0, rows) split in bands of at
+        // least min_band rows and returns once every band is done
+        void parallel_for_rows(int rows, int min_band, RowTask fn, string tag = "");
+
+        int size() { return workers_.size(); }
+
+        map<string, TaskStats> stats();
+        void log_stats();
+        void reset_stats();
+
+    private:
+
+        struct Item {
+            Task task;
+            string tag;
+            TaskGroup* group;
+        };
+
+        struct Worker {
+            boost::mutex mutex;
+            deque<Item> tasks;
+        };
+
+        void worker_loop(int id);
+        bool try_pop(int id, Item& item, bool& stolen);
+        bool try_pop_group(int id, TaskGroup& group, Item& item);
+        void run(Item& item, bool stolen);
+
+        vector<boost::shared_ptr<Worker> > workers_;
+        boost::thread_group threads_;
+
+        boost::mutex sleep_mutex_;
+        boost::condition_variable wake_;
+        std::atomic<int> queued_;
+        std::atomic<unsigned> next_;
+        bool stop_;
+
+        boost::mutex stats_mutex_;
+        map<string, TaskStats> stats_;
+
+    };
+
+}
+
+#endif
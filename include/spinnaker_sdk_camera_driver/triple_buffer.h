@@ -0,0 +1,69 @@
+#ifndef TRIPLE_BUFFER_HEADER
+#define TRIPLE_BUFFER_HEADER
+
+#include <atomic>
+
+namespace acquisition {
+
+    // Lock-free single producer / single consumer triple buffer with
+    // latest-wins semantics. The producer always owns one slot and the
+    // consumer another; the third one is exchanged atomically together with
+    // a "fresh" bit. Neither side ever waits on the other, and a value
+    // published while the consumer is busy simply replaces the previous one.
+    template <typename T>
+    class TripleBuffer {
+
+    public:
+
+        TripleBuffer() : write_(0), read_(1), middle_(2) {}
+
+        // Slot owned by the producer, fill it then call publish()
+        T& write_buffer() { return buffers_[write_]; }
+
+        void publish() {
+            unsigned prev = middle_.exchange(write_ | FRESH, std::memory_order_acq_rel);
+            write_ = prev & INDEX;
+        }
+
+        void publish(const T& value) {
+            write_buffer() = value;
+            publish();
+        }
+
+        // Consumer side. Grabs the newest published slot if there is one,
+        // returns false when nothing was published since the last call.
+        bool update() {
+            if (!(middle_.load(std::memory_order_acquire) & FRESH))
+                return false;
+            unsigned prev = middle_.exchange(read_, std::memory_order_acq_rel);
+            read_ = prev & INDEX;
+            return true;
+        }
+
+        // Slot owned by the consumer, valid until the next update()
+        const T& read_buffer() const { return buffers_[read_]; }
+
+        bool latest(T& out) {
+            bool fresh = update();
+            out = buffers_[read_];
+            return fresh;
+        }
+
+    private:
+
+        static const unsigned INDEX = 3;
+        static const unsigned FRESH = 4;
+
+        T buffers_[3];
+        unsigned write_;
+        unsigned read_;
+        std::atomic<unsigned> middle_;
+
+        TripleBuffer(const TripleBuffer&);
+        TripleBuffer& operator=(const TripleBuffer&);
+
+    };
+
+}
+
+#endif
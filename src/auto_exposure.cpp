@@ -0,0 +1,76 @@
+#include "spinnaker_sdk_camera_driver/auto_exposure.h"
+
+acquisition::AutoExposure::AutoExposure(const AutoExposureSettings& settings, double exposure_us, double gain_db) {
+
+    settings_ = settings;
+    exposure_ = exposure_us;
+    gain_ = gain_db;
+    settle_ = 0;
+
+}
+
+acquisition::ExposureStats acquisition::AutoExposure::meter(const Mat& frame, const Rect2d& roi, int stride) {
+
+    ExposureStats stats;
+    if (frame.empty() || frame.depth() != CV_8U)
+        return stats;
+
+    Rect area = Rect(cvRound(roi.x*frame.cols), cvRound(roi.y*frame.rows),
+                     cvRound(roi.width*frame.cols), cvRound(roi.height*frame.rows)) & Rect(0, 0, frame.cols, frame.rows);
+    // Every channel counts, close enough to the luminance for metering.
+    // YCbCr has the luminance itself, its chroma would only pull to grey.
+    size_t bytes = area.width*frame.elemSize();
+    vector<uchar> luma(frame.channels() == 2 ? area.width : 0);
+    for (int y = area.y; y < area.y + area.height; y += max(stride, 1)) {
+        const uchar* row = frame.ptr(y) + area.x*frame.elemSize();
+        if (luma.empty()) {
+            kernels::histogram16(row, bytes, stats.hist, stats.sum);
+            continue;
+        }
+        for (int x = 0; x < area.width; x++)
+            luma[x] = row[2*x];
+        kernels::histogram16(&luma[0], luma.size(), stats.hist, stats.sum);
+    }
+    for (int b = 0; b < 16; b++)
+        stats.count += stats.hist[b];
+    return stats;
+
+}
+
+bool acquisition::AutoExposure::update(const ExposureStats& stats, const FrameMetadata& meta) {
+
+    if (!stats.count)
+        return false;
+
+    // What the metered frame was actually exposed with
+    double exposure = exposure_, gain = gain_;
+    if (meta.valid && meta.exposure_time > 0) {
+        exposure = meta.exposure_time;
+        gain = meta.gain;
+    } else if (settle_ > 0) {
+        settle_--;
+        return false;
+    }
+
+    double error = log2(max(settings_.target, 1.0)/max(stats.mean(), 1.0));
+    // Glare near the surface clips before the mean says so
+    if (double(stats.hist[15])/stats.count > settings_.clip_limit)
+        error = min(error, -0.25);
+    error = min(max(error, -2.0), 2.0);
+
+    // Within ~3% of the target, writing would only make it hunt
+    if (fabs(error) < 0.05)
+        return false;
+
+    double total = exposure*pow(10, gain/20)*pow(2, settings_.speed*error);
+    exposure = min(max(total, settings_.min_exposure), settings_.max_exposure);
+    gain = min(max(20*log10(total/exposure), 0.0), settings_.max_gain);
+    // A frame older than the last change asks for it again
+    if (fabs(exposure - exposure_) < 1 && fabs(gain - gain_) < 0.05)
+        return false;
+    exposure_ = exposure;
+    gain_ = gain;
+    settle_ = settings_.settle;
+    return true;
+
+}
@@ -0,0 +1,130 @@
+#include "spinnaker_sdk_camera_driver/bandwidth_planner.h"
+
+acquisition::BandwidthPlanner::BandwidthPlanner(double budget_bytes_per_s, double headroom) {
+
+    budget_ = budget_bytes_per_s;
+    headroom_ = headroom;
+
+}
+
+double acquisition::BandwidthPlanner::total() {
+
+    double sum = 0;
+    for (int i=0; i<cams_.size(); i++)
+        sum += cams_[i].required()*(1 + headroom_);
+    return sum;
+
+}
+
+bool acquisition::BandwidthPlanner::fits(const LinkDemand& cam) {
+
+    double need = cam.required()*(1 + headroom_);
+    if (cam.link_speed > 0 && need > cam.link_speed)
+        return false;
+    if (cam.limit_max > 0 && need > cam.limit_max)
+        return false;
+    return true;
+
+}
+
+bool acquisition::BandwidthPlanner::fits() {
+
+    for (int i=0; i<cams_.size(); i++)
+        if (!fits(cams_[i]))
+            return false;
+    return total() <= budget_;
+
+}
+
+// One step of the given kind on the most demanding camera that allows it
+bool acquisition::BandwidthPlanner::downgrade(string step) {
+
+    if (step == "fps") {
+        // A common rate keeps the set synchronized, scale it to the tightest constraint
+        double scale = budget_/total();
+        for (int i=0; i<cams_.size(); i++) {
+            double need = cams_[i].required()*(1 + headroom_);
+            if (cams_[i].link_speed > 0)
+                scale = min(scale, cams_[i].link_speed/need);
+            if (cams_[i].limit_max > 0)
+                scale = min(scale, cams_[i].limit_max/need);
+        }
+        if (scale >= 1 || cams_.empty())
+            return false;
+        for (int i=0; i<cams_.size(); i++) {
+            // Round down to 0.1 fps so the result is reproducible
+            double fps = floor(cams_[i].fps*scale*10)/10;
+            if (fps < 0.1)
+                return false;
+            ostringstream ss;
+            ss << "fps " << cams_[i].fps << " -> " << fps;
+            cams_[i].downgrades.push_back(ss.str());
+            cams_[i].fps = fps;
+        }
+        return true;
+    }
+
+    int worst = -1;
+    for (int i=0; i<cams_.size(); i++) {
+        bool possible = (step == "format" && cams_[i].bytes_per_pixel > 1) ||
+                        (step == "binning" && cams_[i].binning < 4);
+        // Ties go to the lowest index, the plan must not depend on anything else
+        if (possible && (worst < 0 || cams_[i].required() > cams_[worst].required()))
+            worst = i;
+    }
+    if (worst < 0)
+        return false;
+
+    ostringstream ss;
+    if (step == "format") {
+        ss << "format " << cams_[worst].bytes_per_pixel << " -> 1 bytes/pixel";
+        cams_[worst].bytes_per_pixel = 1;
+    } else {
+        ss << "binning " << cams_[worst].binning << " -> " << cams_[worst].binning*2;
+        cams_[worst].binning *= 2;
+    }
+    cams_[worst].downgrades.push_back(ss.str());
+    return true;
+
+}
+
+bool acquisition::BandwidthPlanner::plan(const vector<string>& downgrade_order) {
+
+    for (int k=0; k<downgrade_order.size() && !fits(); k++) {
+        if (downgrade_order[k] != "format" && downgrade_order[k] != "binning" && downgrade_order[k] != "fps") {
+            ROS_WARN_STREAM("Bandwidth planner: unknown downgrade " << downgrade_order[k] << ", skipped");
+            continue;
+        }
+        while (!fits() && downgrade(downgrade_order[k]));
+    }
+
+    bool ok = fits();
+
+    // Cap every camera at its share, the spare budget is split evenly
+    double spare = ok && !cams_.empty() ? (budget_ - total())/cams_.size() : 0;
+    for (int i=0; i<cams_.size(); i++) {
+        int64_t limit = ceil(cams_[i].required()*(1 + headroom_) + spare);
+        if (cams_[i].limit_max > 0)
+            limit = min(limit, cams_[i].limit_max);
+        limit = max(limit, cams_[i].limit_min);
+        cams_[i].throughput_limit = limit;
+    }
+
+    return ok;
+
+}
+
+void acquisition::BandwidthPlanner::log() {
+
+    for (int i=0; i<cams_.size(); i++) {
+        ostringstream ss;
+        for (int k=0; k<cams_[i].downgrades.size(); k++)
+            ss << (k ? ", " : "") << cams_[i].downgrades[k];
+        ROS_INFO("Camera %s: %dx%d /%d bin, %.2f bytes/pixel @ %.1f fps = %.1f MB/s, link %.0f MB/s, limit %.1f MB/s%s%s",
+                 cams_[i].id.c_str(), cams_[i].width, cams_[i].height, cams_[i].binning, cams_[i].bytes_per_pixel,
+                 cams_[i].fps, cams_[i].required()/1048576.0, cams_[i].link_speed/1048576.0,
+                 cams_[i].throughput_limit/1048576.0, ss.str().empty() ? "" : ", downgraded: ", ss.str().c_str());
+    }
+    ROS_INFO("Bus total: %.1f MB/s (%.0f%% headroom included) of %.1f MB/s", total()/1048576.0, headroom_*100, budget_/1048576.0);
+
+}
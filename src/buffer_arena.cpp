@@ -0,0 +1,131 @@
+#include "spinnaker_sdk_camera_driver/buffer_arena.h"
+
+#include <sys/mman.h>
+
+acquisition::BufferArena::BufferArena(bool use_hugepages) {
+
+    USE_HUGEPAGES_ = use_hugepages;
+
+}
+
+acquisition::BufferArena::~BufferArena() {
+
+    release_all();
+
+}
+
+void acquisition::BufferArena::ensure_slot(int cam) {
+
+    while (regions_.size() <= cam) {
+        regions_.push_back(Region());
+        previous_.push_back(Region());
+    }
+
+}
+
+bool acquisition::BufferArena::reserve(int cam, size_t payload, int count) {
+
+    boost::mutex::scoped_lock lock(mutex_);
+    ensure_slot(cam);
+
+    // Every slice starts on a page boundary
+    size_t page = FramePool::page_size();
+    size_t slice = (payload + page - 1) / page * page;
+    size_t total = slice * count;
+
+    if (regions_[cam].ptr && regions_[cam].size >= total && regions_[cam].slice == slice && regions_[cam].slices.size() == count)
+        return true;
+
+    Region r;
+    r.ptr = FramePool::map_block(total, USE_HUGEPAGES_, &r.huge);
+    if (!r.ptr) {
+        ROS_ERROR_STREAM("Could not map " << total << " bytes of acquisition buffers for camera " << cam);
+        return false;
+    }
+    r.size = r.huge ? (total + FramePool::hugepage_size() - 1) / FramePool::hugepage_size() * FramePool::hugepage_size() : total;
+
+    // Touch and pin the pages so the first frames don't page fault in the driver
+    memset(r.ptr, 0, total);
+    r.pinned = mlock(r.ptr, total) == 0;
+    ROS_WARN_STREAM_COND(!r.pinned, "Could not pin acquisition buffers of camera " << cam
+                         << " (" << strerror(errno) << "), check 'ulimit -l'");
+
+    r.slice = slice;
+    for (int i=0; i<count; i++)
+        r.slices.push_back((char*)r.ptr + i*slice);
+
+    unmap(previous_[cam]);
+    previous_[cam] = regions_[cam];
+    regions_[cam] = r;
+    return true;
+
+}
+
+// The stream took the new buffers, the old ones can go
+void acquisition::BufferArena::release_previous(int cam) {
+
+    boost::mutex::scoped_lock lock(mutex_);
+    if (cam < previous_.size())
+        unmap(previous_[cam]);
+
+}
+
+// The stream kept the old buffers, the new ones go
+void acquisition::BufferArena::restore_previous(int cam) {
+
+    boost::mutex::scoped_lock lock(mutex_);
+    if (cam >= previous_.size() || !previous_[cam].ptr)
+        return;
+    unmap(regions_[cam]);
+    regions_[cam] = previous_[cam];
+    previous_[cam] = Region();
+
+}
+
+void acquisition::BufferArena::release(int cam) {
+
+    boost::mutex::scoped_lock lock(mutex_);
+    if (cam >= regions_.size())
+        return;
+    unmap(regions_[cam]);
+    unmap(previous_[cam]);
+
+}
+
+void acquisition::BufferArena::unmap(Region& r) {
+
+    if (!r.ptr)
+        return;
+    if (r.pinned)
+        munlock(r.ptr, r.slice*r.slices.size());
+    FramePool::unmap_block(r.ptr, r.size, r.huge);
+    r = Region();
+
+}
+
+void acquisition::BufferArena::release_all() {
+
+    boost::mutex::scoped_lock lock(mutex_);
+    for (int i=0; i<regions_.size(); i++) {
+        unmap(regions_[i]);
+        unmap(previous_[i]);
+    }
+
+}
+
+size_t acquisition::BufferArena::footprint(int cam) {
+
+    boost::mutex::scoped_lock lock(mutex_);
+    return cam < regions_.size() ? regions_[cam].size : 0;
+
+}
+
+size_t acquisition::BufferArena::total_footprint() {
+
+    boost::mutex::scoped_lock lock(mutex_);
+    size_t total = 0;
+    for (int i=0; i<regions_.size(); i++)
+        total += regions_[i].size + previous_[i].size;
+    return total;
+
+}
@@ -22,6 +22,14 @@ acquisition::Camera::Camera(CameraPtr pCam) {
     MASTER_ = false;
     timestamp_ = 0;
     GET_NEXT_IMAGE_TIMEOUT_ = 2000;
+    frame_pool_ = NULL;
+    tone_lut_ = NULL;
+    CHUNKS_ = false;
+    PUBLISH_YUV_ = false;
+    demosaic_.name = "default";
+    demosaic_.spinnaker = DEFAULT;
+    demosaic_.cv_code = -1;
+    output_size_.reset(new Size(600, 400));
     
 }
 
@@ -37,6 +45,26 @@ void acquisition::Camera::deinit() {
 
 }
 
+void acquisition::Camera::reset(CameraPtr pCam) {
+
+    pCam_ = pCam;
+
+    if (pCam_->IsInitialized()) {
+        pCam_->EndAcquisition();
+        pCam_->DeInit();
+    }
+
+    // The stream and the node map start over with the device
+    lastFrameID_ = -1;
+    frameID_ = -1;
+    timestamp_ = 0;
+    metadata_ = FrameMetadata();
+    CHUNKS_ = false;
+    exposure_node_ = CFloatPtr();
+    gain_node_ = CFloatPtr();
+
+}
+
 ImagePtr acquisition::Camera::grab_frame() {
 
     ImagePtr pResultImage = pCam_->GetNextImage(GET_NEXT_IMAGE_TIMEOUT_);
@@ -49,6 +77,21 @@ ImagePtr acquisition::Camera::grab_frame() {
     } else {
 
         timestamp_ = pResultImage->GetTimeStamp();
+
+        metadata_ = FrameMetadata();
+        if (CHUNKS_) {
+            try {
+                const ChunkData& chunk = pResultImage->GetChunkData();
+                metadata_.frame_id = chunk.GetFrameID();
+                metadata_.timestamp = chunk.GetTimestamp();
+                metadata_.exposure_time = chunk.GetExposureTime();
+                metadata_.gain = chunk.GetGain();
+                metadata_.black_level = chunk.GetBlackLevel();
+                metadata_.valid = true;
+            } catch (Spinnaker::Exception &e) {
+                ROS_WARN_STREAM_THROTTLE(5, "Unable to read chunk data of camera " << get_id() << ": " << e.what());
+            }
+        }
     
         if (frameID_ >= 0) {
             lastFrameID_ = frameID_;
@@ -89,29 +132,218 @@ Mat acquisition::Camera::grab_mat_frame() {
 
 Mat acquisition::Camera::convert_to_mat(ImagePtr pImage) {
 
-    ImagePtr convertedImage;
-    if (COLOR_)
-        convertedImage = pImage->Convert(PixelFormat_BGR8); //, NEAREST_NEIGHBOR);
-    else
-		convertedImage = pImage->Convert(PixelFormat_Mono8); //, NEAREST_NEIGHBOR);
-    unsigned int XPadding = convertedImage->GetXPadding();
-    unsigned int YPadding = convertedImage->GetYPadding();
-    unsigned int rowsize = convertedImage->GetWidth();
-    unsigned int colsize = convertedImage->GetHeight();
-    //image data contains padding. When allocating Mat container size, you need to account for the X,Y image data padding.
-    Mat img;
-    if (COLOR_)
-        img = Mat(colsize + YPadding, rowsize + XPadding, CV_8UC3, convertedImage->GetData(), convertedImage->GetStride());
-    else
-        img = Mat(colsize + YPadding, rowsize + XPadding, CV_8UC1, convertedImage->GetData(), convertedImage->GetStride());
+    return finish_colors(resize_output(convert_image(pImage)), true);
     
-    // resize the image
-    cv::resize(img, img, cv::Size(600,400), cv::INTER_LINEAR);
-    return img.clone();
-    // return img;
+}
+
+Mat acquisition::Camera::resize_output(Mat img) {
+
+    // A 16 bit Bayer mosaic or 4:2:2 YCbCr is published as is, scaling
+    // would mix its colors
+    Size size = output_size();
+    if (size.area() == 0 || (COLOR_ && img.depth() == CV_16U) || img.channels() == 2)
+        return img;
+
+    // resize the image, the destination is a fresh (pooled) buffer so no clone is needed
+    Mat resized;
+    resized.allocator = frame_pool_;
+    cv::resize(img, resized, size, 0, 0, cv::INTER_LINEAR);
+    return resized;
     
 }
 
+// Converts to BGR8/Mono8 at full resolution, straight into a buffer we own
+// (pooled when a frame pool is set) instead of one allocated by Spinnaker.
+// Packed 10/12 bit formats and YCbCr go through our own kernels instead.
+// The color matrix and the tone curve are left to finish_colors().
+Mat acquisition::Camera::convert_image(ImagePtr pImage, Size size) {
+
+    int bits = packed_bits(pImage->GetPixelFormat());
+    if (bits)
+        return unpack_image(pImage, bits);
+    if (pImage->GetPixelFormat() == PixelFormat_YCbCr422_8)
+        return convert_yuv(pImage, size);
+
+    PixelFormatEnums format = COLOR_ ? PixelFormat_BGR8 : PixelFormat_Mono8;
+    int mat_type = COLOR_ ? CV_8UC3 : CV_8UC1;
+
+    Mat img;
+    img.allocator = frame_pool_;    // NULL falls back on OpenCV's allocator
+    img.create(pImage->GetHeight(), pImage->GetWidth(), mat_type);
+
+    // Already processed on the camera (ISP), only the copy is left
+    if (pImage->GetPixelFormat() == format) {
+        Mat src(pImage->GetHeight(), pImage->GetWidth(), mat_type, pImage->GetData(), pImage->GetStride());
+        src.copyTo(img);
+        return img;
+    }
+
+    if (COLOR_ && demosaic_.cv_code >= 0 && pImage->GetPixelFormat() == PixelFormat_BayerRG8) {
+        Mat bayer(img.rows, img.cols, CV_8UC1, pImage->GetData(),
+                  pImage->GetStride() ? pImage->GetStride() : (size_t)img.cols);
+        cvtColor(bayer, img, demosaic_.cv_code);
+    } else {
+        ImagePtr convertedImage = Image::Create(pImage->GetWidth(), pImage->GetHeight(), 0, 0, format, img.data);
+        pImage->Convert(convertedImage, format, demosaic_.spinnaker);
+    }
+    return img;
+
+}
+
+// The color matrix then the tone curve, in one pass a row at a time, on a
+// frame already at its output resolution: the matrix mixes the colors as
+// the sensor delivered them, the curve encodes the result. Into a new
+// (pooled) frame unless in_place, `img` may share its pixels with other
+// frames or ROIs.
+Mat acquisition::Camera::finish_colors(const Mat& img, bool in_place) {
+
+    boost::shared_ptr<const vector<uchar> > curve = boost::atomic_load(&tone_curve_);
+    boost::shared_ptr<const vector<short> > matrix = boost::atomic_load(&color_matrix_);
+    const short* m = matrix && img.type() == CV_8UC3 ? &(*matrix)[0] : NULL;
+    if (img.depth() != CV_8U || img.channels() == 2 || (!curve && !m))
+        return img;
+
+    Mat out = img;
+    if (!in_place) {
+        out = Mat();
+        out.allocator = frame_pool_;
+        out.create(img.rows, img.cols, img.type());
+    }
+    for (int y = 0; y < img.rows; y++) {
+        const uchar* row = img.ptr(y);
+        if (m) {
+            kernels::color_matrix(row, out.ptr(y), img.cols, m);
+            row = out.ptr(y);
+        }
+        if (curve)
+            kernels::apply_lut8(row, out.ptr(y), img.cols*img.elemSize(), &(*curve)[0]);
+    }
+    return out;
+
+}
+
+int acquisition::Camera::packed_bits(PixelFormatEnums format) {
+
+    switch (format) {
+    case PixelFormat_Mono12p:
+    case PixelFormat_BayerRG12p:
+        return 12;
+    case PixelFormat_Mono10p:
+    case PixelFormat_BayerRG10p:
+        return 10;
+    default:
+        return 0;
+    }
+
+}
+
+// Mono16/BayerRG16 (MSB aligned) without a tone map. With one, every row is
+// unpacked into a scratch row still in cache and mapped to 8 bit from there,
+// Bayer is then demosaiced like Spinnaker would (RGGB is OpenCV's BG).
+Mat acquisition::Camera::unpack_image(ImagePtr pImage, int bits) {
+
+    int width = pImage->GetWidth();
+    int height = pImage->GetHeight();
+    const uchar* src = (const uchar*)pImage->GetData();
+    size_t stride = pImage->GetStride();
+    if (stride == 0)
+        stride = (width*bits + 7)/8;
+
+    Mat img;
+    img.allocator = frame_pool_;
+
+    if (!tone_lut_) {
+        if (boost::atomic_load(&tone_curve_))
+            ROS_WARN_ONCE("Tone curves apply to 8 bit output, set a 'tone_map' with 'bit_depth' above 8");
+        img.create(height, width, CV_16UC1);
+        for (int y = 0; y < height; y++)
+            kernels::unpack_row(bits, src + y*stride, img.ptr<ushort>(y), width);
+        return img;
+    }
+
+    Mat mapped;
+    mapped.allocator = frame_pool_;
+    mapped.create(height, width, CV_8UC1);
+    vector<ushort> row(width);
+    for (int y = 0; y < height; y++) {
+        kernels::unpack_row(bits, src + y*stride, &row[0], width);
+        kernels::apply_tone_lut(&row[0], mapped.ptr<uchar>(y), width, tone_lut_);
+    }
+    if (!COLOR_)
+        return mapped;
+
+    img.create(height, width, CV_8UC3);
+    // OpenCV's bilinear unless an algorithm was picked
+    if (demosaic_.name == "default")
+        cvtColor(mapped, img, COLOR_BayerBG2BGR);
+    else
+        demosaic(mapped, img, demosaic_);
+    return img;
+
+}
+
+// YCbCr422_8 (Y0 Cb Y1 Cr) from the camera ISP, 2 bytes a pixel on the link
+// instead of 3. Published as sent, or converted to BGR row by row with the
+// SIMD kernel. When the output is smaller, the luma and the chroma pairs are
+// resampled first, so only the output pixels get converted.
+Mat acquisition::Camera::convert_yuv(ImagePtr pImage, Size size) {
+
+    int width = pImage->GetWidth();
+    int height = pImage->GetHeight();
+    size_t stride = pImage->GetStride() ? pImage->GetStride() : width*2;
+    Mat yuyv(height, width, CV_8UC2, pImage->GetData(), stride);
+
+    Mat img;
+    img.allocator = frame_pool_;
+
+    if (PUBLISH_YUV_) {
+        if (boost::atomic_load(&tone_curve_))
+            ROS_WARN_ONCE("Tone curves don't apply to the published YCbCr frames");
+        img.create(height, width, CV_8UC2);
+        yuyv.copyTo(img);
+        return img;
+    }
+
+    Mat src = yuyv;
+    bool resample = size.width > 0 && size.height > 0 && size.width < width && size.height <= height;
+    if (resample) {
+        Mat planes[2], luma, chroma;
+        split(yuyv, planes);
+        // Cb Cr pairs as a half width 2 channel image, resampled together
+        cv::resize(planes[0], luma, size, 0, 0, cv::INTER_LINEAR);
+        cv::resize(planes[1].reshape(2), chroma, Size((size.width + 1)/2, size.height), 0, 0, cv::INTER_LINEAR);
+        // An odd width repeats the last luma to fill its pair
+        src.create(size.height, (size.width + 1)/2*2, CV_8UC2);
+        for (int y = 0; y < src.rows; y++) {
+            uchar* dst = src.ptr(y);
+            const uchar* l = luma.ptr(y);
+            const uchar* c = chroma.ptr(y);
+            for (int x = 0; x < src.cols; x++) {
+                dst[2*x] = l[min(x, size.width - 1)];
+                dst[2*x + 1] = c[x];
+            }
+        }
+    }
+
+    img.create(src.rows, resample ? size.width : width, CV_8UC3);
+    for (int y = 0; y < img.rows; y++)
+        kernels::yuv422_to_bgr(src.ptr(y), img.ptr(y), img.cols);
+    return img;
+
+}
+
+string acquisition::Camera::ros_encoding(const Mat& img) {
+
+    if (img.channels() == 3)
+        return "bgr8";
+    if (img.channels() == 2)
+        return "yuv422_yuy2";
+    if (img.depth() == CV_16U)
+        return COLOR_ ? "bayer_rggb16" : "mono16";
+    return "mono8";
+
+}
+
 void acquisition::Camera::begin_acquisition() {
 
     ROS_INFO_STREAM("Begin Acquisition...");
@@ -181,6 +413,163 @@ void acquisition::Camera::setFloatValue(string setting, float val) {
     
 }
 
+// Turns chunk mode on with the given chunks, false if the camera has none.
+// Chunks missing on this model are skipped.
+bool acquisition::Camera::enableChunks(const vector<string>& chunks) {
+
+    INodeMap & nodeMap = pCam_->GetNodeMap();
+
+    CBooleanPtr active = nodeMap.GetNode("ChunkModeActive");
+    CEnumerationPtr selector = nodeMap.GetNode("ChunkSelector");
+    if (!IsAvailable(active) || !IsWritable(active) || !IsAvailable(selector) || !IsWritable(selector)) {
+        ROS_WARN_STREAM("Camera " << get_id() << " has no chunk data, frame metadata won't be available");
+        return false;
+    }
+    active->SetValue(true);
+
+    for (int i=0; i<chunks.size(); i++) {
+        CEnumEntryPtr entry = selector->GetEntryByName(chunks[i].c_str());
+        if (!IsAvailable(entry) || !IsReadable(entry)) {
+            ROS_WARN_STREAM("Camera " << get_id() << " has no " << chunks[i] << " chunk");
+            continue;
+        }
+        selector->SetIntValue(entry->GetValue());
+        CBooleanPtr enable = nodeMap.GetNode("ChunkEnable");
+        if (IsAvailable(enable) && IsWritable(enable))
+            enable->SetValue(true);
+    }
+
+    CHUNKS_ = true;
+    ROS_DEBUG_STREAM("Chunk data enabled on camera " << get_id());
+    return true;
+
+}
+
+// Two sequencer sets, short and long, each handing over to the other on
+// every frame start: the exposure alternates without a write per trigger
+bool acquisition::Camera::setExposureSequence(double short_us, double long_us) {
+
+    INodeMap & nodeMap = pCam_->GetNodeMap();
+
+    CEnumerationPtr mode = nodeMap.GetNode("SequencerMode");
+    CCommandPtr save = nodeMap.GetNode("SequencerSetSave");
+    if (!IsAvailable(mode) || !IsWritable(mode) || !IsAvailable(save))
+        return false;
+
+    try {
+        setEnumValue("SequencerMode", "Off");
+        setEnumValue("SequencerConfigurationMode", "On");
+        double exposures[2] = {short_us, long_us};
+        for (int set = 0; set < 2; set++) {
+            setIntValue("SequencerSetSelector", set);
+            setFloatValue("ExposureTime", exposures[set]);
+            setIntValue("SequencerPathSelector", 0);
+            setEnumValue("SequencerTriggerSource", "FrameStart");
+            setIntValue("SequencerSetNext", 1 - set);
+            save->Execute();
+        }
+        setIntValue("SequencerSetStart", 0);
+        setEnumValue("SequencerConfigurationMode", "Off");
+        setEnumValue("SequencerMode", "On");
+    } catch (Spinnaker::Exception &e) {
+        ROS_WARN_STREAM("Camera " << get_id() << ": unable to set up the exposure sequencer: " << e.what());
+        return false;
+    }
+
+    ROS_DEBUG_STREAM("Camera " << get_id() << " alternates " << short_us << " and " << long_us << " us exposures");
+    return true;
+
+}
+
+// Returns -1 when the node can't be read
+double acquisition::Camera::getFloatValue(string setting) {
+
+    CFloatPtr ptr = pCam_->GetNodeMap().GetNode(setting.c_str());
+    if (!IsAvailable(ptr) || !IsReadable(ptr)) {
+        ROS_WARN_STREAM("Unable to read " << setting << " on camera " << get_id());
+        return -1;
+    }
+    return ptr->GetValue();
+
+}
+
+// Symbolic name of the current entry, empty when the node can't be read
+string acquisition::Camera::getEnumValue(string setting) {
+
+    CEnumerationPtr ptr = pCam_->GetNodeMap().GetNode(setting.c_str());
+    if (!IsAvailable(ptr) || !IsReadable(ptr)) {
+        ROS_WARN_STREAM("Unable to read " << setting << " on camera " << get_id());
+        return "";
+    }
+    CEnumEntryPtr entry = ptr->GetCurrentEntry();
+    if (!IsAvailable(entry) || !IsReadable(entry))
+        return "";
+    return string(entry->GetSymbolic().c_str());
+
+}
+
+// Whether the node can be set to that entry on this model, in this state
+bool acquisition::Camera::hasEnumEntry(string setting, string value) {
+
+    CEnumerationPtr ptr = pCam_->GetNodeMap().GetNode(setting.c_str());
+    if (!IsAvailable(ptr) || !IsWritable(ptr))
+        return false;
+    CEnumEntryPtr entry = ptr->GetEntryByName(value.c_str());
+    return IsAvailable(entry) && IsReadable(entry);
+
+}
+
+void acquisition::Camera::setExposureGain(double exposure_us, double gain_db) {
+
+    if (!IsAvailable(exposure_node_) || !IsAvailable(gain_node_)) {
+        exposure_node_ = pCam_->GetNodeMap().GetNode("ExposureTime");
+        gain_node_ = pCam_->GetNodeMap().GetNode("Gain");
+    }
+    if (IsWritable(exposure_node_))
+        exposure_node_->SetValue(min(max(exposure_us, exposure_node_->GetMin()), exposure_node_->GetMax()));
+    if (IsWritable(gain_node_))
+        gain_node_->SetValue(min(max(gain_db, gain_node_->GetMin()), gain_node_->GetMax()));
+
+}
+
+// Returns -1 when the node can't be read
+int64_t acquisition::Camera::getIntValue(string setting) {
+
+    CIntegerPtr ptr = pCam_->GetNodeMap().GetNode(setting.c_str());
+    if (!IsAvailable(ptr) || !IsReadable(ptr)) {
+        ROS_WARN_STREAM("Unable to read " << setting << " on camera " << get_id());
+        return -1;
+    }
+    return ptr->GetValue();
+
+}
+
+bool acquisition::Camera::getIntRange(string setting, int64_t& min, int64_t& max) {
+
+    CIntegerPtr ptr = pCam_->GetNodeMap().GetNode(setting.c_str());
+    if (!IsAvailable(ptr) || !IsReadable(ptr))
+        return false;
+    min = ptr->GetMin();
+    max = ptr->GetMax();
+    return true;
+
+}
+
+// Camera clock at the time of the call (ns), -1 if unsupported
+int64_t acquisition::Camera::latch_timestamp() {
+
+    INodeMap & nodeMap = pCam_->GetNodeMap();
+    CCommandPtr latch = nodeMap.GetNode("TimestampLatch");
+    CIntegerPtr value = nodeMap.GetNode("TimestampLatchValue");
+    if (!IsAvailable(latch) || !IsWritable(latch) || !IsAvailable(value) || !IsReadable(value)) {
+        ROS_WARN_STREAM("Unable to latch the timestamp of camera " << get_id());
+        return -1;
+    }
+    latch->Execute();
+    return value->GetValue();
+
+}
+
 void acquisition::Camera::setBoolValue(string setting, bool val) {
 
     INodeMap & nodeMap = pCam_->GetNodeMap();
@@ -196,6 +585,87 @@ void acquisition::Camera::setBoolValue(string setting, bool val) {
     
 }
 
+// Whether the camera sends a raw mosaic, which the host demosaics
+bool acquisition::Camera::bayer_format() {
+
+    CEnumerationPtr format = pCam_->GetNodeMap().GetNode("PixelFormat");
+    return IsAvailable(format) && IsReadable(format) &&
+           string(format->GetCurrentEntry()->GetSymbolic().c_str()).find("Bayer") == 0;
+
+}
+
+// ReverseX/ReverseY on the sensor, true when it is set as asked. Never on
+// with a Bayer format: the mosaic would change phase under the demosaicing.
+bool acquisition::Camera::setReverse(string axis, bool on) {
+
+    INodeMap & nodeMap = pCam_->GetNodeMap();
+
+    CBooleanPtr ptr = nodeMap.GetNode(("Reverse" + axis).c_str());
+    if (!IsAvailable(ptr) || !IsWritable(ptr))
+        return false;
+    bool bayer = bayer_format();
+    ptr->SetValue(on && !bayer);
+    ROS_DEBUG_STREAM("Reverse" << axis << " set to " << (on && !bayer));
+    return !(on && bayer);
+
+}
+
+// The camera's own gamma (out = in^Gamma), 1 turns it off. True when it is
+// set as asked: not with Bayer formats, the camera applies it after its ISP.
+bool acquisition::Camera::setGamma(double gamma) {
+
+    INodeMap & nodeMap = pCam_->GetNodeMap();
+
+    CBooleanPtr enable = nodeMap.GetNode("GammaEnable");
+    CFloatPtr value = nodeMap.GetNode("Gamma");
+    if (!IsAvailable(enable) || !IsWritable(enable))
+        return false;
+    if (gamma == 1) {
+        enable->SetValue(false);
+        return true;
+    }
+    if (bayer_format() || !IsAvailable(value) || gamma < value->GetMin() || gamma > value->GetMax()) {
+        enable->SetValue(false);
+        return false;
+    }
+    enable->SetValue(true);
+    value->SetValue(gamma);
+    ROS_DEBUG_STREAM("Gamma set to " << gamma);
+    return true;
+
+}
+
+void acquisition::Camera::set_output_size(int width, int height) {
+
+    boost::shared_ptr<const Size> size(new Size(width > 0 && height > 0 ? Size(width, height) : Size()));
+    boost::atomic_store(&output_size_, size);
+
+}
+
+Size acquisition::Camera::output_size() {
+
+    return *boost::atomic_load(&output_size_);
+
+}
+
+void acquisition::Camera::set_tone_curve(const vector<uchar>& curve) {
+
+    boost::shared_ptr<const vector<uchar> > lut;
+    if (!curve.empty())
+        lut.reset(new vector<uchar>(curve));
+    boost::atomic_store(&tone_curve_, lut);
+
+}
+
+void acquisition::Camera::set_color_matrix(const vector<short>& matrix) {
+
+    boost::shared_ptr<const vector<short> > m;
+    if (matrix.size() == 9)
+        m.reset(new vector<short>(matrix));
+    boost::atomic_store(&color_matrix_, m);
+
+}
+
 
 
 void acquisition::Camera::setResolutionPixels(int width, int height) {
@@ -223,6 +693,41 @@ void acquisition::Camera::setResolutionPixels(int width, int height) {
     ptrHeight->SetValue(height);                                                                                                                                 
 }
 
+// Restricts the sensor readout to the given rectangle, grown to the
+// increments the camera supports. Returns what was actually set.
+Rect acquisition::Camera::setROI(Rect roi) {
+
+    INodeMap & nodeMap = pCam_->GetNodeMap();
+    CIntegerPtr offsetX = nodeMap.GetNode("OffsetX");
+    CIntegerPtr offsetY = nodeMap.GetNode("OffsetY");
+    CIntegerPtr width = nodeMap.GetNode("Width");
+    CIntegerPtr height = nodeMap.GetNode("Height");
+    if (!IsWritable(offsetX) || !IsWritable(offsetY) || !IsWritable(width) || !IsWritable(height)) {
+        ROS_WARN_STREAM("Camera " << get_id() << " doesn't allow a sensor ROI, reading out the full frame");
+        return Rect(0, 0, getIntValue("Width"), getIntValue("Height"));
+    }
+
+    // Offsets to 0 first, the maximum width depends on them
+    offsetX->SetValue(0);
+    offsetY->SetValue(0);
+
+    int64_t x = roi.x/offsetX->GetInc()*offsetX->GetInc();
+    int64_t y = roi.y/offsetY->GetInc()*offsetY->GetInc();
+    int64_t w = (roi.x + roi.width - x + width->GetInc() - 1)/width->GetInc()*width->GetInc();
+    int64_t h = (roi.y + roi.height - y + height->GetInc() - 1)/height->GetInc()*height->GetInc();
+    w = min(max(w, width->GetMin()), (width->GetMax() - x)/width->GetInc()*width->GetInc());
+    h = min(max(h, height->GetMin()), (height->GetMax() - y)/height->GetInc()*height->GetInc());
+
+    width->SetValue(w);
+    height->SetValue(h);
+    offsetX->SetValue(x);
+    offsetY->SetValue(y);
+
+    ROS_DEBUG_STREAM("Camera " << get_id() << " sensor ROI set to " << w << "x" << h << "+" << x << "+" << y);
+    return Rect(x, y, w, h);
+
+}
+
 void acquisition::Camera::adcBitDepth(gcstring bitDep) {
     CEnumerationPtr ptrADC = pCam_->GetNodeMap().GetNode("AdcBitDepth");
     if (!IsAvailable(ptrADC) || !IsWritable(ptrADC)){
@@ -250,6 +755,57 @@ void acquisition::Camera::setBufferSize(int numBuf) {
     ROS_DEBUG_STREAM("Set Buf "<<numBuf<<endl);
 }
 
+void acquisition::Camera::setUserBuffers(void** buffers, int count, size_t size) {
+
+    INodeMap & sNodeMap = pCam_->GetTLStreamNodeMap();
+
+    // The stream buffer count has to match the number of buffers we hand over
+    CEnumerationPtr ptrCountMode = sNodeMap.GetNode("StreamBufferCountMode");
+    if (IsAvailable(ptrCountMode) && IsWritable(ptrCountMode)) {
+        CEnumEntryPtr ptrManual = ptrCountMode->GetEntryByName("Manual");
+        if (IsAvailable(ptrManual) && IsReadable(ptrManual))
+            ptrCountMode->SetIntValue(ptrManual->GetValue());
+    }
+    CIntegerPtr ptrCount = sNodeMap.GetNode("StreamBufferCountManual");
+    if (IsAvailable(ptrCount) && IsWritable(ptrCount))
+        ptrCount->SetValue(count);
+
+    pCam_->SetUserBuffers(buffers, count, size);
+    ROS_DEBUG_STREAM("Camera " << get_id() << " using " << count << " user buffers of " << size << " bytes");
+
+}
+
+// Which of the ready buffers a grab returns: OldestFirst, NewestOnly, ...
+bool acquisition::Camera::setBufferHandling(string mode) {
+
+    INodeMap & sNodeMap = pCam_->GetTLStreamNodeMap();
+    CEnumerationPtr ptrMode = sNodeMap.GetNode("StreamBufferHandlingMode");
+    if (!IsAvailable(ptrMode) || !IsWritable(ptrMode)) {
+        ROS_WARN_STREAM("Camera " << get_id() << ": unable to set StreamBufferHandlingMode");
+        return false;
+    }
+    CEnumEntryPtr ptrEntry = ptrMode->GetEntryByName(mode.c_str());
+    if (!IsAvailable(ptrEntry) || !IsReadable(ptrEntry)) {
+        ROS_WARN_STREAM("Camera " << get_id() << ": no " << mode << " stream buffer handling");
+        return false;
+    }
+    ptrMode->SetIntValue(ptrEntry->GetValue());
+    ROS_DEBUG_STREAM("Camera " << get_id() << " stream buffer handling: " << mode);
+    return true;
+
+}
+
+int64_t acquisition::Camera::get_payload_size() {
+
+    CIntegerPtr ptrPayload = pCam_->GetNodeMap().GetNode("PayloadSize");
+    if (!IsAvailable(ptrPayload) || !IsReadable(ptrPayload)) {
+        ROS_FATAL_STREAM("Unable to read PayloadSize. Aborting...");
+        return 0;
+    }
+    return ptrPayload->GetValue();
+
+}
+
 void acquisition::Camera::setISPEnable() {
     CBooleanPtr ptrISPEn=pCam_->GetNodeMap().GetNode("IspEnable");
     if (!IsAvailable(ptrISPEn) || !IsWritable(ptrISPEn)){
@@ -259,6 +815,85 @@ void acquisition::Camera::setISPEnable() {
     ptrISPEn->SetValue("True");
 }
 
+// Seconds the host takes to demosaic one BayerRG8 frame of that size to
+// BGR8, through the same Spinnaker conversion as convert_image
+double acquisition::Camera::benchmark_host_debayer(int width, int height) {
+
+    DemosaicAlgorithm algorithm;
+    algorithm.name = "default";
+    algorithm.spinnaker = DEFAULT;
+    algorithm.cv_code = -1;
+    return benchmark_demosaic(width, height, algorithm);
+
+}
+
+double acquisition::Camera::benchmark_demosaic(int width, int height, const DemosaicAlgorithm& algorithm) {
+
+    Mat bayer(height, width, CV_8UC1);
+    randu(bayer, Scalar(0), Scalar(255));
+    Mat bgr(height, width, CV_8UC3);
+
+    // First run warms the caches up, the best of the next ones is kept. The
+    // slow algorithms stop after a second, they're out of the race anyway.
+    double start = ros::WallTime::now().toSec();
+    demosaic(bayer, bgr, algorithm);
+    double best = ros::WallTime::now().toSec() - start;
+    for (int k = 0; k < 3 && ros::WallTime::now().toSec() - start < 1; k++) {
+        double t = ros::WallTime::now().toSec();
+        demosaic(bayer, bgr, algorithm);
+        best = min(best, ros::WallTime::now().toSec() - t);
+    }
+    return best;
+
+}
+
+vector<acquisition::DemosaicAlgorithm> acquisition::Camera::demosaic_algorithms() {
+
+    // Spinnaker's directional filters and rigorous keep the edges of
+    // OpenCV's VNG, which beats the linear ones; nearest neighbor is last
+    const DemosaicAlgorithm list[] = {
+        {"rigorous", RIGOROUS, -1},
+        {"weighted_directional", WEIGHTED_DIRECTIONAL_FILTER, -1},
+        {"directional", DIRECTIONAL_FILTER, -1},
+        {"vng", DEFAULT, COLOR_BayerBG2BGR_VNG},
+        {"hq_linear", HQ_LINEAR, -1},
+        {"edge_aware", DEFAULT, COLOR_BayerBG2BGR_EA},
+        {"edge_sensing", EDGE_SENSING, -1},
+        {"bilinear", DEFAULT, COLOR_BayerBG2BGR},
+        {"nearest_neighbor", NEAREST_NEIGHBOR, -1}
+    };
+    return vector<DemosaicAlgorithm>(list, list + sizeof(list)/sizeof(list[0]));
+
+}
+
+bool acquisition::Camera::demosaic_algorithm(string name, DemosaicAlgorithm& algorithm) {
+
+    vector<DemosaicAlgorithm> algorithms = demosaic_algorithms();
+    for (int k = 0; k < algorithms.size(); k++)
+        if (algorithms[k].name == name) {
+            algorithm = algorithms[k];
+            return true;
+        }
+    return false;
+
+}
+
+// BayerRG8 (OpenCV's BG) to BGR8 into bgr, allocated as it is
+void acquisition::Camera::demosaic(const Mat& bayer, Mat& bgr, const DemosaicAlgorithm& algorithm) {
+
+    if (algorithm.cv_code >= 0) {
+        cvtColor(bayer, bgr, algorithm.cv_code);
+        return;
+    }
+
+    Mat src = bayer.isContinuous() ? bayer : bayer.clone();
+    bgr.create(bayer.rows, bayer.cols, CV_8UC3);
+    ImagePtr in = Image::Create(src.cols, src.rows, 0, 0, PixelFormat_BayerRG8, src.data);
+    ImagePtr out = Image::Create(bgr.cols, bgr.rows, 0, 0, PixelFormat_BGR8, bgr.data);
+    in->Convert(out, PixelFormat_BGR8, algorithm.spinnaker);
+
+}
+
 void acquisition::Camera::setFREnable() {
     CBooleanPtr ptrAcquisitionFrameRateEnable=pCam_->GetNodeMap().GetNode("AcquisitionFrameRateEnable");
     if (!IsAvailable(ptrAcquisitionFrameRateEnable) || !IsWritable(ptrAcquisitionFrameRateEnable)){
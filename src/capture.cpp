@@ -4,6 +4,10 @@ acquisition::Capture::~Capture(){
 
     // destructor
 
+    // Recovery threads use the cameras and the system
+    recovery_threads_.interrupt_all();
+    recovery_threads_.join_all();
+
     ifstream file(dump_img_.c_str());
     if (file)
         if (remove(dump_img_.c_str()) != 0)
@@ -30,6 +34,124 @@ acquisition::Capture::~Capture(){
 
 }
 
+// Fraction of all cores busy over the given period, from /proc/stat
+static double cpu_load(double seconds) {
+
+    unsigned long long busy[2] = {0, 0}, total[2] = {0, 0};
+    for (int k = 0; k < 2; k++) {
+        ifstream stat("/proc/stat");
+        string cpu;
+        unsigned long long user, nice, system, idle, iowait = 0, irq = 0, softirq = 0, steal = 0;
+        if (!(stat >> cpu >> user >> nice >> system >> idle >> iowait >> irq >> softirq >> steal))
+            return -1;
+        busy[k] = user + nice + system + irq + softirq + steal;
+        total[k] = busy[k] + idle + iowait;
+        if (k == 0)
+            usleep(seconds*1e6);
+    }
+    return total[1] > total[0] ? double(busy[1] - busy[0])/(total[1] - total[0]) : -1;
+
+}
+
+// Mounting orientation name to mirrors + transpose, quarter turns clockwise
+static bool parse_orientation(string name, acquisition::Orientation& o) {
+
+    o = acquisition::Orientation();
+    if (name == "none")
+        return true;
+    if (name == "flip_x")
+        o.flip_x = true;
+    else if (name == "flip_y")
+        o.flip_y = true;
+    else if (name == "rotate_90")
+        o.flip_y = o.transpose = true;
+    else if (name == "rotate_180")
+        o.flip_x = o.flip_y = true;
+    else if (name == "rotate_270")
+        o.flip_x = o.transpose = true;
+    else if (name == "transpose")
+        o.transpose = true;
+    else if (name == "transverse")
+        o.flip_x = o.flip_y = o.transpose = true;
+    else
+        return false;
+    return true;
+
+}
+
+// Calibration of the camera as mounted. Pixels move by A, the normalized
+// camera frame by M, so K' = A K M^-1, R' = M R M^-1 and P' = A P M^-1;
+// the tangential distortion terms follow the axes.
+static void orient_camera_info(sensor_msgs::CameraInfo& info, const acquisition::Orientation& o) {
+
+    if (!o.any())
+        return;
+
+    Mat A = Mat::eye(3, 3, CV_64F), M = Mat::eye(3, 3, CV_64F);
+    if (o.flip_x) {
+        Mat_<double> F = (Mat_<double>(3, 3) << -1, 0, info.width - 1.0, 0, 1, 0, 0, 0, 1);
+        A = F*A;
+        M = Mat(Mat::diag((Mat_<double>(3, 1) << -1, 1, 1)))*M;
+    }
+    if (o.flip_y) {
+        Mat_<double> F = (Mat_<double>(3, 3) << 1, 0, 0, 0, -1, info.height - 1.0, 0, 0, 1);
+        A = F*A;
+        M = Mat(Mat::diag((Mat_<double>(3, 1) << 1, -1, 1)))*M;
+    }
+    if (o.transpose) {
+        Mat_<double> T = (Mat_<double>(3, 3) << 0, 1, 0, 1, 0, 0, 0, 0, 1);
+        A = T*A;
+        M = T*M;
+        swap(info.width, info.height);
+    }
+    Mat M_inv = M.inv();
+    Mat P_inv = Mat::eye(4, 4, CV_64F);
+    M_inv.copyTo(P_inv(Rect(0, 0, 3, 3)));
+
+    Mat K(3, 3, CV_64F, info.K.data()), R(3, 3, CV_64F, info.R.data()), P(3, 4, CV_64F, info.P.data());
+    Mat(A*K*M_inv).copyTo(K);
+    Mat(M*R*M_inv).copyTo(R);
+    Mat(A*P*P_inv).copyTo(P);
+
+    if ((info.distortion_model == "plumb_bob" || info.distortion_model == "rational_polynomial") && info.D.size() >= 4) {
+        if (o.flip_x)
+            info.D[3] = -info.D[3];
+        if (o.flip_y)
+            info.D[2] = -info.D[2];
+        if (o.transpose)
+            swap(info.D[2], info.D[3]);
+    }
+
+}
+
+// Calibration of the frame cut to `crop` (sensor pixels and orientation) out
+// of a `sensor` sized readout, for an already oriented info: the crop is
+// oriented and scaled to the calibrated resolution, the principal point
+// moves by its offset and the image size becomes the crop's.
+static void crop_camera_info(sensor_msgs::CameraInfo& info, const acquisition::Orientation& o, Size sensor, Rect crop) {
+
+    if (info.width == 0 || info.height == 0 || crop == Rect(Point(), sensor))
+        return;
+
+    if (o.flip_x)
+        crop.x = sensor.width - crop.x - crop.width;
+    if (o.flip_y)
+        crop.y = sensor.height - crop.y - crop.height;
+    if (o.transpose) {
+        crop = Rect(crop.y, crop.x, crop.height, crop.width);
+        swap(sensor.width, sensor.height);
+    }
+
+    double sx = double(info.width)/sensor.width, sy = double(info.height)/sensor.height;
+    info.K[2] -= crop.x*sx;
+    info.K[5] -= crop.y*sy;
+    info.P[2] -= crop.x*sx;
+    info.P[6] -= crop.y*sy;
+    info.width = cvRound(crop.width*sx);
+    info.height = cvRound(crop.height*sy);
+
+}
+
 void handler(int i) {
 
     // Capture* obj = reinterpret_cast<Capture*>(object);
@@ -81,6 +203,60 @@ acquisition::Capture::Capture(): it_(nh_), nh_pvt_ ("~") {
     init_delay_ = 1; 
     master_fps_ = 20.0;
     binning_ = 1;
+    FRAME_POOL_ = true;
+    FRAME_POOL_HUGEPAGES_ = false;
+    frame_pool_max_mb_ = 0;
+    USER_BUFFERS_ = false;
+    USER_BUFFERS_HUGEPAGES_ = true;
+    user_buffer_count_ = 10;
+    memory_budget_mb_ = 0;
+    ASYNC_PUBLISH_ = false;
+    publish_pending_ = false;
+    display_consumer_ = -1;
+    publish_consumer_ = -1;
+    worker_threads_ = 0;
+    row_band_ = 64;
+    PIPELINE_ = false;
+    PIPELINED_TRIGGER_ = false;
+    sync_mode_ = "software";
+    HARDWARE_SYNC_ = false;
+    FREE_RUN_ = false;
+    clock_calibration_time_ = 0;
+    clock_latch_failed_ = false;
+    skew_sum_ = 0;
+    skew_max_ = 0;
+    skew_count_ = 0;
+    STAGGER_TRIGGERS_ = false;
+    stagger_max_offset_us_ = 0;
+    peak_bw_sum_ = 0;
+    peak_bw_max_ = 0;
+    BANDWIDTH_PLAN_ = false;
+    color_processing_ = "host";
+    isp_cpu_threshold_ = 0.1;
+    PUBLISH_YUV_ = false;
+    KERNEL_SELF_CHECK_ = true;
+    demosaic_ = "default";
+    demosaic_cpu_budget_ = 0.5;
+    DEMOSAIC_RETUNE_ = false;
+    demosaic_cache_ = "~/.ros/demosaic_timings.yml";
+    CHUNK_DATA_ = true;
+    bit_depth_ = 8;
+    tone_map_ = "none";
+    tone_map_gamma_ = 2.2;
+    HDR_ = false;
+    AUTO_EXPOSURE_ = false;
+    WATCHDOG_ = true;
+    watchdog_periods_ = 3;
+    watchdog_misses_ = 3;
+    hdr_short_exposure_ = 1000;
+    hdr_long_exposure_ = 8000;
+    hdr_knee_ = 200;
+    hdr_fuse_time_ = 0;
+    hdr_fused_ = 0;
+    tick_ = 0;
+    usb_budget_mb_ = 380;
+    sensor_max_fps_ = 0;
+    sensor_fps_read_time_ = 0;
     todays_date_ = todays_date();
     
     dump_img_ = "dump" + ext_;
@@ -111,7 +287,22 @@ acquisition::Capture::Capture(): it_(nh_), nh_pvt_ ("~") {
     ROS_INFO_STREAM("Creating system instance...");
     system_ = System::GetInstance();
 
+    if (FRAME_POOL_)
+        frame_pool_.reset(new FramePool(FRAME_POOL_HUGEPAGES_, frame_pool_max_mb_));
+    if (USER_BUFFERS_)
+        buffer_arena_.reset(new BufferArena(USER_BUFFERS_HUGEPAGES_));
+    worker_pool_.reset(new WorkStealingPool(worker_threads_));
+
     load_cameras();
+    load_rois();
+    load_auto_exposure();
+    load_tone_curves();
+    load_color_correction();
+
+    register_memory_components();
+
+    if (PIPELINE_)
+        build_pipelines();
  
     //initializing the ros publisher
     acquisition_pub = nh_.advertise<provider_vision::SpinnakerImageNames>("camera", 1000);
@@ -160,6 +351,60 @@ acquisition::Capture::Capture(ros::NodeHandle nodehandl, ros::NodeHandle private
     init_delay_ = 1;
     master_fps_ = 20.0;
     binning_ = 1;
+    FRAME_POOL_ = true;
+    FRAME_POOL_HUGEPAGES_ = false;
+    frame_pool_max_mb_ = 0;
+    USER_BUFFERS_ = false;
+    USER_BUFFERS_HUGEPAGES_ = true;
+    user_buffer_count_ = 10;
+    memory_budget_mb_ = 0;
+    ASYNC_PUBLISH_ = false;
+    publish_pending_ = false;
+    display_consumer_ = -1;
+    publish_consumer_ = -1;
+    worker_threads_ = 0;
+    row_band_ = 64;
+    PIPELINE_ = false;
+    PIPELINED_TRIGGER_ = false;
+    sync_mode_ = "software";
+    HARDWARE_SYNC_ = false;
+    FREE_RUN_ = false;
+    clock_calibration_time_ = 0;
+    clock_latch_failed_ = false;
+    skew_sum_ = 0;
+    skew_max_ = 0;
+    skew_count_ = 0;
+    STAGGER_TRIGGERS_ = false;
+    stagger_max_offset_us_ = 0;
+    peak_bw_sum_ = 0;
+    peak_bw_max_ = 0;
+    BANDWIDTH_PLAN_ = false;
+    color_processing_ = "host";
+    isp_cpu_threshold_ = 0.1;
+    PUBLISH_YUV_ = false;
+    KERNEL_SELF_CHECK_ = true;
+    demosaic_ = "default";
+    demosaic_cpu_budget_ = 0.5;
+    DEMOSAIC_RETUNE_ = false;
+    demosaic_cache_ = "~/.ros/demosaic_timings.yml";
+    CHUNK_DATA_ = true;
+    bit_depth_ = 8;
+    tone_map_ = "none";
+    tone_map_gamma_ = 2.2;
+    HDR_ = false;
+    AUTO_EXPOSURE_ = false;
+    WATCHDOG_ = true;
+    watchdog_periods_ = 3;
+    watchdog_misses_ = 3;
+    hdr_short_exposure_ = 1000;
+    hdr_long_exposure_ = 8000;
+    hdr_knee_ = 200;
+    hdr_fuse_time_ = 0;
+    hdr_fused_ = 0;
+    tick_ = 0;
+    usb_budget_mb_ = 380;
+    sensor_max_fps_ = 0;
+    sensor_fps_read_time_ = 0;
     todays_date_ = todays_date();
 
     dump_img_ = "dump" + ext_;
@@ -190,7 +435,22 @@ acquisition::Capture::Capture(ros::NodeHandle nodehandl, ros::NodeHandle private
     ROS_INFO_STREAM("Creating system instance...");
     system_ = System::GetInstance();
 
+    if (FRAME_POOL_)
+        frame_pool_.reset(new FramePool(FRAME_POOL_HUGEPAGES_, frame_pool_max_mb_));
+    if (USER_BUFFERS_)
+        buffer_arena_.reset(new BufferArena(USER_BUFFERS_HUGEPAGES_));
+    worker_pool_.reset(new WorkStealingPool(worker_threads_));
+
     load_cameras();
+    load_rois();
+    load_auto_exposure();
+    load_tone_curves();
+    load_color_correction();
+
+    register_memory_components();
+
+    if (PIPELINE_)
+        build_pipelines();
 
     //initializing the ros publisher
     acquisition_pub = nh_.advertise<provider_vision::SpinnakerImageNames>("camera", 1000);
@@ -248,10 +508,17 @@ void acquisition::Capture::load_cameras() {
                 Mat img;
                 frames_.push_back(img);
                 time_stamps_.push_back("");
+                metadata_.push_back(FrameMetadata());
         
+                cam.set_frame_pool(frame_pool_.get());
+                cam.set_tone_map(tone_lut_.empty() ? NULL : &tone_lut_[0]);
+                cam.set_publish_yuv(PUBLISH_YUV_);
                 cams.push_back(cam);
+                handoffs_.push_back(boost::shared_ptr<FrameHandoff>(new FrameHandoff()));
+                display_frames_.push_back(Mat());
                 
                 camera_image_pubs.push_back(it_.advertiseCamera("camera_array/"+cam_names_[j]+"/image_raw", 1));
+                metadata_pubs.push_back(nh_.advertise<provider_vision::FrameMetadata>("camera_array/"+cam_names_[j]+"/metadata", 10));
                 //camera_info_pubs.push_back(nh_.advertise<sensor_msgs::CameraInfo>("camera_array/"+cam_names_[j]+"/camera_info", 1));
 
                 img_msgs.push_back(sensor_msgs::ImagePtr());
@@ -323,6 +590,53 @@ void acquisition::Capture::load_cameras() {
     // Setting numCameras_ variable to reflect number of camera objects used.
     // numCameras_ variable is used in other methods where it means size of cams list.
     numCameras_ = cams.size();
+
+    // What every camera is triggered by, see init_cameras
+    for (int i=0; i<numCameras_; i++) {
+        int divisor = rate_divisors_param_.count(cam_names_[i]) ? max(rate_divisors_param_[cam_names_[i]], 1) : 1;
+        if (cams[i].is_master()) {
+            ROS_WARN_COND(divisor > 1, "The master camera sets the schedule, its rate divisor is ignored");
+            divisor = 1;
+            trigger_modes_.push_back(MAX_RATE_SAVE_ || FREE_RUN_ ? "off" : "software");
+        } else if (HARDWARE_SYNC_ && divisor == 1) {
+            trigger_modes_.push_back("hardware");
+        } else {
+            // The strobe fires every frame, skipping some takes a software trigger
+            ROS_WARN_COND(HARDWARE_SYNC_, "Camera %s has a rate divisor, it is software triggered", cam_names_[i].c_str());
+            trigger_modes_.push_back("software");
+        }
+        rate_divisors_.push_back(divisor);
+
+        Orientation orientation;
+        if (orientation_param_.count(cam_names_[i]) && !parse_orientation(orientation_param_[cam_names_[i]], orientation))
+            ROS_WARN("Camera %s: unknown orientation %s (none, flip_x, flip_y, rotate_90, rotate_180, rotate_270, transpose, transverse), left as is",
+                     cam_names_[i].c_str(), orientation_param_[cam_names_[i]].c_str());
+        orientations_.push_back(orientation);
+        host_orientations_.push_back(orientation);
+        orient_maps_.push_back(map<vector<int>, pair<Mat, Mat> >());
+        resize_stages_.push_back(false);
+        orient_camera_info(*cam_info_msgs[i], orientation);
+
+        fresh_.push_back(false);
+        stalled_.push_back(false);
+        resync_.push_back(false);
+        recovered_.push_back(CameraPtr());
+        runtime_commands_.push_back(vector<CameraCommand>());
+        misses_.push_back(0);
+        frame_id_offsets_.push_back(0);
+        hdr_short_.push_back(Mat());
+        hdr_alternate_.push_back(false);
+        hdr_next_long_.push_back(false);
+        hdr_parity_.push_back(0);
+    }
+
+    // Consumers of the latest-frame handoffs, same id on every camera
+    for (int i=0; i<numCameras_; i++) {
+        if (LIVE_)
+            display_consumer_ = handoffs_[i]->add_consumer();
+        if (EXPORT_TO_ROS_ && ASYNC_PUBLISH_)
+            publish_consumer_ = handoffs_[i]->add_consumer();
+    }
     // setting PUBLISH_CAM_INFO_ to true so export to ros method can publish it_.advertiseCamera msg with zero intrisics and distortion coeffs.
     PUBLISH_CAM_INFO_ = true;
 }
@@ -403,6 +717,162 @@ void acquisition::Capture::read_parameters() {
         ROS_INFO("  Exporting images to ROS: %s",EXPORT_TO_ROS_?"true":"false");
         else ROS_WARN("  'to_ros' Parameter not set, using default behavior to_ros=%s",EXPORT_TO_ROS_?"true":"false");
 
+    if (nh_pvt_.getParam("async_publish", ASYNC_PUBLISH_)) 
+        ROS_INFO("  Publishing images from a separate thread: %s",ASYNC_PUBLISH_?"true":"false");
+        else ROS_WARN("  'async_publish' Parameter not set, using default behavior async_publish=%s",ASYNC_PUBLISH_?"true":"false");
+
+    if (nh_pvt_.getParam("pipelined_trigger", PIPELINED_TRIGGER_)) 
+        ROS_INFO("  Triggering the next set before processing the current one: %s",PIPELINED_TRIGGER_?"true":"false");
+        else ROS_WARN("  'pipelined_trigger' Parameter not set, using default behavior pipelined_trigger=%s",PIPELINED_TRIGGER_?"true":"false");
+
+    if (nh_pvt_.getParam("sync_mode", sync_mode_)) {
+        if (sync_mode_ == "software" || sync_mode_ == "hardware" || sync_mode_ == "free_run")
+            ROS_INFO_STREAM("  Camera synchronization: " << sync_mode_);
+        else {
+            ROS_WARN_STREAM("  Provided 'sync_mode' " << sync_mode_ << " is not valid (software, hardware, free_run), using default behavior sync_mode=software");
+            sync_mode_ = "software";
+        }
+    } else ROS_WARN_STREAM("  'sync_mode' Parameter not set, using default behavior sync_mode=" << sync_mode_);
+    HARDWARE_SYNC_ = sync_mode_ != "software";
+    FREE_RUN_ = sync_mode_ == "free_run";
+    if (FREE_RUN_ && SOFT_FRAME_RATE_CTRL_)
+        ROS_WARN("  In free_run the master sets the rate, soft_framerate only delays the grab and adds latency");
+
+    if (nh_pvt_.getParam("stagger_triggers", STAGGER_TRIGGERS_)) 
+        ROS_INFO("  Staggering trigger phases across cameras: %s",STAGGER_TRIGGERS_?"true":"false");
+        else ROS_WARN("  'stagger_triggers' Parameter not set, using default behavior stagger_triggers=%s",STAGGER_TRIGGERS_?"true":"false");
+
+    if (nh_pvt_.getParam("stagger_max_offset_us", stagger_max_offset_us_)){
+        if (stagger_max_offset_us_ >= 0) ROS_INFO("  Largest inter-camera trigger offset: %.0f us",stagger_max_offset_us_);
+        else {
+            stagger_max_offset_us_ = 0;
+            ROS_WARN("  Provided 'stagger_max_offset_us' is not valid, using default behavior, half the frame period");
+        }
+    } else ROS_WARN("  'stagger_max_offset_us' Parameter not set, using default behavior: half the frame period");
+
+    if (nh_pvt_.getParam("rate_divisors", rate_divisors_param_)) {
+        for (map<string, int>::iterator it = rate_divisors_param_.begin(); it != rate_divisors_param_.end(); ++it)
+            ROS_INFO("  Camera %s runs at 1/%d of the master rate",it->first.c_str(),it->second);
+    } else ROS_WARN("  'rate_divisors' Parameter not set, using default behavior: every camera at the master rate");
+
+    if (nh_pvt_.getParam("orientation", orientation_param_)) {
+        for (map<string, string>::iterator it = orientation_param_.begin(); it != orientation_param_.end(); ++it)
+            ROS_INFO("  Camera %s is mounted %s",it->first.c_str(),it->second.c_str());
+    } else ROS_WARN("  'orientation' Parameter not set, using default behavior: every camera published as the sensor reads out");
+
+    if (nh_pvt_.getParam("chunk_data", CHUNK_DATA_)) 
+        ROS_INFO("  Per frame chunk metadata: %s",CHUNK_DATA_?"true":"false");
+        else ROS_WARN("  'chunk_data' Parameter not set, using default behavior chunk_data=%s",CHUNK_DATA_?"true":"false");
+
+    if (nh_pvt_.getParam("hdr", HDR_)) 
+        ROS_INFO("  HDR exposure bracketing: %s",HDR_?"true":"false");
+        else ROS_WARN("  'hdr' Parameter not set, using default behavior hdr=%s",HDR_?"true":"false");
+
+    if (HDR_) {
+        if (nh_pvt_.getParam("hdr_short_exposure", hdr_short_exposure_))
+            ROS_INFO("    Short exposure: %.0f us",hdr_short_exposure_);
+            else ROS_WARN("    'hdr_short_exposure' Parameter not set, using default behavior hdr_short_exposure=%.0f",hdr_short_exposure_);
+        if (nh_pvt_.getParam("hdr_long_exposure", hdr_long_exposure_))
+            ROS_INFO("    Long exposure: %.0f us",hdr_long_exposure_);
+            else ROS_WARN("    'hdr_long_exposure' Parameter not set, using default behavior hdr_long_exposure=%.0f",hdr_long_exposure_);
+        if (nh_pvt_.getParam("hdr_knee", hdr_knee_)){
+            if (hdr_knee_ >= 0 && hdr_knee_ < 255) ROS_INFO("    Long exposure kept up to %d",hdr_knee_);
+            else {
+                hdr_knee_ = 200;
+                ROS_WARN("    Provided 'hdr_knee' is not valid (0-254), using default behavior, hdr_knee=%d",hdr_knee_);
+            }
+        } else ROS_WARN("    'hdr_knee' Parameter not set, using default behavior: hdr_knee=%d",hdr_knee_);
+        if (hdr_short_exposure_ >= hdr_long_exposure_)
+            ROS_WARN("    The short exposure should be shorter than the long one");
+        ROS_WARN_COND(!CHUNK_DATA_, "    Without chunk data exposures are told apart by their order, a dropped frame swaps them");
+    }
+
+    if (nh_pvt_.getParam("watchdog", WATCHDOG_)) 
+        ROS_INFO("  Stall watchdog: %s",WATCHDOG_?"true":"false");
+        else ROS_WARN("  'watchdog' Parameter not set, using default behavior watchdog=%s",WATCHDOG_?"true":"false");
+    if (WATCHDOG_) {
+        if (nh_pvt_.getParam("watchdog_periods", watchdog_periods_)) {
+            if (watchdog_periods_ >= 1) ROS_INFO("    Grab timeout: %.1f frame periods",watchdog_periods_);
+            else {
+                watchdog_periods_ = 3;
+                ROS_WARN("    Provided 'watchdog_periods' is not valid (>= 1), using default behavior, watchdog_periods=%.1f",watchdog_periods_);
+            }
+        } else ROS_WARN("    'watchdog_periods' Parameter not set, using default behavior: watchdog_periods=%.1f",watchdog_periods_);
+        if (nh_pvt_.getParam("watchdog_misses", watchdog_misses_)) {
+            if (watchdog_misses_ >= 1) ROS_INFO("    Camera recovered after %d missed frames",watchdog_misses_);
+            else {
+                watchdog_misses_ = 3;
+                ROS_WARN("    Provided 'watchdog_misses' is not valid (>= 1), using default behavior, watchdog_misses=%d",watchdog_misses_);
+            }
+        } else ROS_WARN("    'watchdog_misses' Parameter not set, using default behavior: watchdog_misses=%d",watchdog_misses_);
+    }
+
+    if (nh_pvt_.getParam("auto_exposure", AUTO_EXPOSURE_)) 
+        ROS_INFO("  Software auto exposure: %s",AUTO_EXPOSURE_?"true":"false");
+        else ROS_WARN("  'auto_exposure' Parameter not set, using default behavior auto_exposure=%s",AUTO_EXPOSURE_?"true":"false");
+    if (AUTO_EXPOSURE_ && HDR_) {
+        ROS_WARN("  'auto_exposure' is ignored with 'hdr', the bracketed exposures are fixed");
+        AUTO_EXPOSURE_ = false;
+    }
+
+    if (nh_pvt_.getParam("color_processing", color_processing_)) {
+        if (color_processing_ == "host" || color_processing_ == "camera" || color_processing_ == "yuv" || color_processing_ == "auto")
+            ROS_INFO_STREAM("  Color processing: " << color_processing_);
+        else {
+            ROS_WARN_STREAM("  Provided 'color_processing' " << color_processing_ << " is not valid (host, camera, yuv, auto), using default behavior color_processing=host");
+            color_processing_ = "host";
+        }
+    } else ROS_WARN_STREAM("  'color_processing' Parameter not set, using default behavior color_processing=" << color_processing_);
+
+    if (nh_pvt_.getParam("isp_cpu_threshold", isp_cpu_threshold_))
+        ROS_INFO("  On-camera ISP preferred when host demosaicing takes more than %.0f%% of the free CPU",isp_cpu_threshold_*100);
+        else ROS_WARN("  'isp_cpu_threshold' Parameter not set, using default behavior isp_cpu_threshold=%.2f",isp_cpu_threshold_);
+
+    DemosaicAlgorithm algorithm;
+    if (nh_pvt_.getParam("demosaic", demosaic_)) {
+        if (demosaic_ == "default" || demosaic_ == "auto" || Camera::demosaic_algorithm(demosaic_, algorithm))
+            ROS_INFO_STREAM("  Host demosaicing: " << demosaic_);
+        else {
+            ROS_WARN_STREAM("  Provided 'demosaic' " << demosaic_ << " is not valid (default, auto or an algorithm), using default behavior demosaic=default");
+            demosaic_ = "default";
+        }
+    } else ROS_WARN_STREAM("  'demosaic' Parameter not set, using default behavior demosaic=" << demosaic_);
+
+    if (demosaic_ == "auto") {
+        if (nh_pvt_.getParam("demosaic_cpu_budget", demosaic_cpu_budget_))
+            ROS_INFO("  Host demosaicing may take %.0f%% of the free CPU",demosaic_cpu_budget_*100);
+            else ROS_WARN("  'demosaic_cpu_budget' Parameter not set, using default behavior demosaic_cpu_budget=%.2f",demosaic_cpu_budget_);
+        if (nh_pvt_.getParam("demosaic_retune", DEMOSAIC_RETUNE_))
+            ROS_INFO("  Demosaicing algorithms timed again: %s",DEMOSAIC_RETUNE_?"true":"false");
+            else ROS_WARN("  'demosaic_retune' Parameter not set, using default behavior demosaic_retune=%s",DEMOSAIC_RETUNE_?"true":"false");
+        if (nh_pvt_.getParam("demosaic_cache", demosaic_cache_))
+            ROS_INFO_STREAM("  Demosaic timings kept in " << demosaic_cache_);
+            else ROS_WARN_STREAM("  'demosaic_cache' Parameter not set, using default behavior demosaic_cache=" << demosaic_cache_);
+    }
+
+    if (nh_pvt_.getParam("publish_yuv", PUBLISH_YUV_))
+        ROS_INFO("  YCbCr frames published as sent (yuv422_yuy2): %s",PUBLISH_YUV_?"true":"false");
+        else ROS_WARN("  'publish_yuv' Parameter not set, using default behavior publish_yuv=%s",PUBLISH_YUV_?"true":"false");
+
+    if (nh_pvt_.getParam("bandwidth_plan", BANDWIDTH_PLAN_)) 
+        ROS_INFO("  USB bandwidth planning: %s",BANDWIDTH_PLAN_?"true":"false");
+        else ROS_WARN("  'bandwidth_plan' Parameter not set, using default behavior bandwidth_plan=%s",BANDWIDTH_PLAN_?"true":"false");
+
+    if (nh_pvt_.getParam("usb_budget_mb", usb_budget_mb_)){
+        if (usb_budget_mb_ > 0) ROS_INFO("  USB bandwidth budget: %.0f MB/s",usb_budget_mb_);
+        else {
+            usb_budget_mb_ = 380;
+            ROS_WARN("  Provided 'usb_budget_mb' is not valid, using default behavior, usb_budget_mb=%.0f",usb_budget_mb_);
+        }
+    } else ROS_WARN("  'usb_budget_mb' Parameter not set, using default behavior: usb_budget_mb=%.0f",usb_budget_mb_);
+
+    if (nh_pvt_.getParam("bandwidth_downgrade", bandwidth_downgrades_)) {
+        ostringstream ss;
+        for (int i=0; i<bandwidth_downgrades_.size(); i++)
+            ss << (i ? ", " : "") << bandwidth_downgrades_[i];
+        ROS_INFO_STREAM("  Downgrades when over the USB budget: " << (ss.str().empty() ? "none, refuse to start" : ss.str()));
+    } else ROS_WARN("  'bandwidth_downgrade' Parameter not set, using default behavior: refuse to start when over the USB budget");
+
     if (nh_pvt_.getParam("live", LIVE_)) 
         ROS_INFO("  Showing live images setting: %s",LIVE_?"true":"false");
         else ROS_WARN("  'live' Parameter not set, using default behavior live=%s",LIVE_?"true":"false");
@@ -473,6 +943,80 @@ void acquisition::Capture::read_parameters() {
     }
     else ROS_WARN("  'soft_framerate' Parameter not set, using default behavior: No Software Rate Control ");
 
+    if (nh_pvt_.getParam("frame_pool", FRAME_POOL_)) 
+        ROS_INFO("  Pooled frame buffers: %s",FRAME_POOL_?"true":"false");
+        else ROS_WARN("  'frame_pool' Parameter not set, using default behavior frame_pool=%s",FRAME_POOL_?"true":"false");
+
+    if (FRAME_POOL_) {
+        if (nh_pvt_.getParam("frame_pool_hugepages", FRAME_POOL_HUGEPAGES_))
+            ROS_INFO("    Frame pool on hugepages: %s",FRAME_POOL_HUGEPAGES_?"true":"false");
+            else ROS_WARN("    'frame_pool_hugepages' Parameter not set, using default behavior frame_pool_hugepages=%s",FRAME_POOL_HUGEPAGES_?"true":"false");
+
+        if (nh_pvt_.getParam("frame_pool_max_mb", frame_pool_max_mb_)){
+            if (frame_pool_max_mb_ >= 0) ROS_INFO("    Frame pool working set limited to: %d MB",frame_pool_max_mb_);
+            else {
+                frame_pool_max_mb_ = 0;
+                ROS_WARN("    Provided 'frame_pool_max_mb' is not valid, frame pool working set is unlimited");
+            }
+        } else ROS_WARN("    'frame_pool_max_mb' Parameter not set, frame pool working set is unlimited");
+    }
+
+    if (nh_pvt_.getParam("user_buffers", USER_BUFFERS_)) 
+        ROS_INFO("  Pipeline owned acquisition buffers: %s",USER_BUFFERS_?"true":"false");
+        else ROS_WARN("  'user_buffers' Parameter not set, using default behavior user_buffers=%s",USER_BUFFERS_?"true":"false");
+
+    if (USER_BUFFERS_) {
+        if (nh_pvt_.getParam("user_buffer_count", user_buffer_count_)){
+            if (user_buffer_count_ > 0) ROS_INFO("    Acquisition buffers per camera: %d",user_buffer_count_);
+            else {
+                user_buffer_count_ = 10;
+                ROS_WARN("    Provided 'user_buffer_count' is not valid, using default behavior, user_buffer_count=%d",user_buffer_count_);
+            }
+        } else ROS_WARN("    'user_buffer_count' Parameter not set, using default behavior: user_buffer_count=%d",user_buffer_count_);
+
+        if (nh_pvt_.getParam("user_buffer_hugepages", USER_BUFFERS_HUGEPAGES_))
+            ROS_INFO("    Acquisition buffers on hugepages: %s",USER_BUFFERS_HUGEPAGES_?"true":"false");
+            else ROS_WARN("    'user_buffer_hugepages' Parameter not set, using default behavior user_buffer_hugepages=%s",USER_BUFFERS_HUGEPAGES_?"true":"false");
+    }
+
+    if (nh_pvt_.getParam("memory_budget_mb", memory_budget_mb_)){
+        if (memory_budget_mb_ > 0) ROS_INFO("  Memory budget set to: %d MB",memory_budget_mb_);
+        else {
+            memory_budget_mb_ = 0;
+            ROS_INFO("  'memory_budget_mb'=0, memory is only shed under system memory pressure");
+        }
+    } else ROS_WARN("  'memory_budget_mb' Parameter not set, memory is only shed under system memory pressure");
+
+    if (nh_pvt_.getParam("memory_priorities", memory_priorities_)) {
+        ROS_INFO("  Memory shedding priorities (lowest sheds first):");
+        for (map<string, int>::iterator it = memory_priorities_.begin(); it != memory_priorities_.end(); ++it)
+            ROS_INFO_STREAM("    " << it->first << " >> " << it->second);
+    } else ROS_WARN("  'memory_priorities' Parameter not set, recording sheds before live vision");
+
+    nh_pvt_.getParam("memory_limits_mb", memory_limits_mb_);
+
+    if (nh_pvt_.getParam("worker_threads", worker_threads_)){
+        if (worker_threads_ > 0) ROS_INFO("  Worker pool threads set to: %d",worker_threads_);
+        else {
+            worker_threads_ = 0;
+            ROS_INFO("  'worker_threads'=0, one worker per core");
+        }
+    } else ROS_WARN("  'worker_threads' Parameter not set, using default behavior: one worker per core");
+
+    if (nh_pvt_.getParam("row_band", row_band_)){
+        if (row_band_ > 0) ROS_INFO("  Minimum rows per parallel band set to: %d",row_band_);
+        else {
+            row_band_ = 64;
+            ROS_WARN("  Provided 'row_band' is not valid, using default behavior, row_band=%d",row_band_);
+        }
+    } else ROS_WARN("  'row_band' Parameter not set, using default behavior: row_band=%d",row_band_);
+
+    if (nh_pvt_.getParam("pipeline", PIPELINE_)) 
+        ROS_INFO("  Stage-graph pipeline per camera: %s",PIPELINE_?"true":"false");
+        else ROS_WARN("  'pipeline' Parameter not set, using default behavior pipeline=%s",PIPELINE_?"true":"false");
+    if (PIPELINE_ && MAX_RATE_SAVE_)
+        ROS_WARN("  'pipeline' is ignored in max rate save mode");
+
     if (nh_pvt_.getParam("save", SAVE_)) 
         ROS_INFO("  Saving images set to: %d",SAVE_);
         else ROS_WARN("  'save' Parameter not set, using default behavior save=%d",SAVE_);
@@ -485,6 +1029,48 @@ void acquisition::Capture::read_parameters() {
         }else ROS_WARN("    'save_type' Parameter not set, using default behavior save=%d",SAVE_);
     }
 
+    if (nh_pvt_.getParam("bit_depth", bit_depth_)){
+        if (bit_depth_ == 8 || bit_depth_ == 10 || bit_depth_ == 12) ROS_INFO("  Bit depth: %d",bit_depth_);
+        else {
+            bit_depth_ = 8;
+            ROS_WARN("  Provided 'bit_depth' is not valid (8, 10, 12), using default behavior, bit_depth=%d",bit_depth_);
+        }
+    } else ROS_WARN("  'bit_depth' Parameter not set, using default behavior: bit_depth=%d",bit_depth_);
+
+    if (nh_pvt_.getParam("tone_map_gamma", tone_map_gamma_))
+        ROS_INFO("  Tone map gamma: %.2f",tone_map_gamma_);
+        else ROS_WARN("  'tone_map_gamma' Parameter not set, using default behavior tone_map_gamma=%.2f",tone_map_gamma_);
+
+    if (nh_pvt_.getParam("tone_map", tone_map_)) {
+        if (tone_map_ == "none" || kernels::make_tone_lut(tone_map_, tone_map_gamma_, tone_lut_))
+            ROS_INFO_STREAM("  Tone map to 8 bit: " << tone_map_);
+        else {
+            ROS_WARN_STREAM("  Provided 'tone_map' " << tone_map_ << " is not valid (none, linear, gamma), using default behavior tone_map=none");
+            tone_map_ = "none";
+        }
+    } else ROS_WARN_STREAM("  'tone_map' Parameter not set, using default behavior tone_map=" << tone_map_);
+
+    if (nh_pvt_.getParam("kernel_self_check", KERNEL_SELF_CHECK_))
+        ROS_INFO("  Image kernels checked against their scalar reference: %s",KERNEL_SELF_CHECK_?"true":"false");
+        else ROS_WARN("  'kernel_self_check' Parameter not set, using default behavior kernel_self_check=%s",KERNEL_SELF_CHECK_?"true":"false");
+    if (KERNEL_SELF_CHECK_) {
+        vector<string> failures;
+        if (!kernels::self_check(failures))
+            for (int k = 0; k < failures.size(); k++)
+                ROS_ERROR_STREAM("  Image kernel " << failures[k] << " differs from its scalar reference, using the scalar one");
+    }
+    ROS_INFO_STREAM("  Image kernels: " << kernels::selected());
+
+    if (bit_depth_ > 8) {
+        ROS_INFO_STREAM("  Packed formats unpacked with " << kernels::simd_name() << " kernels");
+        // 16 bit frames only survive these, anything else would be cut to 8 bit
+        if (tone_lut_.empty() && (SAVE_||LIVE_) && !SAVE_BIN_ && ext_ != ".png" && ext_ != ".tif" && ext_ != ".tiff" && ext_ != ".pgm") {
+            ROS_WARN_STREAM("  'save_type' " << ext_ << " can't hold 16 bit images, saving as .png");
+            ext_ = ".png";
+            dump_img_ = "dump" + ext_;
+        }
+    }
+
     if (SAVE_||MAX_RATE_SAVE_){
         if (nh_pvt_.getParam("frames", nframes_)) {
             if (nframes_>0){
@@ -601,6 +1187,16 @@ void acquisition::Capture::init_array() {
     sleep(init_delay_*2.0);
 
     init_cameras(false);
+    choose_color_processing();
+    apply_orientation();
+    apply_tone_curve();
+    apply_color_correction();
+    apply_sensor_rois();
+    plan_bandwidth();
+    tune_demosaic();
+    reserve_user_buffers();
+    schedule_trigger_phases();
+    set_grab_timeouts();
 
     ROS_DEBUG_STREAM("Flush sequence done.");
 
@@ -616,82 +1212,413 @@ void acquisition::Capture::init_cameras(bool soft = false) {
         ROS_INFO_STREAM("Initializing camera " << cam_ids_[i] << "...");
 
         try {
+            init_camera(i, soft);
+        }
+
+        catch (Spinnaker::Exception &e) {
+            string error_msg = e.what();
+            ROS_FATAL_STREAM("Error: " << error_msg);
+            if (error_msg.find("Unable to set PixelFormat to BGR8") >= 0)
+              ROS_WARN("Most likely cause for this error is if your camera can't support color and your are trying to set it to color mode");
+            ros::shutdown();
+        }
+
+    }
+    ROS_INFO_STREAM("All cameras initialized.");
+}
+
+// Everything one camera needs before acquiring, also what brings a
+// recovered camera back. Throws on any failure.
+void acquisition::Capture::init_camera(int i, bool soft) {
+
+    cams[i].init();
+
+    if (!soft) {
+
+        cams[i].set_color(color_);
+        //cams[i].setIntValue("BinningHorizontal", binning_);
+        //cams[i].setIntValue("BinningVertical", binning_);
+
+        cams[i].setEnumValue("ExposureMode", "Timed");
+        if (exposure_time_ > 0) { 
+            cams[i].setEnumValue("ExposureAuto", "Off");
+            cams[i].setFloatValue("ExposureTime", exposure_time_);
+        } else {
+            cams[i].setEnumValue("ExposureAuto", "Continuous");
+        }
+        if (target_grey_value_ > 4.0) {
+            //cams[i].setEnumValue("AutoExposureTargetGreyValueAuto", "Off");
+            //cams[i].setFloatValue("AutoExposureTargetGreyValue", target_grey_value_);
+        } else {
+            //cams[i].setEnumValue("AutoExposureTargetGreyValueAuto", "Continuous");
+        }
+
+        // cams[i].setIntValue("DecimationHorizontal", decimation_);
+        // cams[i].setIntValue("DecimationVertical", decimation_);
+        // cams[i].setFloatValue("AcquisitionFrameRate", 5.0);
+
+        // The ADC must deliver the bits before the packed formats are available
+        if (bit_depth_ > 8)
+            cams[i].adcBitDepth(bit_depth_ == 12 ? "Bit12" : "Bit10");
+        cams[i].setEnumValue("PixelFormat", pixel_format());
+        cams[i].setEnumValue("AcquisitionMode", "Continuous");
+
+        if (CHUNK_DATA_) {
+            vector<string> chunks;
+            chunks.push_back("FrameID");
+            chunks.push_back("Timestamp");
+            chunks.push_back("ExposureTime");
+            chunks.push_back("Gain");
+            chunks.push_back("BlackLevel");
+            cams[i].enableChunks(chunks);
+        }
+
+        if (AUTO_EXPOSURE_) {
+            // The camera's own loop would fight ours
+            cams[i].setEnumValue("ExposureAuto", "Off");
+            cams[i].setEnumValue("GainAuto", "Off");
+            if (!auto_exposures_[i])
+                auto_exposures_[i].reset(new AutoExposure(ae_settings_[i], cams[i].getFloatValue("ExposureTime"),
+                                                          max(cams[i].getFloatValue("Gain"), 0.0)));
+            else {
+                // A recovered camera takes the exposure it had back
+                boost::mutex::scoped_lock lock(ae_mutex_);
+                ae_pending_[i] = true;
+            }
+        }
+
+        if (HDR_) {
+            cams[i].setEnumValue("ExposureAuto", "Off");
+            hdr_alternate_[i] = !cams[i].setExposureSequence(hdr_short_exposure_, hdr_long_exposure_);
+            if (hdr_alternate_[i]) {
+                ROS_WARN_STREAM("Camera " << cam_ids_[i] << " has no sequencer, the exposure is written before every trigger");
+                cams[i].setFloatValue("ExposureTime", hdr_short_exposure_);
+            }
+        }
+        
+        // Nothing paces a free running set but the master: a grab late by a
+        // period must get the latest frame, not one the others moved past
+        if (FREE_RUN_)
+            cams[i].setBufferHandling("NewestOnly");
+
+        // set only master to be software triggered
+        if (cams[i].is_master()) { 
+            if (MAX_RATE_SAVE_){
+              ROS_INFO_STREAM("Master Camera Max Rate");
+              cams[i].setEnumValue("LineSelector", "Line2");
+              cams[i].setEnumValue("LineMode", "Output");
+              cams[i].setBoolValue("AcquisitionFrameRateEnable", false);
+              //cams[i].setFloatValue("AcquisitionFrameRate", 170);
+            }else if (FREE_RUN_){
+              ROS_INFO_STREAM("Master Camera, free running at " << master_fps_ << " fps");
+              cams[i].setEnumValue("TriggerMode", "Off");
+              cams[i].setBoolValue("AcquisitionFrameRateEnable", true);
+              cams[i].setFloatValue("AcquisitionFrameRate", master_fps_);
+            }else{
+              ROS_INFO_STREAM("Master Camera");
+              cams[i].setEnumValue("TriggerMode", "On");
+              cams[i].setEnumValue("LineSelector", "Line2");
+              cams[i].setEnumValue("LineMode", "Output");
+              cams[i].setEnumValue("TriggerSource", "Software");
+            }
+            if (HARDWARE_SYNC_ && !MAX_RATE_SAVE_) {
+              // The strobe the slaves trigger on
+              cams[i].setEnumValue("LineSelector", "Line2");
+              cams[i].setEnumValue("LineMode", "Output");
+              cams[i].setEnumValue("LineSource", "ExposureActive");
+            }
+            //cams[i].setEnumValue("LineSource", "ExposureActive");
+
+
+        } else if (trigger_modes_[i] == "hardware") {
+            // Exposure starts on the master strobe, no software trigger
+            ROS_INFO_STREAM("Slave Camera, hardware triggered on Line3");
+            cams[i].setEnumValue("TriggerMode", "Off");
+            cams[i].setEnumValue("TriggerSelector", "FrameStart");
+            cams[i].setEnumValue("TriggerSource", "Line3");
+            cams[i].setEnumValue("TriggerActivation", "RisingEdge");
+            cams[i].setEnumValue("TriggerOverlap", "ReadOut");
+            cams[i].setEnumValue("TriggerMode", "On");
+        } else {
+            ROS_INFO_STREAM("Slave Camera");
+            cams[i].setEnumValue("TriggerMode", "On");
+            cams[i].setEnumValue("LineSelector", "Line3");
+            cams[i].setEnumValue("TriggerSource", "Software");
+            //cams[i].setEnumValue("TriggerSelector", "FrameStart");
+            cams[i].setEnumValue("LineMode", "Output");
             
-            cams[i].init();
+//            cams[i].setFloatValue("TriggerDelay", 40.0);
+            //cams[i].setEnumValue("TriggerOverlap", "ReadOut");//"Off"
+            //cams[i].setEnumValue("TriggerActivation", "RisingEdge");
+        }
+
+    }
 
-            if (!soft) {
+}
 
-                cams[i].set_color(color_);
-                //cams[i].setIntValue("BinningHorizontal", binning_);
-                //cams[i].setIntValue("BinningVertical", binning_);
+void acquisition::Capture::reserve_user_buffers() {
 
-                cams[i].setEnumValue("ExposureMode", "Timed");
-                if (exposure_time_ > 0) { 
-                    cams[i].setEnumValue("ExposureAuto", "Off");
-                    cams[i].setFloatValue("ExposureTime", exposure_time_);
-                } else {
-                    cams[i].setEnumValue("ExposureAuto", "Continuous");
-                }
-                if (target_grey_value_ > 4.0) {
-                    //cams[i].setEnumValue("AutoExposureTargetGreyValueAuto", "Off");
-                    //cams[i].setFloatValue("AutoExposureTargetGreyValue", target_grey_value_);
-                } else {
-                    //cams[i].setEnumValue("AutoExposureTargetGreyValueAuto", "Continuous");
-                }
+    if (!USER_BUFFERS_)
+        return;
 
-                // cams[i].setIntValue("DecimationHorizontal", decimation_);
-                // cams[i].setIntValue("DecimationVertical", decimation_);
-                // cams[i].setFloatValue("AcquisitionFrameRate", 5.0);
+    for (int i = 0; i < numCameras_; i++)
+        reserve_user_buffers(i);
+    ROS_INFO("Acquisition buffers total footprint: %.1f MB", buffer_arena_->total_footprint()/1048576.0);
 
-                if (color_)
-                    cams[i].setEnumValue("PixelFormat", "BayerRG8");
-                    else
-                        cams[i].setEnumValue("PixelFormat", "Mono8");
-                cams[i].setEnumValue("AcquisitionMode", "Continuous");
-                
-                // set only master to be software triggered
-                if (cams[i].is_master()) { 
-                    if (MAX_RATE_SAVE_){
-                      ROS_INFO_STREAM("Master Camera Max Rate");
-                      cams[i].setEnumValue("LineSelector", "Line2");
-                      cams[i].setEnumValue("LineMode", "Output");
-                      cams[i].setBoolValue("AcquisitionFrameRateEnable", false);
-                      //cams[i].setFloatValue("AcquisitionFrameRate", 170);
-                    }else{
-                      ROS_INFO_STREAM("Master Camera");
-                      cams[i].setEnumValue("TriggerMode", "On");
-                      cams[i].setEnumValue("LineSelector", "Line2");
-                      cams[i].setEnumValue("LineMode", "Output");
-                      cams[i].setEnumValue("TriggerSource", "Software");
-                    }
-                    //cams[i].setEnumValue("LineSource", "ExposureActive");
+}
 
+// False when the camera must stay stopped: its stream still points at
+// buffers too small for the new payload. The previous buffers are only
+// unmapped once the stream has the new ones.
+bool acquisition::Capture::reserve_user_buffers(int i) {
 
-                } else {
-                    ROS_INFO_STREAM("Slave Camera");
-                    cams[i].setEnumValue("TriggerMode", "On");
-                    cams[i].setEnumValue("LineSelector", "Line3");
-                    cams[i].setEnumValue("TriggerSource", "Software");
-                    //cams[i].setEnumValue("TriggerSelector", "FrameStart");
-                    cams[i].setEnumValue("LineMode", "Output");
-                    
-//                    cams[i].setFloatValue("TriggerDelay", 40.0);
-                    //cams[i].setEnumValue("TriggerOverlap", "ReadOut");//"Off"
-                    //cams[i].setEnumValue("TriggerActivation", "RisingEdge");
+    // Payload is only final once pixel format and ROI are set
+    int64_t payload = cams[i].get_payload_size();
+    if (payload > 0 && buffer_arena_->reserve(i, payload, user_buffer_count_)) {
+        try {
+            cams[i].setUserBuffers(buffer_arena_->buffers(i), buffer_arena_->buffer_count(i), buffer_arena_->buffer_size(i));
+        } catch (Spinnaker::Exception &e) {
+            ROS_ERROR_STREAM("Camera " << cam_ids_[i] << ": unable to hand over its acquisition buffers: " << e.what());
+            buffer_arena_->restore_previous(i);
+            return buffer_arena_->buffer_count(i) == 0 || buffer_arena_->buffer_size(i) >= payload;
+        }
+        buffer_arena_->release_previous(i);
+        ROS_INFO("Camera %s acquisition buffers: %d x %.2f MB = %.1f MB%s%s", cam_ids_[i].c_str(),
+                 buffer_arena_->buffer_count(i), buffer_arena_->buffer_size(i)/1048576.0,
+                 buffer_arena_->footprint(i)/1048576.0,
+                 buffer_arena_->is_huge(i)?", hugepages":"", buffer_arena_->is_pinned(i)?", pinned":"");
+        return true;
+    }
+
+    // Never handed any, the driver allocates its own
+    if (buffer_arena_->buffer_count(i) == 0) {
+        ROS_WARN_STREAM("Camera " << cam_ids_[i] << " falls back on driver allocated buffers");
+        return true;
+    }
+    if (buffer_arena_->buffer_size(i) >= payload) {
+        ROS_WARN_STREAM("Camera " << cam_ids_[i] << " keeps its previous acquisition buffers");
+        return true;
+    }
+    ROS_ERROR_STREAM("Camera " << cam_ids_[i] << " has no acquisition buffers for its payload, left stopped");
+    return false;
+
+}
+
+// A grab waits a few frame periods rather than the 2 s default, a stalled
+// camera is noticed within a few frames
+void acquisition::Capture::set_grab_timeouts() {
+
+    for (int i = 0; i < numCameras_; i++)
+        set_grab_timeout(i);
+
+}
+
+// From what the camera runs at now, so it is called again whenever its
+// rate, exposure or trigger changes
+void acquisition::Capture::set_grab_timeout(int i) {
+
+    if (!WATCHDOG_ || MANUAL_TRIGGER_ || MAX_RATE_SAVE_)
+        return;
+    double fps = frame_rate(i);
+    if (fps <= 0)
+        return;
+
+    double exposure = max(cams[i].getFloatValue("ExposureTime"), 0.0)*1e-6;
+    // The camera's own auto exposure may go up to the frame period
+    if (cams[i].getEnumValue("ExposureAuto") != "Off")
+        exposure = max(exposure, 1/fps);
+    if (HDR_)
+        exposure = max(exposure, hdr_long_exposure_*1e-6);
+    else if (AUTO_EXPOSURE_)
+        exposure = max(exposure, ae_settings_[i].max_exposure*1e-6);
+    uint64_t timeout = (watchdog_periods_/fps + exposure)*1000 + 20;
+    cams[i].set_grab_timeout(timeout);
+    ROS_INFO("Camera %s grab timeout: %d ms", cam_ids_[i].c_str(), (int)timeout);
+
+}
+
+// Frames per second the camera delivers: its resulting rate when free
+// running, the master's when the strobe triggers it, the trigger rate
+// otherwise
+double acquisition::Capture::frame_rate(int i) {
+
+    if (trigger_modes_[i] == "off")
+        return cams[i].getFloatValue("AcquisitionResultingFrameRate");
+    if (trigger_modes_[i] == "hardware" && i != MASTER_CAM_)
+        return frame_rate(MASTER_CAM_);
+    return soft_framerate_;
+
+}
+
+// grab_frame, except that a camera missing watchdog_misses_ frames in a row
+// is taken out of the set and recovered while the others carry on. A missed
+// frame is a null image.
+ImagePtr acquisition::Capture::grab_watched(int i) {
+
+    try {
+        ImagePtr image = cams[i].grab_frame();
+        misses_[i] = 0;
+        return image;
+    } catch (Spinnaker::Exception &e) {
+        if (!WATCHDOG_)
+            throw;
+        ROS_WARN_STREAM("Camera " << cam_ids_[i] << " missed a frame: " << e.what());
+        if (++misses_[i] >= watchdog_misses_)
+            isolate_camera(i);
+        return ImagePtr();
+    }
+
+}
+
+bool acquisition::Capture::is_stalled(int i) {
+
+    boost::mutex::scoped_lock lock(watchdog_mutex_);
+    return stalled_[i];
+
+}
+
+// Hardware triggered slaves have nothing to wait for without their master
+bool acquisition::Capture::streaming(int i) {
+
+    boost::mutex::scoped_lock lock(watchdog_mutex_);
+    return !stalled_[i] && !(trigger_modes_[i] == "hardware" && stalled_[MASTER_CAM_]);
+
+}
+
+void acquisition::Capture::isolate_camera(int i) {
+
+    {
+        boost::mutex::scoped_lock lock(watchdog_mutex_);
+        if (stalled_[i])
+            return;
+        stalled_[i] = true;
+    }
+    ROS_ERROR_STREAM("Camera " << cam_ids_[i] << " stalled after " << misses_[i] << " missed frames, recovering it");
+    ROS_ERROR_COND(cams[i].is_master() && HARDWARE_SYNC_, "The hardware triggered slaves pause with their master");
+
+    // Called by the acquisition loop, frames of it may still be converting
+    flush_pipeline(i);
+    try {
+        cams[i].end_acquisition();
+    } catch (Spinnaker::Exception &e) {
+        ROS_DEBUG_STREAM("Camera " << cam_ids_[i] << " end acquisition: " << e.what());
+    }
+    try {
+        cams[i].deinit();
+    } catch (Spinnaker::Exception &e) {
+        ROS_DEBUG_STREAM("Camera " << cam_ids_[i] << " deinit: " << e.what());
+    }
+    recovery_threads_.create_thread(boost::bind(&Capture::recover_camera, this, i));
+
+}
+
+// Runs on its own thread until the camera is back. A camera that dropped
+// off the bus is looked up by serial until it re-enumerates, the
+// acquisition loop then brings it up, see restore_cameras().
+void acquisition::Capture::recover_camera(int i) {
+
+    for (int attempt = 1; ; attempt++) {
+        try {
+            system_->UpdateCameras();
+            CameraList list = system_->GetCameras();
+            CameraPtr pCam = list.GetBySerial(cam_ids_[i]);
+            if (pCam.IsValid()) {
+                boost::mutex::scoped_lock lock(watchdog_mutex_);
+                recovered_[i] = pCam;
+                return;
+            }
+            ROS_WARN_STREAM("Camera " << cam_ids_[i] << " is not on the bus, attempt " << attempt);
+        } catch (Spinnaker::Exception &e) {
+            ROS_WARN_STREAM("Camera " << cam_ids_[i] << " recovery attempt " << attempt << " failed: " << e.what());
+        }
+        boost::this_thread::sleep(boost::posix_time::seconds(min(attempt, 5)));
+    }
+
+}
+
+// Called by the acquisition loop between two sets, like apply_commands():
+// the recovered camera is swapped in while nothing grabs or converts from
+// it. It comes back with the launch settings, the settings commanded since,
+// the bandwidth plan and its trigger phase. With rearm it gets the trigger
+// the others already had.
+void acquisition::Capture::restore_cameras(bool rearm) {
+
+    for (int i = 0; i < numCameras_; i++) {
+        CameraPtr pCam;
+        {
+            boost::mutex::scoped_lock lock(watchdog_mutex_);
+            if (!recovered_[i].IsValid())
+                continue;
+            pCam = recovered_[i];
+            recovered_[i] = CameraPtr();
+        }
+
+        bool ok = false;
+        try {
+            cams[i].reset(pCam);
+            init_camera(i, false);
+            apply_link_plan(i);
+            for (int k = 0; k < runtime_commands_[i].size(); k++) {
+                try {
+                    apply_command(runtime_commands_[i][k]);
+                } catch (Spinnaker::Exception &e) {
+                    ROS_WARN_STREAM("Camera " << cam_ids_[i] << ": unable to set " << runtime_commands_[i][k].node << " again: " << e.what());
                 }
             }
+            apply_orientation(i);
+            apply_tone_curve(i);
+            if (!roi_streams_[i].empty())
+                cams[i].setROI(sensor_rois_[i]);
+            if (!USER_BUFFERS_ || reserve_user_buffers(i)) {
+                // The payload may not be the one its phase was based on
+                payload_bytes_[i] = 0;
+                schedule_trigger_phases();
+                apply_trigger_phase(i);
+                cams[i].begin_acquisition();
+                set_grab_timeout(i);
+                ok = true;
+            }
+        } catch (Spinnaker::Exception &e) {
+            ROS_WARN_STREAM("Camera " << cam_ids_[i] << " could not be brought back: " << e.what());
+        }
+        if (!ok) {
+            try {
+                cams[i].deinit();
+            } catch (Spinnaker::Exception &) {}
+            recovery_threads_.create_thread(boost::bind(&Capture::recover_camera, this, i));
+            continue;
         }
 
-        catch (Spinnaker::Exception &e) {
-            string error_msg = e.what();
-            ROS_FATAL_STREAM("Error: " << error_msg);
-            if (error_msg.find("Unable to set PixelFormat to BGR8") >= 0)
-              ROS_WARN("Most likely cause for this error is if your camera can't support color and your are trying to set it to color mode");
-            ros::shutdown();
+        {
+            boost::mutex::scoped_lock lock(watchdog_mutex_);
+            stalled_[i] = false;
+            resync_[i] = true;
+            misses_[i] = 0;
         }
+        if (rearm && trigger_modes_[i] == "software" && due(i))
+            cams[i].trigger();
+        ROS_INFO_STREAM("Camera " << cam_ids_[i] << " recovered");
+    }
 
+}
+
+// A recovered camera counts its frames from 0 again, it takes the count of
+// a camera running at the same rate back
+void acquisition::Capture::resync_frame_ids() {
+
+    boost::mutex::scoped_lock lock(watchdog_mutex_);
+    for (int i = 0; i < numCameras_; i++) {
+        if (!resync_[i] || !fresh_[i])
+            continue;
+        frame_id_offsets_[i] = 0;
+        for (int j = 0; j < numCameras_; j++)
+            if (j != i && fresh_[j] && !resync_[j] && rate_divisors_[j] == rate_divisors_[i]) {
+                frame_id_offsets_[i] = frame_id(j) - cams[i].get_frame_id();
+                break;
+            }
+        resync_[i] = false;
     }
-    ROS_INFO_STREAM("All cameras initialized.");
+
 }
 
 void acquisition::Capture::start_acquisition() {
@@ -706,8 +1633,10 @@ void acquisition::Capture::start_acquisition() {
 
 void acquisition::Capture::end_acquisition() {
 
+    // A stalled camera is left to its recovery
     for (int i = 0; i < numCameras_; i++)
-        cams[i].end_acquisition();
+        if (!is_stalled(i))
+            cams[i].end_acquisition();
     
 }
 
@@ -719,6 +1648,8 @@ void acquisition::Capture::deinit_cameras() {
     
     for (int i = numCameras_-1 ; i >=0 ; i--) {
 
+        if (is_stalled(i))
+            continue;
         ROS_DEBUG_STREAM("Camera "<<i<<": Deinit...");
         cams[i].deinit();
         // pCam = NULL;
@@ -751,6 +1682,7 @@ void acquisition::Capture::save_mat_frames(int dump) {
         create_cam_directories();
     
     string timestamp;
+    TaskGroup group;
     for (unsigned int i = 0; i < numCameras_; i++) {
 
         if (dump) {
@@ -760,6 +1692,9 @@ void acquisition::Capture::save_mat_frames(int dump) {
             
         } else {
 
+            if (!fresh_[i])
+                continue;
+
             if (MASTER_TIMESTAMP_FOR_ALL_)
                 timestamp = time_stamps_[MASTER_CAM_];
             else
@@ -770,114 +1705,255 @@ void acquisition::Capture::save_mat_frames(int dump) {
             ROS_DEBUG_STREAM("Saving image at " << filename.str());
             //ros image names 
             mesg.name.push_back(filename.str());
-            imwrite(filename.str(), frames_[i]);
+            // encoding is the expensive part, cameras are written in parallel
+            worker_pool_->submit(boost::bind(&Capture::write_mat_frame, this, filename.str(), frames_[i]), "encode", &group);
             
         }
 
     }
+    worker_pool_->wait(group);
     
     save_mat_time_ = ros::Time::now().toSec() - t;
     
 }
 
+void acquisition::Capture::write_mat_frame(string filename, Mat frame) {
+
+    imwrite(filename, frame);
+
+}
+
+void acquisition::Capture::write_binary_frame(string filename, Mat frame) {
+
+    std::ofstream ofs(filename);
+    boost::archive::binary_oarchive oa(ofs);
+    oa << frame;
+    ofs.close();
+
+}
+
 void acquisition::Capture::export_to_ROS() {
     double t = ros::Time::now().toSec();
-    std_msgs::Header img_msg_header;
-    img_msg_header.stamp = mesg.header.stamp;
 
     for (unsigned int i = 0; i < numCameras_; i++) {
-        img_msg_header.frame_id = "cam_"+to_string(i)+"_optical_frame";
-
-        if(color_)
-            img_msgs[i]=cv_bridge::CvImage(img_msg_header, "bgr8", frames_[i]).toImageMsg();
-        else
-            img_msgs[i]=cv_bridge::CvImage(img_msg_header, "mono8", frames_[i]).toImageMsg();
-
-        if (PUBLISH_CAM_INFO_){
-            cam_info_msgs[i]->header.stamp = mesg.header.stamp;
-        }
-        camera_image_pubs[i].publish(img_msgs[i],cam_info_msgs[i]);
-/*
-        if (PUBLISH_CAM_INFO_){
-        cam_info_msgs[i].header.stamp = mesg.header.stamp;
-        camera_info_pubs[i].publish(cam_info_msgs[i]);
-        }
-    */
+        // Divided cameras have nothing new on most sets
+        if (!fresh_[i])
+            continue;
+        Frame frame;
+        frame.image = frames_[i];
+        frame.frame_id = frame_id(i);
+        frame.stamp = mesg.header.stamp;
+        frame.meta = metadata_[i];
+        frame.rois = roi_frames_[i];
+        publish_frame(i, frame);
     }
     export_to_ROS_time_ = ros::Time::now().toSec()-t;;
 }
 
-void acquisition::Capture::save_binary_frames(int dump) {
-    
-    double t = ros::Time::now().toSec();
+void acquisition::Capture::publish_frame(int i, const Frame& frame) {
 
-    if (!CAM_DIRS_CREATED_)
-        create_cam_directories();
-    
-    string timestamp;
-    for (unsigned int i = 0; i < numCameras_; i++) {
+    std_msgs::Header img_msg_header;
+    img_msg_header.stamp = frame.stamp;
+    img_msg_header.frame_id = "cam_"+to_string(i)+"_optical_frame";
 
-        if (dump) {
-            //imwrite(dump_img_.c_str(), frames_[i]);
-            ROS_DEBUG_STREAM("Skipping frame...");
-        } else {
+    // Per camera, the pixel format can be reconfigured at runtime
+    sensor_msgs::ImagePtr img_msg = cv_bridge::CvImage(img_msg_header, cams[i].ros_encoding(frame.image), frame.image).toImageMsg();
 
-            if (MASTER_TIMESTAMP_FOR_ALL_)
-                timestamp = time_stamps_[MASTER_CAM_];
-            else
-                timestamp = time_stamps_[i];
-                
+    // A copy per frame, the previous one may still be with the subscribers
+    sensor_msgs::CameraInfoPtr cam_info_msg(new sensor_msgs::CameraInfo(*cam_info_msgs[i]));
+    if (PUBLISH_CAM_INFO_){
+        cam_info_msg->header.stamp = frame.stamp;
+    }
+    camera_image_pubs[i].publish(img_msg,cam_info_msg);
+
+    {
+        boost::mutex::scoped_lock lock(publish_mutex_);
+        img_msgs[i] = img_msg;
+    }
+
+    for (int k = 0; k < frame.rois.size() && k < roi_streams_[i].size(); k++) {
+        if (frame.rois[k].empty() || roi_streams_[i][k].pub.getNumSubscribers() == 0)
+            continue;
+        roi_streams_[i][k].pub.publish(cv_bridge::CvImage(img_msg_header, cams[i].ros_encoding(frame.rois[k]),
+                                                          frame.rois[k]).toImageMsg());
+    }
+
+    if (metadata_pubs[i].getNumSubscribers() > 0) {
+        provider_vision::FrameMetadata meta;
+        meta.header = img_msg_header;
+        meta.camera = cam_names_[i];
+        meta.chunk_valid = frame.meta.valid;
+        meta.frame_id = frame.meta.valid ? frame.meta.frame_id : frame.frame_id;
+        meta.timestamp = frame.meta.timestamp;
+        meta.exposure_time = frame.meta.exposure_time;
+        meta.gain = frame.meta.gain;
+        meta.black_level = frame.meta.black_level;
+        metadata_pubs[i].publish(meta);
+    }
+
+}
+
+// Latest frame of a camera for the display and the async publisher
+void acquisition::Capture::hand_off(int i, const Frame& frame) {
+
+    handoffs_[i]->publish(frame);
+    if (!ASYNC_PUBLISH_)
+        return;
+    boost::mutex::scoped_lock lock(publish_mutex_);
+    publish_pending_ = true;
+    publish_cond_.notify_one();
+
+}
+
+void acquisition::Capture::publish_loop() {
+
+    ROS_DEBUG("  Publisher Thread Initiated");
+
+    try {
+        while (ros::ok()) {
+            {
+                // also serves as interruption point
+                boost::mutex::scoped_lock lock(publish_mutex_);
+                while (!publish_pending_)
+                    publish_cond_.wait(lock);
+                publish_pending_ = false;
+            }
+            for (int i=0; i<numCameras_; i++) {
+                Frame frame;
+                if (handoffs_[i]->latest(publish_consumer_, frame))
+                    publish_frame(i, frame);
+            }
+        }
+    }
+    catch (boost::thread_interrupted&) {}
+
+    ROS_DEBUG("  Publisher Thread Stopped");
+
+}
+
+void acquisition::Capture::save_binary_frames(int dump) {
+    
+    double t = ros::Time::now().toSec();
+
+    if (!CAM_DIRS_CREATED_)
+        create_cam_directories();
+    
+    string timestamp;
+    TaskGroup group;
+    for (unsigned int i = 0; i < numCameras_; i++) {
+
+        if (dump) {
+            //imwrite(dump_img_.c_str(), frames_[i]);
+            ROS_DEBUG_STREAM("Skipping frame...");
+        } else {
+
+            if (!fresh_[i])
+                continue;
+
+            if (MASTER_TIMESTAMP_FOR_ALL_)
+                timestamp = time_stamps_[MASTER_CAM_];
+            else
+                timestamp = time_stamps_[i];
+                
             ostringstream filename;
             filename<< path_ << cam_names_[i] << "/" << timestamp << ".bin";
             ROS_DEBUG_STREAM("Saving image at " << filename.str());
             //ros image names
             mesg.name.push_back(filename.str());
-            std::ofstream ofs(filename.str());
-            boost::archive::binary_oarchive oa(ofs);
-            oa << frames_[i];
-            ofs.close();
+            worker_pool_->submit(boost::bind(&Capture::write_binary_frame, this, filename.str(), frames_[i]), "write", &group);
             
         }
 
     }
+    worker_pool_->wait(group);
     save_mat_time_ = ros::Time::now().toSec() - t;
     
 }
 
 void acquisition::Capture::get_mat_images() {
-    //ros time stamp creation
-    mesg.header.stamp = ros::Time::now();
+    //ros time stamp creation, pipelined the set was exposed when it was
+    //triggered, before the rate control sleep
+    mesg.header.stamp = trigger_stamp_.isZero() ? ros::Time::now() : trigger_stamp_;
     mesg.time = ros::Time::now();
+    trigger_stamp_ = ros::Time();
     double t = ros::Time::now().toSec();
     
     ostringstream ss;
     ss<<"frameIDs: [";
     
-    int frameID;
+    // Cameras running at the same rate count frames together
+    map<int, int> frameIDs;
     int fid_mismatch = 0;
    
 
+    // Grabbing stays serial, the conversion of camera i runs on the pool
+    // while camera i+1 is being grabbed
+    TaskGroup group;
     for (int i=0; i<numCameras_; i++) {
+        fresh_[i] = due(i) && streaming(i);
+        if (!fresh_[i])
+            continue;
         ROS_DEBUG_STREAM("CAM ID IS "<< i);
-        frames_[i] = cams[i].grab_mat_frame();
-        ROS_DEBUG_STREAM("sucess");
+        pResultImages_[i] = grab_watched(i);
+        if (!pResultImages_[i]) {
+            fresh_[i] = false;
+            continue;
+        }
+        // The conversion meters the frame with its metadata
         time_stamps_[i] = cams[i].get_time_stamp();
+        metadata_[i] = cams[i].get_metadata();
+        worker_pool_->submit(boost::bind(&Capture::convert_frame, this, i), "convert", &group);
+        ROS_DEBUG_STREAM("sucess");
+    }
+    resync_frame_ids();
 
+    for (int i=0; i<numCameras_; i++) {
+        if (!fresh_[i]) {
+            ss << "-" << (i == numCameras_-1 ? "]" : ", ");
+            continue;
+        }
 
-        if (i==0)
-            frameID = cams[i].get_frame_id();
+        if (!frameIDs.count(rate_divisors_[i]))
+            frameIDs[rate_divisors_[i]] = frame_id(i);
         else
-            if (cams[i].get_frame_id() != frameID)
+            if (frame_id(i) != frameIDs[rate_divisors_[i]])
                 fid_mismatch = 1;
         
         if (i == numCameras_-1)
-            ss << cams[i].get_frame_id() << "]";
+            ss << frame_id(i) << "]";
         else
-            ss << cams[i].get_frame_id() << ", ";
+            ss << frame_id(i) << ", ";
         
     }
     string message = ss.str();
     ROS_DEBUG_STREAM(message);
+    grab_time_ = ros::Time::now().toSec() - t;
+    measure_skew();
+    tick_++;
+
+    // Every camera has read its frame out, the next set can expose while
+    // this one is converted, saved and published
+    if (PIPELINED_TRIGGER_ && !MANUAL_TRIGGER_)
+        trigger_all();
+
+    worker_pool_->wait(group);
+
+    if (HDR_)
+        fuse_hdr();
+
+    // Hand the set over to the consumers, this never waits on them
+    for (int i=0; i<numCameras_; i++) {
+        if (!fresh_[i])
+            continue;
+        Frame frame;
+        frame.image = frames_[i];
+        frame.time_stamp = time_stamps_[i];
+        frame.frame_id = frame_id(i);
+        frame.stamp = mesg.header.stamp;
+        frame.meta = metadata_[i];
+        frame.rois = roi_frames_[i];
+        hand_off(i, frame);
+    }
 
     if (fid_mismatch)
         ROS_WARN_STREAM("Frame IDs for grabbed set of images did not match!");
@@ -886,6 +1962,1092 @@ void acquisition::Capture::get_mat_images() {
     
 }
 
+// Reads the ROI streams of every camera, e.g.
+//   rois: {front: [{name: buoy, x: 800, y: 400, width: 640, height: 480, scale: 1.0}]}
+void acquisition::Capture::load_rois() {
+
+    XmlRpc::XmlRpcValue config;
+    bool has_config = nh_pvt_.getParam("rois", config) && config.getType() == XmlRpc::XmlRpcValue::TypeStruct;
+
+    roi_streams_.assign(numCameras_, vector<RoiStream>());
+    roi_frames_.assign(numCameras_, vector<Mat>());
+    sensor_rois_.assign(numCameras_, Rect());
+
+    if (!has_config)
+        return;
+
+    for (int i = 0; i < numCameras_; i++) {
+        if (!config.hasMember(cam_names_[i]))
+            continue;
+        XmlRpc::XmlRpcValue& list = config[cam_names_[i]];
+        ROS_ASSERT_MSG(list.getType() == XmlRpc::XmlRpcValue::TypeArray, "The ROIs of a camera must be a list!");
+
+        for (int k = 0; k < list.size(); k++) {
+            XmlRpc::XmlRpcValue& r = list[k];
+            ROS_ASSERT_MSG(r.getType() == XmlRpc::XmlRpcValue::TypeStruct && r.hasMember("name"), "Every ROI needs at least a name!");
+            RoiStream roi;
+            roi.name = static_cast<string>(r["name"]);
+            roi.rect = Rect(r.hasMember("x") ? static_cast<int>(r["x"]) : 0,
+                            r.hasMember("y") ? static_cast<int>(r["y"]) : 0,
+                            r.hasMember("width") ? static_cast<int>(r["width"]) : 0,
+                            r.hasMember("height") ? static_cast<int>(r["height"]) : 0);
+            roi.scale = 1.0;
+            if (r.hasMember("scale"))
+                roi.scale = r["scale"].getType() == XmlRpc::XmlRpcValue::TypeInt ? static_cast<int>(r["scale"]) : static_cast<double>(r["scale"]);
+            roi.pub = it_.advertise("camera_array/"+cam_names_[i]+"/"+roi.name+"/image_raw", 1);
+            roi_streams_[i].push_back(roi);
+
+            ROS_INFO("  Camera %s ROI %s: %dx%d+%d+%d, scale %.2f", cam_names_[i].c_str(), roi.name.c_str(),
+                     roi.rect.width, roi.rect.height, roi.rect.x, roi.rect.y, roi.scale);
+        }
+        roi_frames_[i].resize(roi_streams_[i].size());
+    }
+
+}
+
+// Reads out only the union of a camera's ROIs, when none of them asks for
+// the whole sensor. The main image then covers that union too, and so does
+// its calibration.
+void acquisition::Capture::apply_sensor_rois() {
+
+    for (int i = 0; i < numCameras_; i++) {
+
+        Rect sensor(0, 0, cams[i].getIntValue("WidthMax"), cams[i].getIntValue("HeightMax"));
+        sensor_rois_[i] = Rect(0, 0, cams[i].getIntValue("Width"), cams[i].getIntValue("Height"));
+        if (roi_streams_[i].empty())
+            continue;
+
+        Rect bounds;
+        for (int k = 0; k < roi_streams_[i].size(); k++) {
+            Rect& r = roi_streams_[i][k].rect;
+            if (r.width <= 0 || r.height <= 0)
+                r = sensor;
+            r &= sensor;
+            bounds = k ? (bounds | r) : r;
+        }
+
+        if (bounds == sensor)
+            continue;
+        sensor_rois_[i] = cams[i].setROI(bounds);
+        crop_camera_info(*cam_info_msgs[i], orientations_[i], sensor.size(), sensor_rois_[i]);
+        ROS_INFO("Camera %s reads out %dx%d+%d+%d for its ROIs", cam_ids_[i].c_str(), sensor_rois_[i].width,
+                 sensor_rois_[i].height, sensor_rois_[i].x, sensor_rois_[i].y);
+    }
+
+}
+
+// Cuts and scales every ROI of a camera out of one converted frame. The
+// ROIs are in sensor coordinates, the frame is already mirrored by the
+// sensor (non Bayer formats): the rect is mirrored the same way.
+void acquisition::Capture::extract_rois(int i, const Mat& full, vector<Mat>& rois) {
+
+    Orientation sensor = sensor_orientation(i);
+    rois.resize(roi_streams_[i].size());
+    Point offset = sensor_rois_[i].tl();
+    for (int k = 0; k < roi_streams_[i].size(); k++) {
+        const RoiStream& roi = roi_streams_[i][k];
+        Rect r = roi.rect - offset;
+        if (sensor.flip_x)
+            r.x = full.cols - r.x - r.width;
+        if (sensor.flip_y)
+            r.y = full.rows - r.y - r.height;
+        r &= Rect(0, 0, full.cols, full.rows);
+        if (r.area() == 0) {
+            rois[k] = Mat();
+            continue;
+        }
+        // Unscaled and upright, it shares the frame's pixels, nothing writes into them
+        Size size = roi.scale == 1.0 ? Size() : Size(cvRound(r.width*roi.scale), cvRound(r.height*roi.scale));
+        rois[k] = resize_oriented(i, full(r), size, roi.scale < 1 ? INTER_AREA : INTER_LINEAR);
+    }
+
+}
+
+void acquisition::Capture::apply_orientation() {
+
+    for (int i = 0; i < numCameras_; i++)
+        apply_orientation(i);
+
+}
+
+// The sensor mirrors for free (ReverseX/Y, not with Bayer formats), the
+// host does the rest in the resize it does anyway
+void acquisition::Capture::apply_orientation(int i) {
+
+    Orientation host = orientations_[i];
+    try {
+        if (cams[i].setReverse("X", host.flip_x))
+            host.flip_x = false;
+        if (cams[i].setReverse("Y", host.flip_y))
+            host.flip_y = false;
+    } catch (Spinnaker::Exception &e) {
+        ROS_WARN_STREAM("Camera " << cam_ids_[i] << " can't mirror on the sensor: " << e.what());
+    }
+
+    if (orientations_[i].any())
+        ROS_INFO("Camera %s orientation: sensor mirrors%s%s, host%s%s%s%s", cam_ids_[i].c_str(),
+                 orientations_[i].flip_x && !host.flip_x ? " x" : "", orientations_[i].flip_y && !host.flip_y ? " y" : "",
+                 host.flip_x ? " mirrors x" : "", host.flip_y ? " mirrors y" : "", host.transpose ? " transposes" : "",
+                 host.any() ? "" : " nothing");
+    boost::mutex::scoped_lock lock(orient_mutex_);
+    host_orientations_[i] = host;
+
+}
+
+// The mirrors done by the sensor, the converted frames have them
+acquisition::Orientation acquisition::Capture::sensor_orientation(int i) {
+
+    boost::mutex::scoped_lock lock(orient_mutex_);
+    Orientation o;
+    o.flip_x = orientations_[i].flip_x && !host_orientations_[i].flip_x;
+    o.flip_y = orientations_[i].flip_y && !host_orientations_[i].flip_y;
+    return o;
+
+}
+
+// Resizes (size in the sensor orientation, empty keeps the resolution) and
+// applies what is left of the camera's orientation in the same pass: the
+// remap reads every output pixel from where the mirrors and transpose put it.
+// The camera's color matrix and tone curve are applied to the result, at
+// the output resolution.
+Mat acquisition::Capture::resize_oriented(int i, const Mat& img, Size size, int interpolation) {
+
+    Orientation o;
+    {
+        boost::mutex::scoped_lock lock(orient_mutex_);
+        o = host_orientations_[i];
+    }
+
+    // A 16 bit Bayer mosaic is published as is, scaling would mix its colors
+    if (color_ && img.depth() == CV_16U) {
+        if (o.any())
+            ROS_WARN_ONCE("A 16 bit Bayer mosaic is published unoriented, set a 'tone_map' to orient it");
+        return img;
+    }
+    // So is 4:2:2 YCbCr, its chroma is shared by pixel pairs
+    if (img.channels() == 2) {
+        if (o.any() || (size.area() && size != img.size()))
+            ROS_WARN_ONCE("YCbCr frames are published at full resolution and unoriented, set 'publish_yuv' to false to resize and orient them");
+        return img;
+    }
+
+    Mat out;
+    out.allocator = frame_pool_.get();
+    if (!o.any()) {
+        // Already resampled while converting (YCbCr)
+        if (size.area() == 0 || size == img.size())
+            return cams[i].finish_colors(img);
+        cv::resize(img, out, size, 0, 0, interpolation);
+        return cams[i].finish_colors(out, true);
+    }
+
+    if ((size.area() == 0 || size == img.size()) && !o.transpose) {
+        cv::flip(img, out, o.flip_x ? (o.flip_y ? -1 : 1) : 0);
+        return cams[i].finish_colors(out, true);
+    }
+
+    if (size.area() == 0)
+        size = img.size();
+    // The maps sample bilinearly: any other interpolation (INTER_AREA
+    // averaging a shrink) resizes first, the maps then only orient
+    Mat src = img;
+    if (interpolation != INTER_LINEAR && size != img.size()) {
+        Mat resized;
+        resized.allocator = frame_pool_.get();
+        cv::resize(img, resized, size, 0, 0, interpolation);
+        src = resized;
+    }
+    if (o.transpose)
+        swap(size.width, size.height);
+    pair<Mat, Mat> maps = orientation_maps(i, o, src.size(), size);
+    remap(src, out, maps.first, maps.second, INTER_LINEAR, BORDER_REPLICATE);
+    return cams[i].finish_colors(out, true);
+
+}
+
+// Fixed point maps of one source size, destination size and orientation,
+// built once. Output pixel centers are placed like cv::resize places them.
+pair<Mat, Mat> acquisition::Capture::orientation_maps(int i, const Orientation& o, Size src, Size dst) {
+
+    int k[] = {o.flip_x, o.flip_y, o.transpose, src.width, src.height, dst.width, dst.height};
+    vector<int> key(k, k + 7);
+    boost::mutex::scoped_lock lock(orient_mutex_);
+    map<vector<int>, pair<Mat, Mat> >::iterator it = orient_maps_[i].find(key);
+    if (it != orient_maps_[i].end())
+        return it->second;
+
+    Size oriented = o.transpose ? Size(src.height, src.width) : src;
+    double sx = double(oriented.width)/dst.width, sy = double(oriented.height)/dst.height;
+    Mat map_x(dst, CV_32FC1), map_y(dst, CV_32FC1);
+    for (int v = 0; v < dst.height; v++) {
+        float* mx = map_x.ptr<float>(v);
+        float* my = map_y.ptr<float>(v);
+        for (int u = 0; u < dst.width; u++) {
+            float x = (u + 0.5)*sx - 0.5, y = (v + 0.5)*sy - 0.5;
+            if (o.transpose)
+                swap(x, y);
+            mx[u] = o.flip_x ? src.width - 1 - x : x;
+            my[u] = o.flip_y ? src.height - 1 - y : y;
+        }
+    }
+
+    pair<Mat, Mat>& maps = orient_maps_[i][key];
+    convertMaps(map_x, map_y, maps.first, maps.second, CV_16SC2);
+    ROS_INFO("Orientation maps of camera %s built for %dx%d -> %dx%d", cam_ids_[i].c_str(),
+             src.width, src.height, dst.width, dst.height);
+    return maps;
+
+}
+
+// Demosaics on the camera ISP (BGR8, 3x the link bandwidth, no host work),
+// on the ISP with YCbCr422_8 out (2x, a cheap SIMD conversion left on the
+// host) or on the host (BayerRG8, as acquired so far). In auto mode, a
+// camera goes to the ISP only if host demosaicing it would cost a
+// noticeable share of the free CPU, as BGR8 if its link and the shared bus
+// can carry 3x, else as YCbCr if they carry 2x: the arm64 boards are CPU
+// bound, the dev machines mostly bus bound.
+void acquisition::Capture::choose_color_processing() {
+
+    if (!color_ || color_processing_ == "host")
+        return;
+    if (bit_depth_ > 8) {
+        ROS_WARN_STREAM("'color_processing' " << color_processing_ << " ignored, the camera ISP only outputs 8 bit");
+        return;
+    }
+
+    ROS_INFO_STREAM("*** COLOR PROCESSING ***");
+
+    // PixelFormat per camera, empty stays on the host
+    vector<string> formats(numCameras_, color_processing_ == "camera" ? "BGR8" :
+                                        color_processing_ == "yuv" ? "YCbCr422_8" : "");
+
+    if (color_processing_ == "auto") {
+        double fps = SOFT_FRAME_RATE_CTRL_ ? soft_framerate_ : master_fps_;
+        double load = cpu_load(0.25);
+        int cores = max((int)boost::thread::hardware_concurrency(), 1);
+        double free_cores = max((1 - max(load, 0.0))*cores, 0.1);
+
+        // What the bus carries with every camera sending Bayer
+        double bus = usb_budget_mb_*1048576.0*0.9;
+        vector<double> bayer_bw(numCameras_);
+        double used = 0;
+        for (int i = 0; i < numCameras_; i++) {
+            bayer_bw[i] = cams[i].get_payload_size()*fps;
+            used += bayer_bw[i];
+        }
+
+        map<pair<int, int>, double> cost;   // same sizes are benchmarked once
+        for (int i = 0; i < numCameras_; i++) {
+            pair<int, int> size(cams[i].getIntValue("Width"), cams[i].getIntValue("Height"));
+            if (!cost.count(size))
+                cost[size] = Camera::benchmark_host_debayer(size.first, size.second);
+            double cpu = cost[size]*fps/free_cores;
+
+            int64_t link = cams[i].getIntValue("DeviceLinkSpeed");
+            bool fits = (link <= 0 || 3*bayer_bw[i] <= 0.9*link) && used + 2*bayer_bw[i] <= bus;
+            bool fits_yuv = (link <= 0 || 2*bayer_bw[i] <= 0.9*link) && used + bayer_bw[i] <= bus;
+            if (cpu > isp_cpu_threshold_ && fits) {
+                formats[i] = "BGR8";
+                used += 2*bayer_bw[i];
+            } else if (cpu > isp_cpu_threshold_ && fits_yuv) {
+                formats[i] = "YCbCr422_8";
+                used += bayer_bw[i];
+            }
+
+            ROS_INFO("Camera %s: host demosaic %.1f ms/frame = %.0f%% of the free CPU (%.1f cores), ISP needs %.0f MB/s (%.0f as YCbCr), bus %.0f/%.0f MB/s: %s",
+                     cam_ids_[i].c_str(), cost[size]*1000, cpu*100, free_cores, 3*bayer_bw[i]/1048576.0,
+                     2*bayer_bw[i]/1048576.0, used/1048576.0, bus/1048576.0,
+                     formats[i].empty() ? "host" : ("camera ISP, " + formats[i]).c_str());
+        }
+    }
+
+    for (int i = 0; i < numCameras_; i++) {
+        if (formats[i].empty())
+            continue;
+        // setEnumValue only logs a missing entry, check it first
+        if (!cams[i].hasEnumEntry("PixelFormat", formats[i])) {
+            ROS_WARN_STREAM("Camera " << cam_ids_[i] << " has no " << formats[i] << " format, demosaicing on the host");
+            continue;
+        }
+        try {
+            cams[i].setEnumValue("PixelFormat", formats[i]);
+            cams[i].setISPEnable();
+            ROS_INFO_STREAM("Camera " << cam_ids_[i] << " demosaics on its ISP (" << formats[i] << ")");
+        } catch (Spinnaker::Exception &e) {
+            ROS_WARN_STREAM("Camera " << cam_ids_[i] << " can't process color on the camera, demosaicing on the host: " << e.what());
+            cams[i].setEnumValue("PixelFormat", pixel_format());
+        }
+    }
+
+}
+
+// Algorithm the cameras left to host demosaicing use: a fixed one, or in
+// auto mode the best quality one the tuner finds fitting in
+// demosaic_cpu_budget of the free CPU, at their resolution and rate
+void acquisition::Capture::tune_demosaic() {
+
+    if (!color_ || demosaic_ == "default")
+        return;
+
+    vector<int> host;
+    for (int i = 0; i < numCameras_; i++)
+        if (cams[i].bayer_format())
+            host.push_back(i);
+    if (host.empty())
+        return;
+
+    DemosaicAlgorithm algorithm;
+    if (demosaic_ != "auto") {
+        Camera::demosaic_algorithm(demosaic_, algorithm);
+        for (int k = 0; k < host.size(); k++)
+            cams[host[k]].set_demosaic(algorithm);
+        return;
+    }
+
+    ROS_INFO_STREAM("*** DEMOSAIC AUTOTUNE ***");
+
+    double fps = SOFT_FRAME_RATE_CTRL_ ? soft_framerate_ : master_fps_;
+    double load = cpu_load(0.25);
+    int cores = max((int)boost::thread::hardware_concurrency(), 1);
+    double free_cores = max((1 - max(load, 0.0))*cores, 0.1);
+
+    DemosaicTuner tuner(demosaic_cache_);
+    for (int k = 0; k < host.size(); k++)
+        tuner.add(cams[host[k]].getIntValue("Width"), cams[host[k]].getIntValue("Height"), fps);
+    string pick = tuner.tune(demosaic_cpu_budget_*free_cores, DEMOSAIC_RETUNE_);
+    tuner.log();
+
+    Camera::demosaic_algorithm(pick, algorithm);
+    for (int k = 0; k < host.size(); k++)
+        cams[host[k]].set_demosaic(algorithm);
+
+}
+
+// What the cameras send when the host processes everything
+string acquisition::Capture::pixel_format() {
+
+    string format = color_ ? "BayerRG" : "Mono";
+    if (bit_depth_ > 8)
+        return format + to_string(bit_depth_) + "p";
+    return format + "8";
+
+}
+
+// Checks the configured resolution, format and rate of every camera against
+// the USB budget before acquiring, downgrades them as allowed when they
+// don't fit and caps each camera's link at its share.
+void acquisition::Capture::plan_bandwidth() {
+
+    if (!BANDWIDTH_PLAN_)
+        return;
+
+    ROS_INFO_STREAM("*** BANDWIDTH PLAN ***");
+
+    double fps = SOFT_FRAME_RATE_CTRL_ ? soft_framerate_ : master_fps_;
+    BandwidthPlanner planner(usb_budget_mb_*1048576.0);
+    for (int i = 0; i < numCameras_; i++) {
+        LinkDemand demand;
+        demand.id = cam_ids_[i];
+        demand.width = cams[i].getIntValue("Width");
+        demand.height = cams[i].getIntValue("Height");
+        // From the format, the payload also carries the chunk data
+        demand.bytes_per_pixel = bytes_per_pixel(i);
+        demand.fps = fps;
+        // Width and height are already binned, the plan bins further
+        demand.binning = 1;
+        demand.link_speed = max(cams[i].getIntValue("DeviceLinkSpeed"), (int64_t)0);
+        demand.limit_min = demand.limit_max = 0;
+        cams[i].getIntRange("DeviceLinkThroughputLimit", demand.limit_min, demand.limit_max);
+        demand.throughput_limit = 0;
+        planner.add(demand);
+    }
+
+    bool ok = planner.plan(bandwidth_downgrades_);
+    planner.log();
+    if (!ok) {
+        ROS_FATAL("The camera configuration doesn't fit the USB budget of %.0f MB/s, allow downgrades with 'bandwidth_downgrade'",
+                  usb_budget_mb_);
+        ros::shutdown();
+        return;
+    }
+
+    link_plan_ = planner.cameras();
+    for (int i = 0; i < numCameras_; i++)
+        apply_link_plan(i);
+
+    // The rate is common to all cameras. Free running the master's own rate
+    // paces the set, software triggered the loop's rate control does, turned
+    // on if it wasn't.
+    if (numCameras_ > 0 && planner.cameras()[0].fps < fps) {
+        master_fps_ = planner.cameras()[0].fps;
+        if (FREE_RUN_ || MAX_RATE_SAVE_) {
+            cams[MASTER_CAM_].setBoolValue("AcquisitionFrameRateEnable", true);
+            cams[MASTER_CAM_].setFloatValue("AcquisitionFrameRate", master_fps_);
+        } else {
+            SOFT_FRAME_RATE_CTRL_ = true;
+            soft_framerate_ = max((int)master_fps_, 1);
+        }
+        ROS_WARN("Frame rate lowered to %.1f fps to fit the USB budget", master_fps_);
+    }
+
+}
+
+// Downgrades and caps camera i as planned. Run on the launch settings, at
+// start and again when the camera was recovered.
+void acquisition::Capture::apply_link_plan(int i) {
+
+    if (i >= link_plan_.size())
+        return;
+
+    const LinkDemand& d = link_plan_[i];
+    if (d.bytes_per_pixel < bytes_per_pixel(i))
+        cams[i].setEnumValue("PixelFormat", color_ ? "BayerRG8" : "Mono8");
+    if (d.binning > 1) {
+        int binning = max((int)cams[i].getIntValue("BinningHorizontal"), 1);
+        cams[i].setIntValue("BinningHorizontal", binning*d.binning);
+        cams[i].setIntValue("BinningVertical", binning*d.binning);
+    }
+    if (d.limit_max > 0)
+        cams[i].setIntValue("DeviceLinkThroughputLimit", d.throughput_limit);
+
+}
+
+double acquisition::Capture::bytes_per_pixel(int i) {
+
+    string pixel_size = cams[i].getEnumValue("PixelSize");
+    return pixel_size.compare(0, 3, "Bpp") == 0 ? atoi(pixel_size.c_str() + 3)/8.0 : 1;
+
+}
+
+// Offsets the exposure of each camera within the frame period so that
+// readouts follow each other on the shared host controller instead of
+// bursting at once. Readout time is estimated from the payload and the
+// link throughput; TriggerDelay applies the phase on the camera, so it
+// holds for software and hardware triggers alike.
+// Also run again whenever a payload changes (reconfigured format or
+// binning, recovered camera); only the delays that moved are written
+void acquisition::Capture::schedule_trigger_phases() {
+
+    vector<double> previous = trigger_offsets_;
+    previous.resize(numCameras_, 0);
+    trigger_offsets_.assign(numCameras_, 0);
+    readout_times_.resize(numCameras_, 0);
+    payload_bytes_.resize(numCameras_, 0);
+
+    for (int i = 0; i < numCameras_; i++) {
+        // A stalled camera keeps what it had until it is back
+        if (!streaming(i) && payload_bytes_[i] > 0)
+            continue;
+        payload_bytes_[i] = cams[i].get_payload_size();
+        int64_t throughput = cams[i].getIntValue("DeviceLinkThroughputLimit");
+        if (throughput <= 0)
+            throughput = cams[i].getIntValue("DeviceLinkSpeed");
+        if (throughput <= 0)
+            throughput = 380000000;    // what USB3 sustains in practice
+        readout_times_[i] = double(payload_bytes_[i])/throughput;
+    }
+
+    if (!STAGGER_TRIGGERS_ || numCameras_ < 2)
+        return;
+
+    double period = 1.0/(SOFT_FRAME_RATE_CTRL_ ? soft_framerate_ : master_fps_);
+    double bound = stagger_max_offset_us_ > 0 ? stagger_max_offset_us_*1e-6 : period/2;
+    bound = min(bound, period);
+
+    // The master goes first, every other camera starts when the previous one is read out
+    vector<int> order;
+    order.push_back(MASTER_CAM_);
+    for (int i = 0; i < numCameras_; i++)
+        if (i != MASTER_CAM_)
+            order.push_back(i);
+
+    double offset = 0;
+    for (int k = 1; k < order.size(); k++) {
+        offset += readout_times_[order[k-1]];
+        trigger_offsets_[order[k]] = offset;
+    }
+
+    // Bounded: squeeze the phases, readouts then partly overlap again
+    if (offset > bound) {
+        double scale = bound/offset;
+        for (int i = 0; i < numCameras_; i++)
+            trigger_offsets_[i] *= scale;
+        ROS_WARN("Staggered readouts need %.0f us, bounded to %.0f us: readouts overlap by %.0f%%",
+                 offset*1e6, bound*1e6, (1 - scale)*100);
+    }
+
+    for (int k = 0; k < order.size(); k++) {
+        int i = order[k];
+        if (trigger_offsets_[i] != previous[i] && streaming(i))
+            apply_trigger_phase(i);
+        ROS_INFO("Camera %s trigger phase: %.0f us (readout %.0f us, %.1f MB)", cam_ids_[i].c_str(),
+                 trigger_offsets_[i]*1e6, readout_times_[i]*1e6, payload_bytes_[i]/1048576.0);
+    }
+    ROS_INFO("Largest inter-camera offset: %.0f us", trigger_offsets_[order.back()]*1e6);
+
+}
+
+void acquisition::Capture::apply_trigger_phase(int i) {
+
+    if (i >= trigger_offsets_.size() || trigger_offsets_[i] <= 0)
+        return;
+    try {
+        cams[i].setFloatValue("TriggerDelay", trigger_offsets_[i]*1e6);
+    } catch (Spinnaker::Exception &e) {
+        ROS_WARN_STREAM("Camera " << cam_ids_[i] << ": unable to set its trigger phase: " << e.what());
+    }
+
+}
+
+void acquisition::Capture::log_sync_stats() {
+
+    if (skew_count_ == 0)
+        return;
+
+    ROS_INFO("Inter-camera skew (us):- mean: %.1f, max: %.1f over %d sets (%s sync%s)",
+             skew_sum_/skew_count_, skew_max_, skew_count_, sync_mode_.c_str(), STAGGER_TRIGGERS_?", staggered":"");
+    ROS_INFO("Peak link bandwidth (MB/s):- mean: %.1f, max: %.1f",
+             peak_bw_sum_/skew_count_/1048576.0, peak_bw_max_/1048576.0);
+    skew_sum_ = skew_max_ = 0;
+    peak_bw_sum_ = peak_bw_max_ = 0;
+    skew_count_ = 0;
+
+}
+
+// Highest sum of link rates of the cameras reading out at the same time,
+// taking readout to start at the (common clock) frame timestamps
+double acquisition::Capture::peak_bandwidth(const vector<int>& cams, const vector<double>& starts) {
+
+    if (readout_times_.size() != numCameras_)
+        return 0;
+
+    double peak = 0;
+    for (int i = 0; i < starts.size(); i++) {
+        double bw = 0;
+        for (int k = 0; k < starts.size(); k++) {
+            double readout = readout_times_[cams[k]];
+            if (readout > 0 && starts[k] <= starts[i] && starts[i] < starts[k] + readout)
+                bw += payload_bytes_[cams[k]]/readout;
+        }
+        peak = max(peak, bw);
+    }
+    return peak;
+
+}
+
+void acquisition::Capture::trigger_all() {
+
+    // Without a sequencer every due camera gets its next exposure first,
+    // slaves included, all writes before the first trigger
+    for (int i = 0; i < numCameras_; i++) {
+        if (!HDR_ || !hdr_alternate_[i] || !due(i) || !streaming(i))
+            continue;
+        cams[i].setFloatValue("ExposureTime", hdr_next_long_[i] ? hdr_long_exposure_ : hdr_short_exposure_);
+        hdr_next_long_[i] = !hdr_next_long_[i];
+    }
+
+    // Hardware triggered slaves follow the master strobe, free running cameras
+    // need nothing, divided cameras only get the ticks they are due
+    ros::Time stamp = ros::Time::now();
+    for (int i = 0; i < numCameras_; i++) {
+        if (trigger_modes_[i] != "software" || !due(i) || !streaming(i))
+            continue;
+        // The grab that follows counts the miss
+        try {
+            cams[i].trigger();
+            trigger_stamp_ = stamp;
+        } catch (Spinnaker::Exception &e) {
+            if (!WATCHDOG_)
+                throw;
+            ROS_WARN_STREAM("Camera " << cam_ids_[i] << " could not be triggered: " << e.what());
+        }
+    }
+
+}
+
+// YAML numbers come as int or double
+static double xmlrpc_to_double(XmlRpc::XmlRpcValue& value) {
+
+    return value.getType() == XmlRpc::XmlRpcValue::TypeInt ? static_cast<int>(value) : static_cast<double>(value);
+
+}
+
+// Auto exposure settings of every camera, 'default' then per camera, e.g.
+//   auto_exposure_settings: {default: {target: 110}, bottom: {target: 90, roi: [0.25, 0.5, 0.5, 0.5]}}
+void acquisition::Capture::load_auto_exposure() {
+
+    AutoExposureSettings defaults;
+    defaults.target = 110;
+    defaults.roi = Rect2d(0, 0, 1, 1);
+    defaults.speed = 0.5;
+    defaults.min_exposure = 20;
+    defaults.max_exposure = 15000;
+    defaults.max_gain = 18;
+    defaults.clip_limit = 0.02;
+    defaults.stride = 4;
+    defaults.settle = 3;
+
+    ae_settings_.assign(numCameras_, defaults);
+    auto_exposures_.assign(numCameras_, boost::shared_ptr<AutoExposure>());
+    ae_pending_.assign(numCameras_, false);
+    if (!AUTO_EXPOSURE_)
+        return;
+
+    XmlRpc::XmlRpcValue config;
+    if (!nh_pvt_.getParam("auto_exposure_settings", config) || config.getType() != XmlRpc::XmlRpcValue::TypeStruct)
+        ROS_WARN("  'auto_exposure_settings' Parameter not set, using default behavior target=%.0f",defaults.target);
+
+    for (int i = 0; i < numCameras_; i++) {
+        AutoExposureSettings& s = ae_settings_[i];
+        const char* sources[2] = {"default", cam_names_[i].c_str()};
+        for (int k = 0; k < 2; k++) {
+            if (config.getType() != XmlRpc::XmlRpcValue::TypeStruct || !config.hasMember(sources[k]))
+                continue;
+            XmlRpc::XmlRpcValue& c = config[sources[k]];
+            ROS_ASSERT_MSG(c.getType() == XmlRpc::XmlRpcValue::TypeStruct, "Auto exposure settings must be a map!");
+            if (c.hasMember("target")) s.target = xmlrpc_to_double(c["target"]);
+            if (c.hasMember("speed")) s.speed = min(max(xmlrpc_to_double(c["speed"]), 0.05), 1.0);
+            if (c.hasMember("min_exposure")) s.min_exposure = xmlrpc_to_double(c["min_exposure"]);
+            if (c.hasMember("max_exposure")) s.max_exposure = xmlrpc_to_double(c["max_exposure"]);
+            if (c.hasMember("max_gain")) s.max_gain = xmlrpc_to_double(c["max_gain"]);
+            if (c.hasMember("clip_limit")) s.clip_limit = xmlrpc_to_double(c["clip_limit"]);
+            if (c.hasMember("stride")) s.stride = max(static_cast<int>(c["stride"]), 1);
+            if (c.hasMember("settle")) s.settle = max(static_cast<int>(c["settle"]), 0);
+            if (c.hasMember("roi")) {
+                ROS_ASSERT_MSG(c["roi"].getType() == XmlRpc::XmlRpcValue::TypeArray && c["roi"].size() == 4,
+                               "An auto exposure roi is [x, y, width, height], as fractions of the frame!");
+                s.roi = Rect2d(xmlrpc_to_double(c["roi"][0]), xmlrpc_to_double(c["roi"][1]),
+                               xmlrpc_to_double(c["roi"][2]), xmlrpc_to_double(c["roi"][3]));
+            }
+        }
+        ROS_INFO("  Camera %s auto exposure: target %.0f, speed %.2f, roi [%.2f %.2f %.2f %.2f], %.0f-%.0f us, gain <= %.1f dB",
+                 cam_names_[i].c_str(), s.target, s.speed, s.roi.x, s.roi.y, s.roi.width, s.roi.height,
+                 s.min_exposure, s.max_exposure, s.max_gain);
+    }
+
+}
+
+// Tone curve of every camera, 'default' then per camera, e.g.
+//   tone_curves: {default: {gamma: 1.0, contrast: 1.0}, bottom: {gamma: 1.6}}
+void acquisition::Capture::load_tone_curves() {
+
+    ToneCurve defaults;
+    defaults.gamma = 1;
+    defaults.contrast = 1;
+    tone_curves_.assign(numCameras_, defaults);
+
+    XmlRpc::XmlRpcValue config;
+    if (!nh_pvt_.getParam("tone_curves", config) || config.getType() != XmlRpc::XmlRpcValue::TypeStruct) {
+        ROS_WARN("  'tone_curves' Parameter not set, using default behavior: frames published as converted");
+        return;
+    }
+
+    for (int i = 0; i < numCameras_; i++) {
+        ToneCurve& t = tone_curves_[i];
+        const char* sources[2] = {"default", cam_names_[i].c_str()};
+        for (int k = 0; k < 2; k++) {
+            if (!config.hasMember(sources[k]))
+                continue;
+            XmlRpc::XmlRpcValue& c = config[sources[k]];
+            ROS_ASSERT_MSG(c.getType() == XmlRpc::XmlRpcValue::TypeStruct, "A tone curve must be a map!");
+            if (c.hasMember("gamma")) t.gamma = xmlrpc_to_double(c["gamma"]);
+            if (c.hasMember("contrast")) t.contrast = xmlrpc_to_double(c["contrast"]);
+        }
+        if (t.gamma <= 0 || t.contrast <= 0) {
+            ROS_WARN("  Camera %s: tone curve gamma %.2f, contrast %.2f is not valid (> 0), using default behavior",
+                     cam_names_[i].c_str(), t.gamma, t.contrast);
+            t = defaults;
+        }
+        ROS_INFO("  Camera %s tone curve: gamma %.2f, contrast %.2f", cam_names_[i].c_str(), t.gamma, t.contrast);
+    }
+
+}
+
+void acquisition::Capture::apply_tone_curve() {
+
+    for (int i = 0; i < numCameras_; i++)
+        apply_tone_curve(i);
+
+}
+
+// A pure gamma goes to the camera's Gamma node when it applies it to what we
+// get; anything else is a table lookup in the conversion pass, folded into
+// the packed format table, the ISP copy or the raw bytes
+void acquisition::Capture::apply_tone_curve(int i) {
+
+    const ToneCurve& t = tone_curves_[i];
+    if (t.gamma <= 0 || t.contrast <= 0) {
+        ROS_WARN("Camera %s: tone curve gamma %.2f, contrast %.2f is not valid (> 0), ignored", cam_ids_[i].c_str(), t.gamma, t.contrast);
+        return;
+    }
+    bool identity = t.gamma == 1 && t.contrast == 1;
+    // The host's color matrix must see the colors before the curve
+    bool camera = !identity && t.contrast == 1 && bit_depth_ <= 8 && !color_corrections_[i];
+
+    // Off unless it takes the whole curve, whatever a previous run left on
+    bool on_camera = false;
+    try {
+        on_camera = cams[i].setGamma(camera ? 1/t.gamma : 1.0) && camera;
+    } catch (Spinnaker::Exception &e) {
+        ROS_WARN_STREAM("Camera " << cam_ids_[i] << " gamma: " << e.what());
+    }
+
+    vector<uchar> lut;
+    if (!identity && !on_camera)
+        kernels::make_curve_lut(t.gamma, t.contrast, lut);
+    cams[i].set_tone_curve(lut);
+
+    if (!identity)
+        ROS_INFO("Camera %s tone curve (gamma %.2f, contrast %.2f) applied on the %s", cam_ids_[i].c_str(),
+                 t.gamma, t.contrast, on_camera ? "camera" : "host");
+
+}
+
+// Meters one converted frame, before the tone curve, and keeps the new
+// exposure/gain for the next frame boundary. The metering region is in
+// sensor coordinates: it is oriented like the frame, which has the sensor's
+// mirrors or, when `oriented`, the camera's whole orientation. Pipeline
+// stages call it from their own threads.
+void acquisition::Capture::meter_frame(int i, const Mat& frame, const FrameMetadata& meta, bool oriented) {
+
+    if (!auto_exposures_[i])
+        return;
+    if (frame.depth() != CV_8U) {
+        ROS_WARN_ONCE("Auto exposure meters 8 bit frames only, set a 'tone_map' with 'bit_depth' above 8");
+        return;
+    }
+
+    Orientation o = oriented ? orientations_[i] : sensor_orientation(i);
+    Rect2d roi = auto_exposures_[i]->settings().roi;
+    if (o.flip_x)
+        roi.x = 1 - roi.x - roi.width;
+    if (o.flip_y)
+        roi.y = 1 - roi.y - roi.height;
+    if (o.transpose)
+        roi = Rect2d(roi.y, roi.x, roi.height, roi.width);
+
+    ExposureStats stats = AutoExposure::meter(frame, roi, auto_exposures_[i]->settings().stride);
+    boost::mutex::scoped_lock lock(ae_mutex_);
+    if (auto_exposures_[i]->update(stats, meta)) {
+        ae_pending_[i] = true;
+        ROS_DEBUG("Camera %s: mean %.1f -> exposure %.0f us, gain %.1f dB", cam_names_[i].c_str(), stats.mean(),
+                  auto_exposures_[i]->exposure(), auto_exposures_[i]->gain());
+    }
+
+}
+
+// Color correction of every camera, 'default' then per camera, e.g.
+//   color_correction: {default: {mode: gray_world}, bottom: {mode: fixed, gains: [1.8, 1.0, 0.8]}}
+// gains are [r, g, b] and the matrix is RGB, row major, applied after them
+void acquisition::Capture::load_color_correction() {
+
+    ColorCorrectionSettings defaults;
+    defaults.gray_world = false;
+    for (int c = 0; c < 3; c++)
+        defaults.gains[c] = 1;
+    for (int k = 0; k < 9; k++)
+        defaults.matrix[k] = k % 4 == 0 ? 1 : 0;
+    defaults.every = 10;
+    defaults.stride = 8;
+    defaults.speed = 0.3;
+    defaults.max_gain = 4;
+    color_corrections_.assign(numCameras_, boost::shared_ptr<ColorCorrection>());
+
+    XmlRpc::XmlRpcValue config;
+    if (!nh_pvt_.getParam("color_correction", config) || config.getType() != XmlRpc::XmlRpcValue::TypeStruct) {
+        ROS_WARN("  'color_correction' Parameter not set, using default behavior: frames published as converted");
+        return;
+    }
+
+    for (int i = 0; i < numCameras_; i++) {
+        ColorCorrectionSettings s = defaults;
+        string mode = "off";
+        const char* sources[2] = {"default", cam_names_[i].c_str()};
+        for (int k = 0; k < 2; k++) {
+            if (!config.hasMember(sources[k]))
+                continue;
+            XmlRpc::XmlRpcValue& c = config[sources[k]];
+            ROS_ASSERT_MSG(c.getType() == XmlRpc::XmlRpcValue::TypeStruct, "A color correction must be a map!");
+            if (c.hasMember("mode")) mode = static_cast<string>(c["mode"]);
+            if (c.hasMember("gains")) {
+                ROS_ASSERT_MSG(c["gains"].getType() == XmlRpc::XmlRpcValue::TypeArray && c["gains"].size() == 3,
+                               "Color correction gains are [r, g, b]!");
+                for (int ch = 0; ch < 3; ch++)
+                    s.gains[2 - ch] = xmlrpc_to_double(c["gains"][ch]);
+            }
+            if (c.hasMember("matrix")) {
+                ROS_ASSERT_MSG(c["matrix"].getType() == XmlRpc::XmlRpcValue::TypeArray && c["matrix"].size() == 9,
+                               "A color correction matrix is 9 values, RGB, row major!");
+                for (int m = 0; m < 9; m++)
+                    s.matrix[m] = xmlrpc_to_double(c["matrix"][m]);
+            }
+            if (c.hasMember("every")) s.every = max(static_cast<int>(c["every"]), 1);
+            if (c.hasMember("stride")) s.stride = max(static_cast<int>(c["stride"]), 1);
+            if (c.hasMember("speed")) s.speed = min(max(xmlrpc_to_double(c["speed"]), 0.05), 1.0);
+            if (c.hasMember("max_gain")) s.max_gain = max(xmlrpc_to_double(c["max_gain"]), 1.0);
+        }
+        if (mode == "off")
+            continue;
+        if (mode != "gray_world" && mode != "fixed") {
+            ROS_WARN("  Camera %s: color correction mode %s is not valid (off, gray_world, fixed), using default behavior",
+                     cam_names_[i].c_str(), mode.c_str());
+            continue;
+        }
+        // The kernel takes coefficients in ]-8, 8[ once the gains are folded
+        // in, gray world may take them up to max_gain
+        bool valid = true;
+        for (int m = 0; m < 9; m++) {
+            double gain = mode == "gray_world" ? max(s.max_gain, s.gains[2 - m % 3]) : s.gains[2 - m % 3];
+            valid = valid && fabs(s.matrix[m]*gain) < 8;
+        }
+        if (!valid) {
+            ROS_WARN("  Camera %s: color correction coefficients must stay within +-8 with the gains, using default behavior",
+                     cam_names_[i].c_str());
+            continue;
+        }
+        s.gray_world = mode == "gray_world";
+        if (!color_) {
+            ROS_WARN_ONCE("  Color correction is for color frames, set 'color' to use it");
+            continue;
+        }
+        color_corrections_[i].reset(new ColorCorrection(s));
+        ROS_INFO("  Camera %s color correction: %s, gains r %.2f g %.2f b %.2f", cam_names_[i].c_str(), mode.c_str(),
+                 s.gains[2], s.gains[1], s.gains[0]);
+    }
+
+}
+
+void acquisition::Capture::apply_color_correction() {
+
+    for (int i = 0; i < numCameras_; i++)
+        cams[i].set_color_matrix(color_corrections_[i] ? color_corrections_[i]->matrix() : vector<short>());
+
+}
+
+// Gray world statistics of one converted frame; new gains reach the camera's
+// conversion from its next frame. One caller per camera at a time.
+void acquisition::Capture::observe_colors(int i, const Mat& frame) {
+
+    if (!color_corrections_[i] || !color_corrections_[i]->observe(frame))
+        return;
+    cams[i].set_color_matrix(color_corrections_[i]->matrix());
+    const double* g = color_corrections_[i]->gains();
+    ROS_DEBUG("Camera %s: white balance gains r %.2f g %.2f b %.2f", cam_names_[i].c_str(), g[2], g[1], g[0]);
+
+}
+
+void acquisition::Capture::apply_auto_exposure() {
+
+    if (!AUTO_EXPOSURE_)
+        return;
+
+    boost::mutex::scoped_lock lock(ae_mutex_);
+    for (int i = 0; i < numCameras_; i++) {
+        if (!ae_pending_[i] || !streaming(i))
+            continue;
+        cams[i].setExposureGain(auto_exposures_[i]->exposure(), auto_exposures_[i]->gain());
+        ae_pending_[i] = false;
+    }
+
+}
+
+// The chunk tells which exposure a frame got, the count only which one it
+// should have; a frame with chunk data puts the count back in step
+bool acquisition::Capture::hdr_is_long(int i, const FrameMetadata& meta) {
+
+    bool is_long = hdr_parity_[i] & 1;
+    if (meta.valid)
+        is_long = meta.exposure_time > (hdr_short_exposure_ + hdr_long_exposure_)/2;
+    hdr_parity_[i] = is_long ? 0 : 1;
+    return is_long;
+
+}
+
+// Pairs every long exposure with the short one before it and fuses them on
+// the pool. Short frames are only kept, so the cameras publish (and record)
+// at half the capture rate.
+void acquisition::Capture::fuse_hdr() {
+
+    TaskGroup group;
+    for (int i = 0; i < numCameras_; i++) {
+        if (!fresh_[i])
+            continue;
+        if (!hdr_is_long(i, metadata_[i])) {
+            hdr_short_[i] = frames_[i];
+            fresh_[i] = false;
+            continue;
+        }
+        if (hdr_short_[i].empty() || hdr_short_[i].size() != frames_[i].size() || hdr_short_[i].type() != frames_[i].type()) {
+            fresh_[i] = false;
+            continue;
+        }
+        worker_pool_->submit(boost::bind(&Capture::fuse_frame, this, i), "hdr", &group);
+    }
+    worker_pool_->wait(group);
+
+}
+
+void acquisition::Capture::fuse_frame(int i) {
+
+    frames_[i] = fuse_exposures(hdr_short_[i], frames_[i]);
+    hdr_short_[i] = Mat();
+
+}
+
+Mat acquisition::Capture::fuse_exposures(const Mat& short_exp, const Mat& long_exp) {
+
+    if (long_exp.depth() != CV_8U) {
+        ROS_WARN_ONCE("HDR fusion needs 8 bit frames, set a 'tone_map' with 'bit_depth' above 8");
+        return long_exp;
+    }
+
+    double t = ros::WallTime::now().toSec();
+
+    Mat fused;
+    fused.allocator = frame_pool_.get();
+    fused.create(long_exp.size(), long_exp.type());
+    size_t bytes = long_exp.cols*long_exp.elemSize();
+    for (int y = 0; y < long_exp.rows; y++)
+        kernels::fuse_exposures(short_exp.ptr(y), long_exp.ptr(y), fused.ptr(y), bytes, hdr_knee_);
+
+    t = ros::WallTime::now().toSec() - t;
+    ROS_DEBUG("HDR fusion of %dx%d took %.2f ms", long_exp.cols, long_exp.rows, t*1000);
+    boost::mutex::scoped_lock lock(hdr_mutex_);
+    hdr_fuse_time_ += t;
+    hdr_fused_++;
+    return fused;
+
+}
+
+// Latches every camera clock and pairs it with the host time of the
+// request. The USB round trip bounds the error, a few tens of us, which is
+// also the floor of the skew we can measure.
+void acquisition::Capture::calibrate_clocks() {
+
+    clock_offsets_.assign(numCameras_, 0);
+    for (int i = 0; i < numCameras_; i++) {
+        // Not part of any set until it is back
+        if (!streaming(i))
+            continue;
+        int64_t before = ros::WallTime::now().toNSec();
+        int64_t latched = cams[i].latch_timestamp();
+        int64_t after = ros::WallTime::now().toNSec();
+        if (latched < 0) {
+            // Not worth a control transfer per set from now on
+            ROS_WARN("Camera clocks cannot be latched, the trigger skew is not measured");
+            clock_offsets_.clear();
+            clock_latch_failed_ = true;
+            return;
+        }
+        clock_offsets_[i] = latched - (before + after)/2;
+    }
+    clock_calibration_time_ = ros::WallTime::now().toSec();
+
+}
+
+// Spread of the exposure start times of the last set, on a common clock
+void acquisition::Capture::measure_skew() {
+
+    // Only for the benchmark, latching costs control transfers on the grab path
+    if (!TIME_BENCHMARK_ || numCameras_ < 2 || clock_latch_failed_)
+        return;
+
+    // Camera clocks drift apart, recalibrate every 10 s
+    if (clock_offsets_.empty() || ros::WallTime::now().toSec() - clock_calibration_time_ > 10.0) {
+        calibrate_clocks();
+        if (clock_offsets_.empty())
+            return;
+    }
+
+    // Only the cameras of this set, divided ones may not be part of it
+    vector<int> members;
+    vector<double> starts;
+    for (int i = 0; i < numCameras_; i++) {
+        if (!fresh_[i])
+            continue;
+        members.push_back(i);
+        starts.push_back((cams[i].get_raw_time_stamp() - clock_offsets_[i])*1e-9);
+    }
+    if (members.size() < 2)
+        return;
+
+    // Staggered phases are intended, only what exceeds them is skew
+    vector<double> aligned = starts;
+    for (int k = 0; k < members.size(); k++)
+        if (members[k] < trigger_offsets_.size())
+            aligned[k] -= trigger_offsets_[members[k]];
+    double skew = (*max_element(aligned.begin(), aligned.end()) - *min_element(aligned.begin(), aligned.end()))*1e6;  // us
+    skew_sum_ += skew;
+    skew_max_ = max(skew_max_, skew);
+    skew_count_++;
+
+    double bw = peak_bandwidth(members, starts);
+    peak_bw_sum_ += bw;
+    peak_bw_max_ = max(peak_bw_max_, bw);
+
+}
+
+// Achieved rate against what the sensors and the host could each sustain.
+// Serially the two add up, pipelined the slowest of them sets the rate.
+void acquisition::Capture::log_frame_rates() {
+
+    double now = ros::Time::now().toSec();
+    if (now - sensor_fps_read_time_ > 1.0) {
+        // Depends on exposure, which may be auto or reconfigured, refresh it now and then
+        sensor_max_fps_ = 0;
+        for (int i = 0; i < numCameras_; i++) {
+            if (!streaming(i))
+                continue;
+            double fps = cams[i].getFloatValue("AcquisitionResultingFrameRate");
+            if (fps > 0 && (sensor_max_fps_ == 0 || fps < sensor_max_fps_))
+                sensor_max_fps_ = fps;
+        }
+        sensor_fps_read_time_ = now;
+    }
+
+    double host_time = toMat_time_ - grab_time_ + save_mat_time_ + export_to_ROS_time_;
+    double host_fps = host_time > 0 ? 1/host_time : 0;
+    double max_fps;
+    if (sensor_max_fps_ <= 0)
+        max_fps = host_fps;
+    else if (PIPELINED_TRIGGER_)
+        max_fps = min(sensor_max_fps_, host_fps);
+    else
+        max_fps = 1/(1/sensor_max_fps_ + host_time);
+    if (SOFT_FRAME_RATE_CTRL_)
+        max_fps = min(max_fps, (double)soft_framerate_);
+
+    ROS_INFO("FPS:- achieved: %.1f, theoretical max: %.1f (sensor: %.1f, host: %.1f, %s)",
+             1/achieved_time_, max_fps, sensor_max_fps_, host_fps, PIPELINED_TRIGGER_?"pipelined":"serial");
+
+}
+
+void acquisition::Capture::convert_frame(int i) {
+
+    // One conversion feeds the main image and every ROI. Without ROIs it
+    // may resample to the output size on the way.
+    try {
+        Mat full = cams[i].convert_image(pResultImages_[i], roi_streams_[i].empty() ? cams[i].output_size() : Size());
+        // Both before the matrix and the curve
+        if (AUTO_EXPOSURE_)
+            meter_frame(i, full, metadata_[i], false);
+        observe_colors(i, full);
+        frames_[i] = resize_oriented(i, full, cams[i].output_size());
+        if (!roi_streams_[i].empty())
+            extract_rois(i, full, roi_frames_[i]);
+    } catch (...) {
+        // The buffer goes back to the stream either way, the error to the
+        // capture loop through the pool
+        pResultImages_[i]->Release();
+        pResultImages_[i] = ImagePtr();
+        throw;
+    }
+    // give the buffer back to the stream
+    pResultImages_[i]->Release();
+    pResultImages_[i] = ImagePtr();
+
+}
+
 void acquisition::Capture::run_soft_trig() {
     achieved_time_ = ros::Time::now().toSec();
     ROS_INFO("*** ACQUISITION ***");
@@ -900,10 +3062,7 @@ void acquisition::Capture::run_soft_trig() {
 
     int count = 0;
     
-    for(int i = 0; i < cams.size(); ++i)
-    {
-        cams[i].trigger();
-    }
+    trigger_all();
     
     get_mat_images();
     if (SAVE_) {
@@ -914,6 +3073,9 @@ void acquisition::Capture::run_soft_trig() {
             save_mat_frames(0);
     }
 
+    if (EXPORT_TO_ROS_ && ASYNC_PUBLISH_)
+        publish_thread_ = boost::thread(&Capture::publish_loop, this);
+
     ros::Rate ros_rate(soft_framerate_);
     try{
         while( ros::ok() ) {
@@ -921,11 +3083,16 @@ void acquisition::Capture::run_soft_trig() {
             double t = ros::Time::now().toSec();
 
             if (LIVE_) {
+                for (int i=0; i<numCameras_; i++) {
+                    Frame frame;
+                    if (handoffs_[i]->latest(display_consumer_, frame))
+                        display_frames_[i] = frame.image;
+                }
                 if (GRID_VIEW_) {
                     update_grid();
                     imshow("Acquisition", grid_);
                 } else {
-                    imshow("Acquisition", frames_[CAM_]);
+                    imshow("Acquisition", display_frames_[CAM_]);
                     char title[50];
                     sprintf(title, "cam # = %d, cam ID = %s, cam name = %s", CAM_, cam_ids_[CAM_].c_str(), cam_names_[CAM_].c_str());
                     displayOverlay("Acquisition", title);
@@ -968,12 +3135,16 @@ void acquisition::Capture::run_soft_trig() {
 
             double disp_time_ = ros::Time::now().toSec() - t;
 
+            // Between frames: nothing is being grabbed, reconfigure now
+            restore_cameras(PIPELINED_TRIGGER_ && !MANUAL_TRIGGER_);
+            apply_commands(PIPELINED_TRIGGER_ && !MANUAL_TRIGGER_);
+            apply_auto_exposure();
+
             // Call update functions
             if (!MANUAL_TRIGGER_) {
-                for(int i = 0; i < cams.size(); ++i)
-                {
-                    cams[i].trigger();
-                }
+                // When pipelined this set was triggered as soon as the previous one was read out
+                if (!PIPELINED_TRIGGER_)
+                    trigger_all();
                 get_mat_images();
             }
 
@@ -994,10 +3165,15 @@ void acquisition::Capture::run_soft_trig() {
                 }
             }
             
-            if (EXPORT_TO_ROS_) export_to_ROS();
+            if (EXPORT_TO_ROS_ && !ASYNC_PUBLISH_) export_to_ROS();
             //cams[MASTER_CAM_].targetGreyValueTest();
             // ros publishing messages
             acquisition_pub.publish(mesg);
+            // names were published, don't let them pile up frame after frame
+            mesg.name.clear();
+
+            if (memory_governor_)
+                memory_governor_->update();
 
             // double total_time = grab_time_ + toMat_time_ + disp_time_ + save_mat_time_;
             double total_time = toMat_time_ + disp_time_ + save_mat_time_+export_to_ROS_time_;
@@ -1009,7 +3185,20 @@ void acquisition::Capture::run_soft_trig() {
             
             ROS_INFO_COND(TIME_BENCHMARK_,"Times (ms):- grab: %.1f, disp: %.1f, save: %.1f, exp2ROS: %.1f",
                           toMat_time_*1000,disp_time_*1000,save_mat_time_*1000,export_to_ROS_time_*1000);
+            if (TIME_BENCHMARK_)
+                log_frame_rates();
+            if (TIME_BENCHMARK_)
+                log_sync_stats();
             
+            if (TIME_BENCHMARK_ && HDR_ && hdr_fused_) {
+                boost::mutex::scoped_lock lock(hdr_mutex_);
+                ROS_INFO("HDR fusion: %d frames, %.2f ms/frame", hdr_fused_, hdr_fuse_time_*1000/hdr_fused_);
+            }
+            if (TIME_BENCHMARK_ && frame_pool_)
+                frame_pool_->log_stats("frames");
+            if (TIME_BENCHMARK_)
+                worker_pool_->log_stats();
+
             achieved_time_=ros::Time::now().toSec();
             
             if (SOFT_FRAME_RATE_CTRL_) {ros_rate.sleep();}
@@ -1022,92 +3211,175 @@ void acquisition::Capture::run_soft_trig() {
     catch(...){
         ROS_FATAL_STREAM("Some unknown exception occured. \v Exiting gracefully, \n  possible reason could be Camera Disconnection...");
     }
+
+    if (publish_thread_.joinable()) {
+        publish_thread_.interrupt();
+        publish_thread_.join();
+    }
 }
 
 float acquisition::Capture::mem_usage() {
-    std::string token;
-    std::ifstream file("/proc/meminfo");
-    unsigned long int total, free;
-    while (file >> token) {
-        if (token == "MemTotal:")
-            if (!(file >> total))
-                ROS_FATAL_STREAM("Could not poll total memory!");
-        if (token == "MemAvailable:")
-            if (!(file >> free)) {
-                ROS_FATAL_STREAM("Could not poll free memory!");
-                break;
-            }
-        // ignore rest of the line
-        file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+    return MemoryGovernor::system_usage();
+
+}
+
+void acquisition::Capture::register_memory_components() {
+
+    memory_governor_.reset(new MemoryGovernor(nh_, (size_t)memory_budget_mb_*1024*1024));
+
+    // Default order: recording is shed first, live vision last
+    map<string, int> priority;
+    priority["recording_queues"] = 0;
+    priority["image_names"] = 10;
+    priority["frame_pool"] = 20;
+    priority["publish_buffers"] = 30;
+    priority["driver_buffers"] = 100;
+    for (map<string, int>::iterator it = memory_priorities_.begin(); it != memory_priorities_.end(); ++it)
+        priority[it->first] = it->second;
+
+    map<string, size_t> limit;
+    for (map<string, int>::iterator it = memory_limits_mb_.begin(); it != memory_limits_mb_.end(); ++it)
+        limit[it->first] = (size_t)it->second*1024*1024;
+
+    if (buffer_arena_)
+        memory_governor_->register_component("driver_buffers", priority["driver_buffers"],
+                                             boost::bind(&BufferArena::total_footprint, buffer_arena_.get()));
+    if (frame_pool_)
+        memory_governor_->register_component("frame_pool", priority["frame_pool"],
+                                             boost::bind(&Capture::frame_pool_usage, this),
+                                             boost::bind(&FramePool::trim, frame_pool_.get(), _1),
+                                             limit["frame_pool"]);
+    memory_governor_->register_component("recording_queues", priority["recording_queues"],
+                                         boost::bind(&Capture::recording_queues_usage, this),
+                                         boost::bind(&Capture::shed_recording_queues, this, _1),
+                                         limit["recording_queues"]);
+    memory_governor_->register_component("image_names", priority["image_names"],
+                                         boost::bind(&Capture::image_names_usage, this));
+    memory_governor_->register_component("publish_buffers", priority["publish_buffers"],
+                                         boost::bind(&Capture::publish_buffers_usage, this));
+
+}
+
+size_t acquisition::Capture::frame_pool_usage() {
+
+    return frame_pool_->stats().resident_bytes;
+
+}
+
+size_t acquisition::Capture::recording_queues_usage() {
+
+    boost::mutex::scoped_lock lock(queue_mutex_);
+
+    size_t total = 0;
+    for (int i=0; i<image_queues_.size(); i++)
+        if (!image_queues_[i].empty())
+            total += image_queues_[i].size() * image_queues_[i].front()->GetBufferSize();
+    return total;
+
+}
+
+size_t acquisition::Capture::shed_recording_queues(size_t bytes_to_free) {
+
+    boost::mutex::scoped_lock lock(queue_mutex_);
+
+    // Drop the newest frames of the longest queue, the front one may be
+    // in the middle of being written by its writer thread
+    size_t freed = 0;
+    while (freed < bytes_to_free) {
+        int longest = -1;
+        for (int i=0; i<image_queues_.size(); i++)
+            if (image_queues_[i].size() > 1 && (longest < 0 || image_queues_[i].size() > image_queues_[longest].size()))
+                longest = i;
+        if (longest < 0)
+            break;
+
+        freed += image_queues_[longest].back()->GetBufferSize();
+        image_queues_[longest].pop_back();
+        dropped_frames_[longest]++;
     }
-    return 1-float(free)/float(total);
+    ROS_WARN_STREAM_COND(freed, "Dropped " << freed/1048576.0 << " MB of frames waiting to be recorded");
+    return freed;
+
+}
+
+size_t acquisition::Capture::image_names_usage() {
+
+    size_t total = 0;
+    for (int i=0; i<mesg.name.size(); i++)
+        total += mesg.name[i].capacity();
+    return total;
+
+}
+
+size_t acquisition::Capture::publish_buffers_usage() {
+
+    boost::mutex::scoped_lock lock(publish_mutex_);
+    size_t total = 0;
+    for (int i=0; i<img_msgs.size(); i++)
+        if (img_msgs[i])
+            total += img_msgs[i]->data.size();
+    return total;
+
 }
 
 void acquisition::Capture::update_grid() {
 
     if (!GRID_CREATED_) {
-        int height = frames_[0].rows;
-        int width = frames_[0].cols*cams.size();
-        
-        if (color_)
-        grid_.create(height, width, CV_8UC3);
-        else
-        grid_.create(height, width, CV_8U);
-        
+        grid_.allocator = frame_pool_.get();
         GRID_CREATED_ = true;
     }
 
-    for (int i=0; i<cams.size(); i++)
-        frames_[i].copyTo(grid_.colRange(i*frames_[i].cols,i*frames_[i].cols+frames_[i].cols).rowRange(0,grid_.rows));
+    // A no-op unless the displayed frames changed size or type, the old
+    // grid then goes back to the pool
+    int height = display_frames_[0].rows;
+    int width = display_frames_[0].cols*cams.size();
+    grid_.create(height, width, display_frames_[0].type());
+
+    worker_pool_->parallel_for_rows(grid_.rows, row_band_, boost::bind(&Capture::update_grid_rows, this, _1, _2), "grid");
     
 }
 
-//*** CODE FOR MULTITHREADED WRITING
-void acquisition::Capture::write_queue_to_disk(queue<ImagePtr>* img_q, int cam_no) {
- 
-    ROS_DEBUG("  Write Queue to Disk Thread Initiated for cam: %d", cam_no);
-
-    int imageCnt =0;
-    string id = cam_ids_[cam_no];
+void acquisition::Capture::update_grid_rows(int row_begin, int row_end) {
 
-    int k_numImages = nframes_;
+    for (int i=0; i<cams.size(); i++)
+        display_frames_[i].rowRange(row_begin, row_end).copyTo(grid_.colRange(i*display_frames_[i].cols,i*display_frames_[i].cols+display_frames_[i].cols).rowRange(row_begin, row_end));
 
-    while (imageCnt < k_numImages){
-//     ROS_DEBUG_STREAM("  Write Queue to Disk for cam: "<< cam_no <<" size = "<<img_q->size());
+}
 
-        if(img_q->empty()){
-            boost::this_thread::sleep(boost::posix_time::milliseconds(5));
-            continue;
-        }
+//*** CODE FOR MULTITHREADED WRITING
+void acquisition::Capture::write_queued_frame(deque<ImagePtr>* img_q, int cam_no) {
 
-        ROS_DEBUG_STREAM("  Write Queue to Disk for cam: "<< cam_no <<" size = "<<img_q->size());
+    // One task per queued frame, whichever worker picks it up writes the
+    // oldest frame of the camera
+    queue_mutex_.lock();
+    if (img_q->empty()) {
+        // shed by the memory governor in the meantime
+        queue_mutex_.unlock();
+        return;
+    }
+    ImagePtr convertedImage = img_q->front();
+    img_q->pop_front();
+    int imageCnt = written_frames_[cam_no]++;
+    int backlog = img_q->size();
+    queue_mutex_.unlock();
 
-        if (img_q->size()>100)
-            ROS_WARN_STREAM("  Queue "<<cam_no<<" size is :"<< img_q->size());
+    ROS_WARN_STREAM_COND(backlog>100, "  Queue "<<cam_no<<" size is :"<< backlog);
 
-        ImagePtr convertedImage = img_q->front();
-        uint64_t timeStamp =  convertedImage->GetTimeStamp() * 1000;
+    uint64_t timeStamp =  convertedImage->GetTimeStamp() * 1000;
 
-        // Create a unique filename
-        ostringstream filename;
-        filename<<path_<<cam_names_[cam_no]<<"/"<<cam_names_[cam_no]
-                <<"_"<<id<<"_"<<todays_date_ << "_"<<std::setfill('0')
-                << std::setw(6) << imageCnt<<"_"<<timeStamp << ext_; 
-            
-//     ROS_DEBUG_STREAM("Writing to "<<filename.str().c_str());
+    // Create a unique filename
+    ostringstream filename;
+    filename<<path_<<cam_names_[cam_no]<<"/"<<cam_names_[cam_no]
+            <<"_"<<cam_ids_[cam_no]<<"_"<<todays_date_ << "_"<<std::setfill('0')
+            << std::setw(6) << imageCnt<<"_"<<timeStamp << ext_; 
 
-        convertedImage->Save(filename.str().c_str());
-     
-        queue_mutex_.lock();
-        img_q->pop();
-        queue_mutex_.unlock();
+    convertedImage->Save(filename.str().c_str());
 
-        ROS_DEBUG_STREAM("Image saved at " << filename.str());
-        imageCnt++;
-    }
+    ROS_DEBUG_STREAM("Image saved at " << filename.str());
 }
 
-void acquisition::Capture::acquire_images_to_queue(vector<queue<ImagePtr>>*  img_qs) {
+void acquisition::Capture::acquire_images_to_queue(vector<deque<ImagePtr>>*  img_qs) {
     int result = 0;
     
     ROS_DEBUG("  Acquire Images to Queue Thread Initiated");
@@ -1142,8 +3414,9 @@ void acquisition::Capture::acquire_images_to_queue(vector<queue<ImagePtr>>*  img
                 imageNames.push_back(filename.str());
 
                 queue_mutex_.lock();
-                img_qs->at(i).push(convertedImage);
+                img_qs->at(i).push_back(convertedImage);
                 queue_mutex_.unlock();
+                worker_pool_->submit(boost::bind(&Capture::write_queued_frame, this, &img_qs->at(i), i), "write", &write_group_);
 
                 ROS_DEBUG_STREAM("Queue no. "<<i<<" size: "<<img_qs->at(i).size());
 
@@ -1167,6 +3440,9 @@ void acquisition::Capture::acquire_images_to_queue(vector<queue<ImagePtr>>*  img
 
         // ros publishing messages
         acquisition_pub.publish(mesg);
+
+        if (memory_governor_)
+            memory_governor_->update();
     }
     return;
 }
@@ -1177,30 +3453,428 @@ void acquisition::Capture::run_mt() {
     if (!CAM_DIRS_CREATED_)
         create_cam_directories();
     
-    boost::thread_group threads;
+    image_queues_.assign(numCameras_, std::deque<ImagePtr>());
+    dropped_frames_.assign(numCameras_, 0);
+    written_frames_.assign(numCameras_, 0);
+
+    // Acquisition keeps its own thread, writing is spread over the worker pool
+    boost::thread acquisition_thread(boost::bind(&Capture::acquire_images_to_queue, this, &image_queues_));
+
+    ROS_DEBUG("Joining acquisition thread");
+    acquisition_thread.join();
+    worker_pool_->wait(write_group_);
+    ROS_DEBUG("All frames written");
 
-    vector<std::queue<ImagePtr>> image_queue_vector;
+    for (int i=0; i<numCameras_; i++)
+        ROS_WARN_STREAM_COND(dropped_frames_[i], dropped_frames_[i] << " frames of camera " << cam_names_[i] << " were dropped to stay within the memory budget");
+
+    if (TIME_BENCHMARK_)
+        worker_pool_->log_stats();
+}
+
+//*** STAGE-GRAPH PIPELINE
+void acquisition::Capture::build_pipelines() {
+
+    XmlRpc::XmlRpcValue config;
+    bool has_config = nh_pvt_.getParam("pipelines", config) && config.getType() == XmlRpc::XmlRpcValue::TypeStruct;
 
     for (int i=0; i<numCameras_; i++) {
-        std::queue<ImagePtr> img_ptr_queue;
-        image_queue_vector.push_back(img_ptr_queue);
+
+        boost::shared_ptr<Pipeline> pipeline(new Pipeline(cam_names_[i]));
+        rect_maps_.push_back(pair<Mat, Mat>());
+
+        XmlRpc::XmlRpcValue stages;
+        if (has_config && config.hasMember(cam_names_[i]))
+            stages = config[cam_names_[i]];
+        else if (has_config && config.hasMember("default"))
+            stages = config["default"];
+
+        if (stages.getType() == XmlRpc::XmlRpcValue::TypeArray) {
+
+            string previous;
+            for (int k=0; k<stages.size(); k++) {
+                XmlRpc::XmlRpcValue& st = stages[k];
+                ROS_ASSERT_MSG(st.getType() == XmlRpc::XmlRpcValue::TypeStruct && st.hasMember("name"),
+                               "Every pipeline stage needs at least a name!");
+                string name = static_cast<string>(st["name"]);
+                string type = st.hasMember("type") ? static_cast<string>(st["type"]) : name;
+                int queue = st.hasMember("queue") ? static_cast<int>(st["queue"]) : 2;
+                bool drop = st.hasMember("drop") ? static_cast<bool>(st["drop"]) : type != "record";
+
+                Pipeline::StageFn fn = make_stage(i, type, st);
+                ROS_ASSERT_MSG(fn, "Unknown pipeline stage type!");
+                pipeline->add_stage(name, fn, queue, drop);
+
+                // Without 'after' a stage follows the one listed before it
+                if (st.hasMember("after")) {
+                    if (st["after"].getType() == XmlRpc::XmlRpcValue::TypeArray) {
+                        for (int a=0; a<st["after"].size(); a++)
+                            pipeline->connect(static_cast<string>(st["after"][a]), name);
+                    } else if (static_cast<string>(st["after"]) != "") {
+                        pipeline->connect(static_cast<string>(st["after"]), name);
+                    }
+                } else if (!previous.empty()) {
+                    pipeline->connect(previous, name);
+                }
+                previous = name;
+            }
+
+        } else {
+
+            // Same processing as the soft trigger loop, stage by stage
+            XmlRpc::XmlRpcValue none;
+            pipeline->add_stage("convert", make_stage(i, "convert", none), 2, true);
+            string source = "convert";
+            if (AUTO_EXPOSURE_) {
+                // A side branch, nothing waits on the metering
+                pipeline->add_stage("ae", make_stage(i, "ae", none), 1, true);
+                pipeline->connect("convert", "ae");
+            }
+            if (color_corrections_[i] && color_corrections_[i]->settings().gray_world) {
+                pipeline->add_stage("wb", make_stage(i, "wb", none), 1, true);
+                pipeline->connect("convert", "wb");
+            }
+            if (HDR_) {
+                pipeline->add_stage("hdr", make_stage(i, "hdr", none), 2, true);
+                pipeline->connect(source, "hdr");
+                source = "hdr";
+            }
+            if (!roi_streams_[i].empty()) {
+                pipeline->add_stage("rois", make_stage(i, "rois", none), 2, true);
+                pipeline->connect(source, "rois");
+                source = "rois";
+            }
+            // To the camera's output size, as reconfigured
+            pipeline->add_stage("resize", make_stage(i, "resize", none), 2, true);
+            pipeline->connect(source, "resize");
+            if (EXPORT_TO_ROS_) {
+                // The async publisher reads the latest frame from the handoff
+                string publish = ASYNC_PUBLISH_ ? "handoff" : "publish";
+                pipeline->add_stage(publish, make_stage(i, publish, none), 1, true);
+                pipeline->connect("resize", publish);
+            }
+            if (SAVE_) {
+                pipeline->add_stage("encode", make_stage(i, "encode", none), 8, false);
+                pipeline->add_stage("record", make_stage(i, "record", none), 16, false);
+                pipeline->connect("resize", "encode");
+                pipeline->connect("encode", "record");
+            }
+
+        }
+
+        ROS_INFO_STREAM("Pipeline " << pipeline->describe());
+        pipelines_.push_back(pipeline);
+    }
+
+}
+
+acquisition::Pipeline::StageFn acquisition::Capture::make_stage(int cam, string type, XmlRpc::XmlRpcValue& params) {
+
+    if (type == "convert")
+        return boost::bind(&Capture::stage_convert, this, _1);
+    if (type == "resize") {
+        // Without a width and a height, the camera's output size at each frame
+        Size size;
+        if (params.getType() == XmlRpc::XmlRpcValue::TypeStruct && params.hasMember("width") && params.hasMember("height"))
+            size = Size(static_cast<int>(params["width"]), static_cast<int>(params["height"]));
+        resize_stages_[cam] = true;
+        return boost::bind(&Capture::stage_resize, this, _1, size);
+    }
+    if (type == "rectify")
+        return boost::bind(&Capture::stage_rectify, this, _1);
+    if (type == "encode")
+        return boost::bind(&Capture::stage_encode, this, _1);
+    if (type == "publish")
+        return boost::bind(&Capture::stage_publish, this, _1);
+    if (type == "record")
+        return boost::bind(&Capture::stage_record, this, _1);
+    if (type == "handoff")
+        return boost::bind(&Capture::stage_handoff, this, _1);
+    if (type == "rois")
+        return boost::bind(&Capture::stage_rois, this, _1);
+    if (type == "hdr")
+        return boost::bind(&Capture::stage_hdr, this, _1);
+    if (type == "ae")
+        return boost::bind(&Capture::stage_ae, this, _1);
+    if (type == "wb")
+        return boost::bind(&Capture::stage_wb, this, _1);
+
+    ROS_ERROR_STREAM("Unknown pipeline stage type " << type << " for camera " << cam_names_[cam]);
+    return Pipeline::StageFn();
+
+}
+
+bool acquisition::Capture::stage_convert(Frame& frame) {
+
+    if (!frame.raw)
+        return !frame.image.empty();
+
+    bool complete = !frame.raw->IsIncomplete();
+    if (complete) {
+        frame.image = cams[frame.cam].convert_image(frame.raw);
+        // Without a resize stage to fold it into, orient here
+        if (!resize_stages_[frame.cam])
+            frame.image = resize_oriented(frame.cam, frame.image, Size());
+    }
+    frame.raw->Release();
+    frame.raw = ImagePtr();
+    return complete;
+
+}
+
+// An empty size follows the camera's output size, OUTPUT_SIZE commands
+// included
+bool acquisition::Capture::stage_resize(Frame& frame, Size size) {
+
+    frame.image = resize_oriented(frame.cam, frame.image, size.area() ? size : cams[frame.cam].output_size());
+    return true;
+
+}
+
+bool acquisition::Capture::stage_rectify(Frame& frame) {
+
+    int i = frame.cam;
+    sensor_msgs::CameraInfoPtr info = cam_info_msgs[i];
+    if (info->K[0] == 0) {
+        ROS_WARN_STREAM_ONCE("No calibration for camera " << cam_names_[i] << ", rectify stage passes frames through");
+        return true;
+    }
+
+    // Only this stage's thread touches the maps of this camera
+    pair<Mat, Mat>& maps = rect_maps_[i];
+    if (maps.first.empty() || maps.first.size() != frame.image.size()) {
+        // Calibration is given at image_width x image_height, scale it to the frame
+        double sx = info->width ? double(frame.image.cols)/info->width : 1;
+        double sy = info->height ? double(frame.image.rows)/info->height : 1;
+        Mat K = Mat(3, 3, CV_64F, (void*)info->K.data()).clone();
+        Mat R = Mat(3, 3, CV_64F, (void*)info->R.data()).clone();
+        Mat P = Mat(3, 4, CV_64F, (void*)info->P.data()).colRange(0, 3).clone();
+        Mat D = Mat(info->D).clone();
+        if (P.at<double>(0, 0) == 0)
+            P = K.clone();
+        if (R.at<double>(0, 0) == 0)
+            R = Mat::eye(3, 3, CV_64F);
+        Mat kx = K.row(0), ky = K.row(1), px = P.row(0), py = P.row(1);
+        kx *= sx;
+        ky *= sy;
+        px *= sx;
+        py *= sy;
+        initUndistortRectifyMap(K, D, R, P, frame.image.size(), CV_16SC2, maps.first, maps.second);
+        ROS_INFO_STREAM("Rectification maps of camera " << cam_names_[i] << " built for "
+                        << frame.image.cols << "x" << frame.image.rows);
+    }
+
+    Mat rectified;
+    rectified.allocator = frame_pool_.get();
+    remap(frame.image, rectified, maps.first, maps.second, INTER_LINEAR);
+    frame.image = rectified;
+    return true;
+
+}
+
+bool acquisition::Capture::stage_encode(Frame& frame) {
+
+    if (SAVE_BIN_)
+        return true;
+    frame.encoded.reset(new vector<uchar>());
+    return imencode(ext_, frame.image, *frame.encoded);
+
+}
+
+bool acquisition::Capture::stage_publish(Frame& frame) {
+
+    publish_frame(frame.cam, frame);
+    return true;
+
+}
+
+bool acquisition::Capture::stage_record(Frame& frame) {
+
+    if (frame.filename.empty())
+        return false;
+
+    if (frame.encoded) {
+        std::ofstream ofs(frame.filename.c_str(), std::ios::binary);
+        ofs.write((const char*)&(*frame.encoded)[0], frame.encoded->size());
+    } else if (SAVE_BIN_) {
+        write_binary_frame(frame.filename, frame.image);
+    } else {
+        imwrite(frame.filename, frame.image);
+    }
+    ROS_DEBUG_STREAM("Image saved at " << frame.filename);
+    return true;
+
+}
+
+// Expects the converted, full resolution frame
+bool acquisition::Capture::stage_rois(Frame& frame) {
+
+    extract_rois(frame.cam, frame.image, frame.rois);
+    return true;
+
+}
+
+bool acquisition::Capture::stage_ae(Frame& frame) {
+
+    // Without a resize stage the convert stage orients
+    meter_frame(frame.cam, frame.image, frame.meta, !resize_stages_[frame.cam]);
+    return true;
+
+}
+
+bool acquisition::Capture::stage_wb(Frame& frame) {
+
+    observe_colors(frame.cam, frame.image);
+    return true;
+
+}
+
+// Holds short exposures back, only fused frames go on
+bool acquisition::Capture::stage_hdr(Frame& frame) {
+
+    int i = frame.cam;
+    if (!hdr_is_long(i, frame.meta)) {
+        hdr_short_[i] = frame.image;
+        return false;
     }
+    if (hdr_short_[i].empty() || hdr_short_[i].size() != frame.image.size() || hdr_short_[i].type() != frame.image.type())
+        return false;
+    frame.image = fuse_exposures(hdr_short_[i], frame.image);
+    hdr_short_[i] = Mat();
+    return true;
+
+}
+
+bool acquisition::Capture::stage_handoff(Frame& frame) {
+
+    hand_off(frame.cam, frame);
+    return true;
 
-    threads.create_thread(boost::bind(&Capture::acquire_images_to_queue, this, &image_queue_vector));
+}
+
+void acquisition::Capture::run_pipeline() {
+    ROS_INFO("*** ACQUISITION PIPELINED ***");
+
+    if (SAVE_ && !CAM_DIRS_CREATED_)
+        create_cam_directories();
+    ROS_WARN_COND(LIVE_, "Live view is not available in pipeline mode, add a 'handoff' stage to feed other consumers");
 
+    start_acquisition();
     for (int i=0; i<numCameras_; i++)
-        threads.create_thread(boost::bind(&Capture::write_queue_to_disk, this, &image_queue_vector.at(i), i));
+        pipelines_[i]->start();
+
+    ROS_INFO_STREAM("*** ACQUISITION STARTED ***");
+
+    if (EXPORT_TO_ROS_ && ASYNC_PUBLISH_)
+        publish_thread_ = boost::thread(&Capture::publish_loop, this);
+
+    int count = 0;
+    ros::Rate ros_rate(soft_framerate_);
+    vector<Frame> set(numCameras_);
+    try{
+        while( ros::ok() ) {
+
+            double t = ros::Time::now().toSec();
+
+            restore_cameras(false);
+            apply_commands(false);
+            apply_auto_exposure();
+            trigger_all();
+
+            mesg.header.stamp = trigger_stamp_.isZero() ? ros::Time::now() : trigger_stamp_;
+            mesg.time = ros::Time::now();
+            trigger_stamp_ = ros::Time();
+
+            // Only the grab happens here, the pipelines do the rest while
+            // the next set is being acquired
+            for (int i = 0; i < numCameras_; i++) {
+                set[i] = Frame();
+                fresh_[i] = due(i) && streaming(i);
+                if (!fresh_[i])
+                    continue;
+                set[i].cam = i;
+                set[i].raw = grab_watched(i);
+                if (!set[i].raw) {
+                    fresh_[i] = false;
+                    continue;
+                }
+                set[i].time_stamp = cams[i].get_time_stamp();
+                set[i].meta = cams[i].get_metadata();
+                set[i].stamp = mesg.header.stamp;
+                time_stamps_[i] = set[i].time_stamp;
+            }
+            resync_frame_ids();
+            measure_skew();
+            tick_++;
+
+            for (int i = 0; i < numCameras_; i++) {
+                if (!fresh_[i])
+                    continue;
+                set[i].frame_id = frame_id(i);
+                if (SAVE_) {
+                    ostringstream filename;
+                    filename << path_ << cam_names_[i] << "/"
+                             << (MASTER_TIMESTAMP_FOR_ALL_ ? time_stamps_[MASTER_CAM_] : time_stamps_[i])
+                             << (SAVE_BIN_ ? ".bin" : ext_);
+                    set[i].filename = filename.str();
+                    mesg.name.push_back(set[i].filename);
+                }
+                pipelines_[i]->push(set[i]);
+                set[i] = Frame();
+            }
+
+            acquisition_pub.publish(mesg);
+            mesg.name.clear();
+
+            if (memory_governor_)
+                memory_governor_->update();
+
+            toMat_time_ = ros::Time::now().toSec() - t;
+            achieved_time_ = ros::Time::now().toSec() - achieved_time_;
+            ROS_INFO_COND(TIME_BENCHMARK_, "grab (ms): %.1f \tActual FPS: %.1f", toMat_time_*1000, 1/achieved_time_);
+            achieved_time_ = ros::Time::now().toSec();
+
+            count++;
+            if (TIME_BENCHMARK_ && count % max(soft_framerate_, 1) == 0) {
+                for (int i = 0; i < numCameras_; i++)
+                    pipelines_[i]->log_stats();
+                log_sync_stats();
+            }
+
+            if (FIXED_NUM_FRAMES_ && count >= nframes_) {
+                ROS_INFO_STREAM(nframes_ << " frames acquired. Terminating...");
+                break;
+            }
+
+            if (SOFT_FRAME_RATE_CTRL_) {ros_rate.sleep();}
+        }
+    }
+    catch(const std::exception &e){
+        ROS_FATAL_STREAM("Exception: "<<e.what());
+    }
+    catch(...){
+        ROS_FATAL_STREAM("Some unknown exception occured. \v Exiting gracefully, \n  possible reason could be Camera Disconnection...");
+    }
+
+    // Drains what is already queued, recording stages don't drop
+    for (int i = 0; i < numCameras_; i++) {
+        pipelines_[i]->stop();
+        pipelines_[i]->log_stats();
+    }
 
-    ROS_DEBUG("Joining all threads");
-    threads.join_all();
-    ROS_DEBUG("All Threads Joined");
+    if (publish_thread_.joinable()) {
+        publish_thread_.interrupt();
+        publish_thread_.join();
+    }
 }
 
 void acquisition::Capture::run() {
-    if(!MAX_RATE_SAVE_)
-        run_soft_trig();
-    else
+    if(MAX_RATE_SAVE_)
         run_mt();
+    else if (PIPELINE_)
+        run_pipeline();
+    else
+        run_soft_trig();
 }
 
 std::string acquisition::Capture::todays_date()
@@ -1215,29 +3889,283 @@ std::string acquisition::Capture::todays_date()
 void acquisition::Capture::dynamicReconfigureCallback(provider_vision::spinnaker_camConfig &config, uint32_t level){
     
     ROS_INFO_STREAM("Dynamic Reconfigure: Level : " << level);
-    if(level == 1 || level ==3){
+
+    // First call when the server starts, the cameras are already set from the params
+    if (level == 0xFFFFFFFF)
+        return;
+
+    // Nothing is written from here, the acquisition loop applies it between frames
+    int cam = config.camera;
+    if (cam >= numCameras_) {
+        ROS_WARN_STREAM("No camera " << cam << ", " << numCameras_ << " cameras are acquiring");
+        return;
+    }
+
+    if (level & 1) {
         ROS_INFO_STREAM("Target grey value : " << config.target_grey_value);
-        for (int i = numCameras_-1 ; i >=0 ; i--) {
-            
-            cams[i].setEnumValue("AutoExposureTargetGreyValueAuto", "Off");
-            cams[i].setFloatValue("AutoExposureTargetGreyValue", config.target_grey_value);
-        }
+        CameraCommand mode(cam, CameraCommand::ENUM, "AutoExposureTargetGreyValueAuto");
+        mode.text = "Off";
+        queue_command(mode);
+        CameraCommand value(cam, CameraCommand::FLOAT, "AutoExposureTargetGreyValue");
+        value.value = config.target_grey_value;
+        queue_command(value);
     }
-    if (level == 2 || level ==3){
+    if (level & 2) {
         ROS_INFO_STREAM("Exposure "<<config.exposure_time);
-        if(config.exposure_time > 0){
-            for (int i = numCameras_-1 ; i >=0 ; i--) {
+        CameraCommand mode(cam, CameraCommand::ENUM, "ExposureMode");
+        mode.text = "Timed";
+        queue_command(mode);
+        CameraCommand automatic(cam, CameraCommand::ENUM, "ExposureAuto");
+        automatic.text = config.exposure_time > 0 ? "Off" : "Continuous";
+        queue_command(automatic);
+        if (config.exposure_time > 0) {
+            CameraCommand value(cam, CameraCommand::FLOAT, "ExposureTime");
+            value.value = config.exposure_time;
+            queue_command(value);
+        }
+    }
+    if (level & 4) {
+        ROS_INFO_STREAM("Frame rate " << config.fps);
+        CameraCommand enable(cam, CameraCommand::BOOL, "AcquisitionFrameRateEnable");
+        enable.value = 1;
+        queue_command(enable);
+        CameraCommand value(cam, CameraCommand::FLOAT, "AcquisitionFrameRate");
+        value.value = config.fps;
+        queue_command(value);
+    }
+    if (level & 8) {
+        ROS_INFO_STREAM("Gain " << config.gain);
+        CameraCommand automatic(cam, CameraCommand::ENUM, "GainAuto");
+        automatic.text = config.gain >= 0 ? "Off" : "Continuous";
+        queue_command(automatic);
+        if (config.gain >= 0) {
+            CameraCommand value(cam, CameraCommand::FLOAT, "Gain");
+            value.value = config.gain;
+            queue_command(value);
+        }
+    }
+    if (level & 16) {
+        ROS_INFO_STREAM("Pixel format " << config.pixel_format);
+        CameraCommand format(cam, CameraCommand::ENUM, "PixelFormat", true);
+        format.text = config.pixel_format;
+        queue_command(format);
+    }
+    if (level & 32) {
+        ROS_INFO_STREAM("Output size " << config.output_width << "x" << config.output_height);
+        CameraCommand size(cam, CameraCommand::OUTPUT_SIZE, "output_size");
+        size.width = config.output_width;
+        size.height = config.output_height;
+        queue_command(size);
+    }
+    if (level & 64) {
+        ROS_INFO_STREAM("Binning " << config.binning);
+        CameraCommand horizontal(cam, CameraCommand::INT, "BinningHorizontal", true);
+        horizontal.value = config.binning;
+        queue_command(horizontal);
+        CameraCommand vertical(cam, CameraCommand::INT, "BinningVertical", true);
+        vertical.value = config.binning;
+        queue_command(vertical);
+    }
+    if (level & 128) {
+        ROS_INFO_STREAM("Trigger mode " << config.trigger_mode);
+        CameraCommand trigger(cam, CameraCommand::TRIGGER, "trigger_mode", true);
+        trigger.text = config.trigger_mode;
+        queue_command(trigger);
+    }
+    if (level & 256) {
+        ROS_INFO_STREAM("Tone curve: gamma " << config.gamma << ", contrast " << config.contrast);
+        CameraCommand gamma(cam, CameraCommand::TONE_CURVE, "gamma");
+        gamma.value = config.gamma;
+        queue_command(gamma);
+        CameraCommand contrast(cam, CameraCommand::TONE_CURVE, "contrast");
+        contrast.value = config.contrast;
+        queue_command(contrast);
+    }
+}
 
-                cams[i].setEnumValue("ExposureAuto", "Off");
-                cams[i].setEnumValue("ExposureMode", "Timed");
-                cams[i].setFloatValue("ExposureTime", config.exposure_time);
-            }
+// A command for camera -1 goes to every camera
+void acquisition::Capture::queue_command(CameraCommand command) {
+
+    if (command.cam >= 0) {
+        command_queue_.push(command);
+        return;
+    }
+    for (int i = 0; i < numCameras_; i++) {
+        command.cam = i;
+        command_queue_.push(command);
+    }
+
+}
+
+// Called by the acquisition loop between two frame sets. Cameras with a
+// setting only writable while stopped, and only those, are stopped, set and
+// restarted. With rearm, a restarted camera gets the trigger it lost, the
+// others already had theirs (pipelined trigger).
+void acquisition::Capture::apply_commands(bool rearm) {
+
+    if (command_queue_.empty())
+        return;
+
+    vector<CameraCommand> commands = command_queue_.take();
+
+    // A stalled camera gets them when it is restored, the slaves paused
+    // with their master are still set up and take them now
+    for (int k = commands.size()-1; k >= 0; k--)
+        if (is_stalled(commands[k].cam)) {
+            ROS_WARN_STREAM("Camera " << cam_ids_[commands[k].cam] << " is stalled, " << commands[k].node << " applied once it is back");
+            remember_command(commands[k]);
+            commands.erase(commands.begin() + k);
         }
-        else if(config.exposure_time ==0){
-            for (int i = numCameras_-1 ; i >=0 ; i--) {
-                cams[i].setEnumValue("ExposureAuto", "Continuous");
-                cams[i].setEnumValue("ExposureMode", "Timed");
-            }
+
+    set<int> restart;
+    for (int k = 0; k < commands.size(); k++)
+        if (commands[k].restart)
+            restart.insert(commands[k].cam);
+
+    // A raw frame still queued would be read from, and released to, a
+    // stopped stream or freed buffers
+    for (set<int>::iterator it = restart.begin(); it != restart.end(); ++it) {
+        flush_pipeline(*it);
+        cams[*it].end_acquisition();
+    }
+
+    // What the grab timeout is based on
+    set<int> retime;
+    for (int k = 0; k < commands.size(); k++) {
+        try {
+            apply_command(commands[k]);
+            remember_command(commands[k]);
+        } catch (Spinnaker::Exception &e) {
+            ROS_ERROR_STREAM("Camera " << cam_ids_[commands[k].cam] << ": unable to set " << commands[k].node << ": " << e.what());
+        }
+        const string& node = commands[k].node;
+        if (commands[k].restart || node.compare(0, 11, "Acquisition") == 0 || node.compare(0, 8, "Exposure") == 0)
+            retime.insert(commands[k].cam);
+    }
+
+    set<int> stopped;
+    for (set<int>::iterator it = restart.begin(); it != restart.end(); ++it) {
+        // The sensor only mirrors non Bayer formats
+        apply_orientation(*it);
+        apply_tone_curve(*it);
+        // Format and binning change the payload, without buffers for it the
+        // watchdog takes the camera over
+        if (USER_BUFFERS_ && !reserve_user_buffers(*it))
+            stopped.insert(*it);
+    }
+    // and with it the readout the phases are staggered by
+    if (!restart.empty())
+        schedule_trigger_phases();
+
+    for (set<int>::iterator it = restart.begin(); it != restart.end(); ++it) {
+        if (stopped.count(*it))
+            continue;
+        cams[*it].begin_acquisition();
+        if (rearm && trigger_modes_[*it] == "software" && due(*it))
+            cams[*it].trigger();
+    }
+
+    // The strobed cameras run at the master's rate
+    if (retime.count(MASTER_CAM_))
+        for (int i = 0; i < numCameras_; i++)
+            if (trigger_modes_[i] == "hardware")
+                retime.insert(i);
+    for (set<int>::iterator it = retime.begin(); it != retime.end(); ++it) {
+        if (stopped.count(*it) || is_stalled(*it))
+            continue;
+        try {
+            set_grab_timeout(*it);
+        } catch (Spinnaker::Exception &e) {
+            ROS_WARN_STREAM("Camera " << cam_ids_[*it] << " keeps its grab timeout: " << e.what());
+        }
+    }
+
+    ROS_INFO("Applied %d camera settings between frames, %d camera(s) restarted", (int)commands.size(), (int)restart.size());
+
+}
+
+// Waits until the camera's pipeline converted or released every acquired
+// buffer it was given. Only the acquisition loop pushes, so none come in.
+void acquisition::Capture::flush_pipeline(int i) {
+
+    if (!PIPELINE_ || i >= pipelines_.size())
+        return;
+    pipelines_[i]->wait_raw_released();
+
+}
+
+void acquisition::Capture::apply_command(const CameraCommand& c) {
+
+    switch (c.kind) {
+    case CameraCommand::ENUM:
+        // A format the camera lacks would leave the conversion out of step
+        if (c.node == "PixelFormat" && !cams[c.cam].hasEnumEntry(c.node, c.text)) {
+            ROS_WARN_STREAM("Camera " << cam_ids_[c.cam] << " has no " << c.text << " format, kept as it was");
+            break;
         }
+        // Packed formats need the ADC bits first
+        if (c.node == "PixelFormat" && c.text.size() > 3 && c.text.compare(c.text.size()-3, 3, "12p") == 0)
+            cams[c.cam].adcBitDepth("Bit12");
+        else if (c.node == "PixelFormat" && c.text.size() > 3 && c.text.compare(c.text.size()-3, 3, "10p") == 0)
+            cams[c.cam].adcBitDepth("Bit10");
+        cams[c.cam].setEnumValue(c.node, c.text);
+        if (c.node == "PixelFormat") {
+            cams[c.cam].set_color(c.text.compare(0, 4, "Mono") != 0);
+            if (c.text == "BGR8" || c.text == "YCbCr422_8")
+                cams[c.cam].setISPEnable();
+        }
+        break;
+    case CameraCommand::FLOAT:
+        cams[c.cam].setFloatValue(c.node, c.value);
+        break;
+    case CameraCommand::INT:
+        cams[c.cam].setIntValue(c.node, c.value);
+        break;
+    case CameraCommand::BOOL:
+        cams[c.cam].setBoolValue(c.node, c.value != 0);
+        break;
+    case CameraCommand::OUTPUT_SIZE:
+        cams[c.cam].set_output_size(c.width, c.height);
+        break;
+    case CameraCommand::TRIGGER:
+        set_trigger_mode(c.cam, c.text);
+        break;
+    case CameraCommand::TONE_CURVE:
+        if (c.node == "gamma")
+            tone_curves_[c.cam].gamma = c.value;
+        else
+            tone_curves_[c.cam].contrast = c.value;
+        apply_tone_curve(c.cam);
+        break;
+    }
+
+}
+
+// Kept for restore_cameras(), latest write per node, like the queue
+void acquisition::Capture::remember_command(const CameraCommand& c) {
+
+    vector<CameraCommand>& applied = runtime_commands_[c.cam];
+    for (int k = applied.size()-1; k >= 0; k--)
+        if (applied[k].node == c.node)
+            applied.erase(applied.begin() + k);
+    applied.push_back(c);
+
+}
+
+void acquisition::Capture::set_trigger_mode(int cam, string mode) {
+
+    // Selector and source are only writable with the trigger off
+    cams[cam].setEnumValue("TriggerMode", "Off");
+    if (mode == "software") {
+        cams[cam].setEnumValue("TriggerSelector", "FrameStart");
+        cams[cam].setEnumValue("TriggerSource", "Software");
+        cams[cam].setEnumValue("TriggerMode", "On");
+    } else if (mode == "hardware") {
+        cams[cam].setEnumValue("TriggerSelector", "FrameStart");
+        cams[cam].setEnumValue("TriggerSource", "Line3");
+        cams[cam].setEnumValue("TriggerActivation", "RisingEdge");
+        cams[cam].setEnumValue("TriggerMode", "On");
     }
-}
\ No newline at end of file
+    trigger_modes_[cam] = mode;
+
+}
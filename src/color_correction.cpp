@@ -0,0 +1,73 @@
+#include "spinnaker_sdk_camera_driver/color_correction.h"
+
+acquisition::ColorCorrection::ColorCorrection(const ColorCorrectionSettings& settings) {
+
+    settings_ = settings;
+    for (int c = 0; c < 3; c++)
+        gains_[c] = settings.gains[c];
+    frames_ = 0;
+
+}
+
+bool acquisition::ColorCorrection::observe(const Mat& frame) {
+
+    if (!settings_.gray_world || frame.type() != CV_8UC3)
+        return false;
+    if (frames_++ % max(settings_.every, 1))
+        return false;
+
+    // Clipped pixels lost their color, black ones never had any
+    uint64_t sums[3] = {0, 0, 0};
+    uint64_t count = 0;
+    int step = max(settings_.stride, 1);
+    for (int y = step/2; y < frame.rows; y += step) {
+        const uchar* row = frame.ptr(y);
+        for (int x = step/2; x < frame.cols; x += step) {
+            const uchar* p = row + 3*x;
+            uchar high = max(p[0], max(p[1], p[2]));
+            if (high >= 250 || high < 8)
+                continue;
+            sums[0] += p[0];
+            sums[1] += p[1];
+            sums[2] += p[2];
+            count++;
+        }
+    }
+    if (count < 64)
+        return false;
+
+    // The frame is not corrected yet: the gains that would make it grey are
+    // known outright, green keeps the brightness
+    bool moved = false;
+    for (int c = 0; c < 3; c++) {
+        double target = max((double)sums[1], 1.0)/max((double)sums[c], 1.0);
+        double error = log2(target*gains_[1]/gains_[c]);
+        // Within ~2%, moving would only make it hunt
+        if (fabs(error) < 0.03)
+            continue;
+        gains_[c] *= pow(2, settings_.speed*min(max(error, -1.0), 1.0));
+        moved = true;
+    }
+    if (!moved)
+        return false;
+
+    // Green keeps the brightness, the others follow it
+    double g = gains_[1];
+    for (int c = 0; c < 3; c++)
+        gains_[c] = min(max(gains_[c]/g, 1/settings_.max_gain), settings_.max_gain);
+    return true;
+
+}
+
+vector<short> acquisition::ColorCorrection::matrix() const {
+
+    // The matrix is given in RGB, the frames are BGR: both axes reversed
+    vector<short> m(9);
+    for (int out = 0; out < 3; out++)
+        for (int in = 0; in < 3; in++) {
+            double v = settings_.matrix[3*(2 - out) + (2 - in)]*gains_[in];
+            m[3*out + in] = (short)min(max(cvRound(v*4096), -32767), 32767);
+        }
+    return m;
+
+}
@@ -0,0 +1,32 @@
+#include "spinnaker_sdk_camera_driver/demosaic_tuner.h"
+
+// Times the host demosaicing algorithms and stores the pick for this host,
+// what 'demosaic: auto' does at startup, without the cameras:
+//   rosrun provider_vision demosaic_bench_node _width:=1920 _height:=1200 _fps:=10 _cameras:=2
+int main(int argc, char** argv) {
+
+    ros::init(argc, argv, "demosaic_bench_node");
+    ros::NodeHandle nh_pvt("~");
+
+    int width = 1920, height = 1200, cameras = 1;
+    double fps = 10, budget = 0.5;
+    string cache = "~/.ros/demosaic_timings.yml";
+    nh_pvt.getParam("width", width);
+    nh_pvt.getParam("height", height);
+    nh_pvt.getParam("cameras", cameras);
+    nh_pvt.getParam("fps", fps);
+    nh_pvt.getParam("demosaic_cpu_budget", budget);
+    nh_pvt.getParam("demosaic_cache", cache);
+
+    // The whole machine, the driver isn't running
+    double cores = max((int)boost::thread::hardware_concurrency(), 1);
+
+    acquisition::DemosaicTuner tuner(cache);
+    for (int i = 0; i < cameras; i++)
+        tuner.add(width, height, fps);
+    tuner.tune(budget*cores, true);
+    tuner.log();
+
+    return 0;
+
+}
@@ -0,0 +1,179 @@
+#include "spinnaker_sdk_camera_driver/demosaic_tuner.h"
+
+acquisition::DemosaicTuner::DemosaicTuner(string cache_path) {
+
+    path_ = cache_path;
+    if (!path_.empty() && path_[0] == '~') {
+        const char* home = getenv("HOME");
+        if (home == NULL) {
+            // No passwd entry either, e.g. an arbitrary uid in a container
+            struct passwd* pw = getpwuid(getuid());
+            if (pw != NULL)
+                home = pw->pw_dir;
+        }
+        if (home != NULL) {
+            path_.replace(0, 1, home);
+        } else {
+            ROS_WARN_STREAM("No home directory for " << cache_path << ", the demosaic timings are not cached");
+            path_.clear();
+        }
+    }
+
+    char name[256] = {0};
+    gethostname(name, sizeof(name) - 1);
+    host_ = name;
+    cores_ = 0;
+
+    load();
+
+}
+
+void acquisition::DemosaicTuner::add(int width, int height, double fps) {
+
+    Demand d;
+    d.width = width;
+    d.height = height;
+    d.fps = fps;
+    demands_.push_back(d);
+
+}
+
+acquisition::DemosaicTuner::Timings& acquisition::DemosaicTuner::timings(int width, int height, bool retune) {
+
+    ostringstream key;
+    key << width << "x" << height;
+    Timings& t = cache_[host_][key.str()];
+
+    vector<DemosaicAlgorithm> algorithms = Camera::demosaic_algorithms();
+    for (int k = 0; k < algorithms.size(); k++) {
+        if (t.count(algorithms[k].name) && !retune)
+            continue;
+        t[algorithms[k].name] = Camera::benchmark_demosaic(width, height, algorithms[k]);
+        ROS_DEBUG("Demosaic %s at %dx%d: %.1f ms/frame", algorithms[k].name.c_str(), width, height,
+                  t[algorithms[k].name]*1000);
+    }
+    return t;
+
+}
+
+double acquisition::DemosaicTuner::cost(const string& algorithm) {
+
+    double cores = 0;
+    for (int i = 0; i < demands_.size(); i++)
+        cores += timings(demands_[i].width, demands_[i].height, false)[algorithm]*demands_[i].fps;
+    return cores;
+
+}
+
+string acquisition::DemosaicTuner::tune(double cores, bool retune) {
+
+    cores_ = cores;
+    if (retune)
+        for (int i = 0; i < demands_.size(); i++)
+            timings(demands_[i].width, demands_[i].height, true);
+
+    // The list is best quality first
+    vector<DemosaicAlgorithm> algorithms = Camera::demosaic_algorithms();
+    string cheapest;
+    choice_.clear();
+    for (int k = 0; k < algorithms.size() && choice_.empty(); k++) {
+        double need = cost(algorithms[k].name);
+        if (need <= cores)
+            choice_ = algorithms[k].name;
+        else if (cheapest.empty() || need < cost(cheapest))
+            cheapest = algorithms[k].name;
+    }
+    if (choice_.empty()) {
+        ROS_WARN("No demosaicing algorithm fits %.2f cores, using the cheapest one, %s", cores, cheapest.c_str());
+        choice_ = cheapest;
+    }
+
+    if (choices_[host_] != choice_) {
+        if (!choices_[host_].empty())
+            ROS_INFO_STREAM("Demosaicing on " << host_ << " changes from " << choices_[host_] << " to " << choice_);
+        choices_[host_] = choice_;
+    }
+    save();
+    return choice_;
+
+}
+
+void acquisition::DemosaicTuner::log() {
+
+    if (demands_.empty())
+        return;
+
+    const Demand& d = demands_[0];
+    ROS_INFO("Host demosaicing on %s, %d camera(s), budget %.2f cores:", host_.c_str(), (int)demands_.size(), cores_);
+    vector<DemosaicAlgorithm> algorithms = Camera::demosaic_algorithms();
+    for (int k = 0; k < algorithms.size(); k++) {
+        string name = algorithms[k].name;
+        ROS_INFO("  %-22s %7.1f ms/frame at %dx%d, %5.2f cores%s", name.c_str(),
+                 timings(d.width, d.height, false)[name]*1000, d.width, d.height, cost(name),
+                 name == choice_ ? "  <- picked" : "");
+    }
+
+}
+
+// hosts:
+//   - { host: auv8, choice: hq_linear, sizes: [ { width: 1920, height: 1200, rigorous: 0.41, ... } ] }
+void acquisition::DemosaicTuner::load() {
+
+    if (path_.empty())
+        return;
+    try {
+        FileStorage fs(path_, FileStorage::READ);
+        if (!fs.isOpened())
+            return;
+        vector<DemosaicAlgorithm> algorithms = Camera::demosaic_algorithms();
+        FileNode hosts = fs["hosts"];
+        for (FileNodeIterator h = hosts.begin(); h != hosts.end(); ++h) {
+            string host = (string)(*h)["host"];
+            choices_[host] = (string)(*h)["choice"];
+            FileNode sizes = (*h)["sizes"];
+            for (FileNodeIterator s = sizes.begin(); s != sizes.end(); ++s) {
+                ostringstream key;
+                key << (int)(*s)["width"] << "x" << (int)(*s)["height"];
+                Timings& t = cache_[host][key.str()];
+                for (int k = 0; k < algorithms.size(); k++)
+                    if (!(*s)[algorithms[k].name].empty())
+                        t[algorithms[k].name] = (double)(*s)[algorithms[k].name];
+            }
+        }
+    } catch (cv::Exception &e) {
+        ROS_WARN_STREAM("Unable to read the demosaic timings in " << path_ << ", timing again: " << e.what());
+        cache_.clear();
+        choices_.clear();
+    }
+
+}
+
+void acquisition::DemosaicTuner::save() {
+
+    if (path_.empty())
+        return;
+    try {
+        FileStorage fs(path_, FileStorage::WRITE);
+        if (!fs.isOpened()) {
+            ROS_WARN_STREAM("Unable to write the demosaic timings to " << path_ << ", they will be timed again next start");
+            return;
+        }
+        fs << "hosts" << "[";
+        for (map<string, map<string, Timings> >::iterator h = cache_.begin(); h != cache_.end(); ++h) {
+            fs << "{" << "host" << h->first << "choice" << choices_[h->first] << "sizes" << "[";
+            for (map<string, Timings>::iterator s = h->second.begin(); s != h->second.end(); ++s) {
+                int width = 0, height = 0;
+                sscanf(s->first.c_str(), "%dx%d", &width, &height);
+                fs << "{" << "width" << width << "height" << height;
+                for (Timings::iterator t = s->second.begin(); t != s->second.end(); ++t)
+                    fs << t->first << t->second;
+                fs << "}";
+            }
+            fs << "]" << "}";
+        }
+        fs << "]";
+    } catch (cv::Exception &e) {
+        ROS_WARN_STREAM("Unable to write the demosaic timings to " << path_ << ": " << e.what());
+    }
+
+}
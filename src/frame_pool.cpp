@@ -0,0 +1,267 @@
+#include "spinnaker_sdk_camera_driver/frame_pool.h"
+
+#include <sys/mman.h>
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+
+// Alignment used for blocks smaller than a page, one cache line
+#define FRAME_POOL_LINE_ALIGN 64
+
+acquisition::FramePool::FramePool(bool use_hugepages, size_t max_resident_mb) {
+
+    USE_HUGEPAGES_ = use_hugepages;
+    max_resident_bytes_ = max_resident_mb*1024*1024;
+    memset(&stats_, 0, sizeof(stats_));
+
+}
+
+acquisition::FramePool::~FramePool() {
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (!used_blocks_.empty())
+        ROS_WARN_STREAM("Frame pool destroyed with " << used_blocks_.size() << " buffers still in use!");
+
+    for (map<PoolKey, vector<Block> >::iterator it = free_blocks_.begin(); it != free_blocks_.end(); ++it)
+        for (int i=0; i<it->second.size(); i++)
+            release_block(it->second[i]);
+    free_blocks_.clear();
+
+}
+
+UMatData* acquisition::FramePool::allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                                           MatAccessFlag flags, UMatUsageFlags usageFlags) const {
+
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims-1; i >= 0; i--) {
+        if (step) {
+            if (data0 && step[i] != CV_AUTOSTEP) {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            } else
+                step[i] = total;
+        }
+        total *= sizes[i];
+    }
+
+    UMatData* u = new UMatData(this);
+    u->size = total;
+
+    if (data0) {
+        // Wrapping foreign memory (e.g. a Spinnaker buffer), nothing to pool
+        u->data = u->origdata = (uchar*)data0;
+        u->flags |= UMatData::USER_ALLOCATED;
+        return u;
+    }
+
+    Block block = take_block(total, type);
+    u->data = u->origdata = (uchar*)block.ptr;
+
+    return u;
+
+}
+
+bool acquisition::FramePool::allocate(UMatData* u, MatAccessFlag accessflags, UMatUsageFlags usageFlags) const {
+
+    return u != NULL;
+
+}
+
+void acquisition::FramePool::deallocate(UMatData* u) const {
+
+    if (!u)
+        return;
+
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+
+    if (!(u->flags & UMatData::USER_ALLOCATED)) {
+
+        boost::mutex::scoped_lock lock(mutex_);
+
+        map<void*, pair<PoolKey, Block> >::iterator it = used_blocks_.find(u->origdata);
+        CV_Assert(it != used_blocks_.end());
+
+        PoolKey key = it->second.first;
+        Block block = it->second.second;
+        used_blocks_.erase(it);
+        stats_.in_use_bytes -= block.size;
+
+        if (max_resident_bytes_ > 0 && stats_.resident_bytes > max_resident_bytes_) {
+            // Over the configured working set, give the memory back
+            release_block(block);
+            stats_.resident_bytes -= block.size;
+            if (block.huge)
+                stats_.huge_bytes -= block.size;
+            stats_.dropped++;
+        } else {
+            free_blocks_[key].push_back(block);
+            stats_.returned++;
+        }
+        u->origdata = 0;
+    }
+
+    delete u;
+
+}
+
+acquisition::FramePool::Block acquisition::FramePool::take_block(size_t size, int type) const {
+
+    PoolKey key(size, type);
+
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        map<PoolKey, vector<Block> >::iterator it = free_blocks_.find(key);
+        if (it != free_blocks_.end() && !it->second.empty()) {
+            Block block = it->second.back();
+            it->second.pop_back();
+            used_blocks_[block.ptr] = make_pair(key, block);
+            stats_.hits++;
+            stats_.in_use_bytes += block.size;
+            return block;
+        }
+    }
+
+    // Miss, map a fresh block outside of the lock
+    Block block;
+    block.size = size;
+    block.ptr = map_block(size, USE_HUGEPAGES_, &block.huge);
+    if (block.huge)
+        block.size = (size + hugepage_size() - 1) / hugepage_size() * hugepage_size();
+    if (!block.ptr)
+        CV_Error(Error::StsNoMem, "Frame pool could not allocate buffer");
+
+    boost::mutex::scoped_lock lock(mutex_);
+    used_blocks_[block.ptr] = make_pair(key, block);
+    stats_.misses++;
+    stats_.resident_bytes += block.size;
+    stats_.in_use_bytes += block.size;
+    if (block.huge)
+        stats_.huge_bytes += block.size;
+
+    return block;
+
+}
+
+void acquisition::FramePool::release_block(const Block& block) const {
+
+    unmap_block(block.ptr, block.size, block.huge);
+
+}
+
+acquisition::FramePoolStats acquisition::FramePool::stats() const {
+
+    boost::mutex::scoped_lock lock(mutex_);
+    return stats_;
+
+}
+
+size_t acquisition::FramePool::trim(size_t bytes_to_free) {
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    size_t freed = 0;
+    for (map<PoolKey, vector<Block> >::iterator it = free_blocks_.begin();
+         it != free_blocks_.end() && freed < bytes_to_free; ++it) {
+        while (!it->second.empty() && freed < bytes_to_free) {
+            Block block = it->second.back();
+            it->second.pop_back();
+            release_block(block);
+            stats_.resident_bytes -= block.size;
+            if (block.huge)
+                stats_.huge_bytes -= block.size;
+            stats_.dropped++;
+            freed += block.size;
+        }
+    }
+
+    return freed;
+
+}
+
+void acquisition::FramePool::log_stats(string name) const {
+
+    FramePoolStats s = stats();
+    uint64_t requests = s.hits + s.misses;
+    ROS_INFO("Frame pool %s:- hits: %lu, misses: %lu (%.1f%% hit), resident: %.1f MB (%.1f MB hugepages), in use: %.1f MB",
+             name.c_str(), (unsigned long)s.hits, (unsigned long)s.misses,
+             requests ? 100.0*s.hits/requests : 0.0,
+             s.resident_bytes/1048576.0, s.huge_bytes/1048576.0, s.in_use_bytes/1048576.0);
+
+}
+
+void* acquisition::FramePool::map_block(size_t size, bool use_hugepages, bool* is_huge) {
+
+    *is_huge = false;
+    void* ptr = NULL;
+
+    if (size < page_size()) {
+        if (posix_memalign(&ptr, FRAME_POOL_LINE_ALIGN, size) != 0)
+            return NULL;
+        return ptr;
+    }
+
+    if (use_hugepages) {
+        size_t huge = hugepage_size();
+        size_t rounded = (size + huge - 1) / huge * huge;
+        ptr = mmap(NULL, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            *is_huge = true;
+            return ptr;
+        }
+        // No reserved hugepages, fall back on transparent hugepages
+        ROS_DEBUG_STREAM("MAP_HUGETLB failed for " << rounded << " bytes, using transparent hugepages");
+        ptr = NULL;
+        if (posix_memalign(&ptr, huge, size) != 0)
+            return NULL;
+        madvise(ptr, size, MADV_HUGEPAGE);
+        return ptr;
+    }
+
+    if (posix_memalign(&ptr, page_size(), size) != 0)
+        return NULL;
+    return ptr;
+
+}
+
+void acquisition::FramePool::unmap_block(void* ptr, size_t size, bool is_huge) {
+
+    if (is_huge)
+        munmap(ptr, size);
+    else
+        free(ptr);
+
+}
+
+size_t acquisition::FramePool::page_size() {
+
+    static size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+
+}
+
+// Read once, the first caller initializes it (C++11 static, thread safe)
+static size_t read_hugepage_size() {
+
+    std::string token;
+    std::ifstream file("/proc/meminfo");
+    size_t kb = 0;
+    while (file >> token) {
+        if (token == "Hugepagesize:") {
+            file >> kb;
+            break;
+        }
+        file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    return kb ? kb*1024 : 2*1024*1024;
+
+}
+
+size_t acquisition::FramePool::hugepage_size() {
+
+    static const size_t size = read_hugepage_size();
+    return size;
+
+}
@@ -0,0 +1,1030 @@
+#include "spinnaker_sdk_camera_driver/kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define KERNELS_NEON
+#endif
+
+namespace {
+
+    void unpack12p_scalar(const uchar* src, ushort* dst, size_t pixels) {
+
+        for (size_t i = 0; i + 1 < pixels; i += 2, src += 3) {
+            dst[i] = (src[0] << 4) | ((src[1] & 0x0F) << 12);
+            dst[i+1] = (src[1] & 0xF0) | (src[2] << 8);
+        }
+        if (pixels & 1)
+            dst[pixels-1] = (src[0] << 4) | ((src[1] & 0x0F) << 12);
+
+    }
+
+    void unpack10p_scalar(const uchar* src, ushort* dst, size_t pixels) {
+
+        size_t i = 0;
+        for (; i + 3 < pixels; i += 4, src += 5) {
+            dst[i] = (src[0] | (src[1] & 0x03) << 8) << 6;
+            dst[i+1] = (src[1] >> 2 | (src[2] & 0x0F) << 6) << 6;
+            dst[i+2] = (src[2] >> 4 | (src[3] & 0x3F) << 4) << 6;
+            dst[i+3] = (src[3] >> 6 | src[4] << 2) << 6;
+        }
+        // Whatever is left of the last group, bit by bit
+        for (int bit = 0; i < pixels; i++, bit += 10) {
+            int byte = bit >> 3, shift = bit & 7;
+            dst[i] = (((src[byte] | src[byte+1] << 8) >> shift) & 0x3FF) << 6;
+        }
+
+    }
+
+    // Weight of the long exposure in 1/256, the same integer steps in every version
+    void fuse_exposures_scalar(const uchar* s, const uchar* l, uchar* dst, size_t bytes, int knee) {
+
+        int range = 255 - knee;
+        int slope = 4096/range;
+        for (size_t i = 0; i < bytes; i++) {
+            int a = min((min(255 - l[i], range)*slope) >> 4, 256);
+            dst[i] = (l[i]*a + s[i]*(256 - a) + 128) >> 8;
+        }
+
+    }
+
+    void apply_lut8_scalar(const uchar* src, uchar* dst, size_t bytes, const uchar* lut) {
+
+        size_t i = 0;
+        for (; i + 4 <= bytes; i += 4) {
+            uchar a = lut[src[i]], b = lut[src[i+1]], c = lut[src[i+2]], d = lut[src[i+3]];
+            dst[i] = a;
+            dst[i+1] = b;
+            dst[i+2] = c;
+            dst[i+3] = d;
+        }
+        for (; i < bytes; i++)
+            dst[i] = lut[src[i]];
+
+    }
+
+    // Cr and Cb are scaled by 4 and multiplied by Q13 coefficients with a
+    // rounding >> 15, exactly what pmulhrsw and vqrdmulh do, so every version
+    // gives the same bytes
+    const int YUV_R_CR = 11485;     // 1.402
+    const int YUV_G_CB = 2819;      // 0.344136
+    const int YUV_G_CR = 5850;      // 0.714136
+    const int YUV_B_CB = 14516;     // 1.772
+
+    inline int mulhrs(int a, int b) { return (a*b + 16384) >> 15; }
+    inline uchar clamp_u8(int v) { return v < 0 ? 0 : v > 255 ? 255 : v; }
+
+    void yuv422_to_bgr_scalar(const uchar* src, uchar* dst, size_t pixels) {
+
+        for (size_t i = 0; i < pixels; i += 2, src += 4) {
+            int cb = (src[1] - 128)*4, cr = (src[3] - 128)*4;
+            int r = mulhrs(cr, YUV_R_CR);
+            int g = mulhrs(cb, YUV_G_CB) + mulhrs(cr, YUV_G_CR);
+            int b = mulhrs(cb, YUV_B_CB);
+            for (size_t k = 0; k < 2 && i + k < pixels; k++, dst += 3) {
+                int y = src[2*k];
+                dst[0] = clamp_u8(y + b);
+                dst[1] = clamp_u8(y - g);
+                dst[2] = clamp_u8(y + r);
+            }
+        }
+
+    }
+
+    // The pixel is scaled by 128 and every product rounded by >> 15 to 1/16
+    // of a level (pmulhrsw, vqrdmulh), the 16 bit sums saturate like theirs
+    inline int sat16(int v) { return v < -32768 ? -32768 : v > 32767 ? 32767 : v; }
+
+    void color_matrix_scalar(const uchar* src, uchar* dst, size_t pixels, const short* m) {
+
+        for (size_t i = 0; i < pixels; i++, src += 3, dst += 3) {
+            int v[3] = {src[0]*128, src[1]*128, src[2]*128};
+            uchar out[3];
+            for (int c = 0; c < 3; c++) {
+                int s = sat16(sat16(mulhrs(v[0], m[3*c]) + mulhrs(v[1], m[3*c+1])) + mulhrs(v[2], m[3*c+2]));
+                out[c] = clamp_u8(sat16(s + 8) >> 4);
+            }
+            dst[0] = out[0];
+            dst[1] = out[1];
+            dst[2] = out[2];
+        }
+
+    }
+
+    void histogram16_scalar(const uchar* src, size_t bytes, uint32_t* hist, uint64_t& sum) {
+
+        for (size_t i = 0; i < bytes; i++) {
+            hist[src[i] >> 4]++;
+            sum += src[i];
+        }
+
+    }
+
+    // The byte counters of the SIMD histograms hold up to 255, flushed before
+    #define KERNELS_HIST_FLUSH 128
+
+#if defined(__SSE2__)
+    // One byte counter per bin and lane: a compare per bin, then subtracting
+    // the all-ones match counts it. SAD against zero sums the counters.
+    void histogram16_sse2(const uchar* src, size_t bytes, uint32_t* hist, uint64_t& sum) {
+
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+        __m128i acc[16];
+        for (int b = 0; b < 16; b++)
+            acc[b] = zero;
+        __m128i total = zero;
+
+        size_t i = 0;
+        int pending = 0;
+        for (; i + 16 <= bytes; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+            total = _mm_add_epi64(total, _mm_sad_epu8(v, zero));
+            __m128i bins = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+            for (int b = 0; b < 16; b++)
+                acc[b] = _mm_sub_epi8(acc[b], _mm_cmpeq_epi8(bins, _mm_set1_epi8(b)));
+            if (++pending == KERNELS_HIST_FLUSH || i + 32 > bytes) {
+                for (int b = 0; b < 16; b++) {
+                    __m128i s = _mm_sad_epu8(acc[b], zero);
+                    hist[b] += _mm_cvtsi128_si32(s) + _mm_cvtsi128_si32(_mm_srli_si128(s, 8));
+                    acc[b] = zero;
+                }
+                pending = 0;
+            }
+        }
+        sum += _mm_cvtsi128_si32(total) + (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(total, 8));
+        histogram16_scalar(src + i, bytes - i, hist, sum);
+
+    }
+#endif
+
+#if defined(__SSE2__)
+    // Baseline on x86_64, no runtime check needed. 16 bytes per step, widened
+    // to 16 bit lanes where no product can overflow.
+    void fuse_exposures_sse2(const uchar* s, const uchar* l, uchar* dst, size_t bytes, int knee) {
+
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ones = _mm_set1_epi8(-1);
+        const __m128i range = _mm_set1_epi8((char)(255 - knee));
+        const __m128i slope = _mm_set1_epi16(4096/(255 - knee));
+        const __m128i full = _mm_set1_epi16(256);
+        const __m128i half = _mm_set1_epi16(128);
+
+        size_t i = 0;
+        for (; i + 16 <= bytes; i += 16) {
+            __m128i vs = _mm_loadu_si128((const __m128i*)(s + i));
+            __m128i vl = _mm_loadu_si128((const __m128i*)(l + i));
+            // Headroom of the long exposure before it clips, capped at the blend range
+            __m128i d = _mm_min_epu8(_mm_sub_epi8(ones, vl), range);
+
+            __m128i out[2];
+            for (int h = 0; h < 2; h++) {
+                __m128i d16 = h ? _mm_unpackhi_epi8(d, zero) : _mm_unpacklo_epi8(d, zero);
+                __m128i l16 = h ? _mm_unpackhi_epi8(vl, zero) : _mm_unpacklo_epi8(vl, zero);
+                __m128i s16 = h ? _mm_unpackhi_epi8(vs, zero) : _mm_unpacklo_epi8(vs, zero);
+                __m128i a = _mm_min_epi16(_mm_srli_epi16(_mm_mullo_epi16(d16, slope), 4), full);
+                __m128i sum = _mm_add_epi16(_mm_mullo_epi16(l16, a), _mm_mullo_epi16(s16, _mm_sub_epi16(full, a)));
+                out[h] = _mm_srli_epi16(_mm_add_epi16(sum, half), 8);
+            }
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(out[0], out[1]));
+        }
+        fuse_exposures_scalar(s + i, l + i, dst + i, bytes - i, knee);
+
+    }
+#endif
+
+#ifdef KERNELS_X86
+
+    // The SSE2 steps on 32 byte vectors. Unpacks and packs stay within
+    // their 128 bit lane, so the bytes come back in order.
+    __attribute__((target("avx2")))
+    void fuse_exposures_avx2(const uchar* s, const uchar* l, uchar* dst, size_t bytes, int knee) {
+
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ones = _mm256_set1_epi8(-1);
+        const __m256i range = _mm256_set1_epi8((char)(255 - knee));
+        const __m256i slope = _mm256_set1_epi16(4096/(255 - knee));
+        const __m256i full = _mm256_set1_epi16(256);
+        const __m256i half = _mm256_set1_epi16(128);
+
+        size_t i = 0;
+        for (; i + 32 <= bytes; i += 32) {
+            __m256i vs = _mm256_loadu_si256((const __m256i*)(s + i));
+            __m256i vl = _mm256_loadu_si256((const __m256i*)(l + i));
+            __m256i d = _mm256_min_epu8(_mm256_sub_epi8(ones, vl), range);
+
+            __m256i out[2];
+            for (int h = 0; h < 2; h++) {
+                __m256i d16 = h ? _mm256_unpackhi_epi8(d, zero) : _mm256_unpacklo_epi8(d, zero);
+                __m256i l16 = h ? _mm256_unpackhi_epi8(vl, zero) : _mm256_unpacklo_epi8(vl, zero);
+                __m256i s16 = h ? _mm256_unpackhi_epi8(vs, zero) : _mm256_unpacklo_epi8(vs, zero);
+                __m256i a = _mm256_min_epi16(_mm256_srli_epi16(_mm256_mullo_epi16(d16, slope), 4), full);
+                __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(l16, a), _mm256_mullo_epi16(s16, _mm256_sub_epi16(full, a)));
+                out[h] = _mm256_srli_epi16(_mm256_add_epi16(sum, half), 8);
+            }
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(out[0], out[1]));
+        }
+        fuse_exposures_scalar(s + i, l + i, dst + i, bytes - i, knee);
+
+    }
+
+    // Sum of the four 64 bit lanes of a SAD, each well below 2^32
+    __attribute__((target("avx2")))
+    uint64_t sum_sad(__m256i s) {
+
+        __m128i h = _mm_add_epi64(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+        return (uint32_t)_mm_cvtsi128_si32(h) + (uint64_t)(uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(h, 8));
+
+    }
+
+    __attribute__((target("avx2")))
+    void histogram16_avx2(const uchar* src, size_t bytes, uint32_t* hist, uint64_t& sum) {
+
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        __m256i acc[16];
+        for (int b = 0; b < 16; b++)
+            acc[b] = zero;
+
+        size_t i = 0;
+        int pending = 0;
+        for (; i + 32 <= bytes; i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+            sum += sum_sad(_mm256_sad_epu8(v, zero));
+            __m256i bins = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+            for (int b = 0; b < 16; b++)
+                acc[b] = _mm256_sub_epi8(acc[b], _mm256_cmpeq_epi8(bins, _mm256_set1_epi8(b)));
+            if (++pending == KERNELS_HIST_FLUSH || i + 64 > bytes) {
+                for (int b = 0; b < 16; b++) {
+                    hist[b] += sum_sad(_mm256_sad_epu8(acc[b], zero));
+                    acc[b] = zero;
+                }
+                pending = 0;
+            }
+        }
+        histogram16_scalar(src + i, bytes - i, hist, sum);
+
+    }
+
+    // 16 pixels (48 bytes) per step: shuffles split the planes, each output
+    // plane is three pmulhrsw summed in 16 bit lanes, shuffles interleave
+    // them again. Both sides are in registers, so src may be dst.
+    __attribute__((target("ssse3")))
+    void color_matrix_ssse3(const uchar* src, uchar* dst, size_t pixels, const short* m) {
+
+        static const signed char split[3][3][16] = {
+            {{0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+             {-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1},
+             {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13}},
+            {{1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+             {-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1},
+             {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14}},
+            {{2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+             {-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1},
+             {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15}}};
+        static const signed char merge[3][3][16] = {
+            {{0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5},
+             {-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1},
+             {-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1}},
+            {{-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1},
+             {5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10},
+             {-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1}},
+            {{-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1},
+             {-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1},
+             {10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15}}};
+
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(8);
+        __m128i coef[9];
+        for (int k = 0; k < 9; k++)
+            coef[k] = _mm_set1_epi16(m[k]);
+
+        size_t i = 0;
+        for (; i + 16 <= pixels; i += 16, src += 48, dst += 48) {
+            __m128i in[3], planes[3], out[3];
+            for (int k = 0; k < 3; k++)
+                in[k] = _mm_loadu_si128((const __m128i*)(src + 16*k));
+            for (int c = 0; c < 3; c++) {
+                planes[c] = _mm_setzero_si128();
+                for (int k = 0; k < 3; k++)
+                    planes[c] = _mm_or_si128(planes[c], _mm_shuffle_epi8(in[k], _mm_loadu_si128((const __m128i*)split[c][k])));
+            }
+            for (int c = 0; c < 3; c++) {
+                __m128i half[2];
+                for (int h = 0; h < 2; h++) {
+                    __m128i s = zero;
+                    for (int k = 0; k < 3; k++) {
+                        __m128i v = h ? _mm_unpackhi_epi8(planes[k], zero) : _mm_unpacklo_epi8(planes[k], zero);
+                        s = _mm_adds_epi16(s, _mm_mulhrs_epi16(_mm_slli_epi16(v, 7), coef[3*c + k]));
+                    }
+                    half[h] = _mm_srai_epi16(_mm_adds_epi16(s, round), 4);
+                }
+                out[c] = _mm_packus_epi16(half[0], half[1]);
+            }
+            for (int k = 0; k < 3; k++) {
+                __m128i v = _mm_setzero_si128();
+                for (int c = 0; c < 3; c++)
+                    v = _mm_or_si128(v, _mm_shuffle_epi8(out[c], _mm_loadu_si128((const __m128i*)merge[k][c])));
+                _mm_storeu_si128((__m128i*)(dst + 16*k), v);
+            }
+        }
+        color_matrix_scalar(src, dst, pixels - i, m);
+
+    }
+
+    // 8 pixels from 12 bytes per step. Every 16 bit lane gets the two bytes
+    // its pixel straddles: even pixels sit in the low 12 bits, odd ones in
+    // the high 12, so one shift and two masks align them all.
+    __attribute__((target("ssse3")))
+    void unpack12p_ssse3(const uchar* src, ushort* dst, size_t pixels) {
+
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+        const __m128i even = _mm_setr_epi16(-1, 0, -1, 0, -1, 0, -1, 0);
+        const __m128i odd = _mm_setr_epi16(0, 0xFFF0, 0, 0xFFF0, 0, 0xFFF0, 0, 0xFFF0);
+
+        // The loads are 16 bytes wide, stop while they still fit in the row
+        size_t i = 0;
+        for (; i*3/2 + 16 <= pixels*3/2; i += 8, src += 12) {
+            __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)src), shuffle);
+            v = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(v, 4), even), _mm_and_si128(v, odd));
+            _mm_storeu_si128((__m128i*)(dst + i), v);
+        }
+        unpack12p_scalar(src, dst + i, pixels - i);
+
+    }
+
+    // 8 pixels from 10 bytes per step. Pixel j of a group starts 2j bits into
+    // its lane, the multiply shifts each lane left by 6 - 2j to MSB align it.
+    __attribute__((target("ssse3")))
+    void unpack10p_ssse3(const uchar* src, ushort* dst, size_t pixels) {
+
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9);
+        const __m128i shift = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1);
+        const __m128i mask = _mm_set1_epi16((short)0xFFC0);
+
+        size_t i = 0;
+        for (; i*5/4 + 16 <= pixels*5/4; i += 8, src += 10) {
+            __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)src), shuffle);
+            v = _mm_and_si128(_mm_mullo_epi16(v, shift), mask);
+            _mm_storeu_si128((__m128i*)(dst + i), v);
+        }
+        unpack10p_scalar(src, dst + i, pixels - i);
+
+    }
+
+    // 8 pixels from 16 bytes per step. Y sits in the low byte of every lane
+    // and the chroma in the high one, a shuffle hands each lane the Cb or Cr
+    // of its pair. The packed B|G and R|R halves are shuffled into 24 bytes.
+    __attribute__((target("ssse3")))
+    void yuv422_to_bgr_ssse3(const uchar* src, uchar* dst, size_t pixels) {
+
+        const __m128i low = _mm_set1_epi16(0xFF);
+        const __m128i bias = _mm_set1_epi16(128);
+        const __m128i cb_lanes = _mm_setr_epi8(0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13);
+        const __m128i cr_lanes = _mm_setr_epi8(2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15);
+        const __m128i kr = _mm_set1_epi16(YUV_R_CR);
+        const __m128i kgb = _mm_set1_epi16(YUV_G_CB);
+        const __m128i kgr = _mm_set1_epi16(YUV_G_CR);
+        const __m128i kb = _mm_set1_epi16(YUV_B_CB);
+        const __m128i bg_first = _mm_setr_epi8(0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5);
+        const __m128i r_first = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+        const __m128i bg_last = _mm_setr_epi8(13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i r_last = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+
+        size_t i = 0;
+        for (; i + 8 <= pixels; i += 8, src += 16, dst += 24) {
+            __m128i v = _mm_loadu_si128((const __m128i*)src);
+            __m128i y = _mm_and_si128(v, low);
+            __m128i c = _mm_slli_epi16(_mm_sub_epi16(_mm_srli_epi16(v, 8), bias), 2);
+            __m128i cb = _mm_shuffle_epi8(c, cb_lanes);
+            __m128i cr = _mm_shuffle_epi8(c, cr_lanes);
+            __m128i r = _mm_add_epi16(y, _mm_mulhrs_epi16(cr, kr));
+            __m128i g = _mm_sub_epi16(_mm_sub_epi16(y, _mm_mulhrs_epi16(cb, kgb)), _mm_mulhrs_epi16(cr, kgr));
+            __m128i b = _mm_add_epi16(y, _mm_mulhrs_epi16(cb, kb));
+            __m128i bg = _mm_packus_epi16(b, g);
+            __m128i rr = _mm_packus_epi16(r, r);
+            _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_shuffle_epi8(bg, bg_first), _mm_shuffle_epi8(rr, r_first)));
+            _mm_storel_epi64((__m128i*)(dst + 16), _mm_or_si128(_mm_shuffle_epi8(bg, bg_last), _mm_shuffle_epi8(rr, r_last)));
+        }
+        yuv422_to_bgr_scalar(src, dst, pixels - i);
+
+    }
+
+#endif
+
+#ifdef KERNELS_NEON
+
+    // 16 pixels from 24 bytes per step, the structure load splits the byte triplets
+    void unpack12p_neon(const uchar* src, ushort* dst, size_t pixels) {
+
+        const uint8x8_t low = vdup_n_u8(0x0F);
+        const uint8x8_t high = vdup_n_u8(0xF0);
+
+        size_t i = 0;
+        for (; i + 16 <= pixels; i += 16, src += 24) {
+            uint8x8x3_t b = vld3_u8(src);
+            uint16x8x2_t p;
+            p.val[0] = vorrq_u16(vshll_n_u8(b.val[0], 4), vshlq_n_u16(vmovl_u8(vand_u8(b.val[1], low)), 12));
+            p.val[1] = vorrq_u16(vmovl_u8(vand_u8(b.val[1], high)), vshll_n_u8(b.val[2], 8));
+            vst2q_u16(dst + i, p);
+        }
+        unpack12p_scalar(src, dst + i, pixels - i);
+
+    }
+
+    void fuse_exposures_neon(const uchar* s, const uchar* l, uchar* dst, size_t bytes, int knee) {
+
+        const uint8x8_t range = vdup_n_u8(255 - knee);
+        const uint16x8_t slope = vdupq_n_u16(4096/(255 - knee));
+        const uint16x8_t full = vdupq_n_u16(256);
+        const uint16x8_t half = vdupq_n_u16(128);
+
+        size_t i = 0;
+        for (; i + 8 <= bytes; i += 8) {
+            uint8x8_t vs = vld1_u8(s + i);
+            uint8x8_t vl = vld1_u8(l + i);
+            uint16x8_t d = vmovl_u8(vmin_u8(vmvn_u8(vl), range));
+            uint16x8_t a = vminq_u16(vshrq_n_u16(vmulq_u16(d, slope), 4), full);
+            uint16x8_t sum = vmlaq_u16(vmulq_u16(vmovl_u8(vl), a), vmovl_u8(vs), vsubq_u16(full, a));
+            vst1_u8(dst + i, vshrn_n_u16(vaddq_u16(sum, half), 8));
+        }
+        fuse_exposures_scalar(s + i, l + i, dst + i, bytes - i, knee);
+
+    }
+
+    // 16 pixels from 32 bytes per step: the structure load splits Y from
+    // the chroma, an unzip splits Cb from Cr and a zip doubles them per pixel
+    void yuv422_to_bgr_neon(const uchar* src, uchar* dst, size_t pixels) {
+
+        const int16x8_t bias = vdupq_n_s16(128);
+        const int16x8_t kr = vdupq_n_s16(YUV_R_CR);
+        const int16x8_t kgb = vdupq_n_s16(YUV_G_CB);
+        const int16x8_t kgr = vdupq_n_s16(YUV_G_CR);
+        const int16x8_t kb = vdupq_n_s16(YUV_B_CB);
+
+        size_t i = 0;
+        for (; i + 16 <= pixels; i += 16, src += 32, dst += 48) {
+            uint8x16x2_t v = vld2q_u8(src);
+            uint8x8x2_t c = vuzp_u8(vget_low_u8(v.val[1]), vget_high_u8(v.val[1]));
+            int16x8_t cb = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(c.val[0])), bias), 2);
+            int16x8_t cr = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(c.val[1])), bias), 2);
+            int16x8x2_t cb2 = vzipq_s16(cb, cb);
+            int16x8x2_t cr2 = vzipq_s16(cr, cr);
+            uint8x8_t out[3][2];
+            for (int h = 0; h < 2; h++) {
+                uint8x8_t luma = h ? vget_high_u8(v.val[0]) : vget_low_u8(v.val[0]);
+                int16x8_t y = vreinterpretq_s16_u16(vmovl_u8(luma));
+                out[0][h] = vqmovun_s16(vaddq_s16(y, vqrdmulhq_s16(cb2.val[h], kb)));
+                out[1][h] = vqmovun_s16(vsubq_s16(vsubq_s16(y, vqrdmulhq_s16(cb2.val[h], kgb)),
+                                                  vqrdmulhq_s16(cr2.val[h], kgr)));
+                out[2][h] = vqmovun_s16(vaddq_s16(y, vqrdmulhq_s16(cr2.val[h], kr)));
+            }
+            uint8x16x3_t bgr;
+            for (int k = 0; k < 3; k++)
+                bgr.val[k] = vcombine_u8(out[k][0], out[k][1]);
+            vst3q_u8(dst, bgr);
+        }
+        yuv422_to_bgr_scalar(src, dst, pixels - i);
+
+    }
+
+    // 16 pixels per step, the structure load/store does the (de)interleaving
+    void color_matrix_neon(const uchar* src, uchar* dst, size_t pixels, const short* m) {
+
+        const int16x8_t round = vdupq_n_s16(8);
+        int16x8_t coef[9];
+        for (int k = 0; k < 9; k++)
+            coef[k] = vdupq_n_s16(m[k]);
+
+        size_t i = 0;
+        for (; i + 16 <= pixels; i += 16, src += 48, dst += 48) {
+            uint8x16x3_t in = vld3q_u8(src);
+            uint8x16x3_t out;
+            for (int c = 0; c < 3; c++) {
+                uint8x8_t half[2];
+                for (int h = 0; h < 2; h++) {
+                    int16x8_t s = vdupq_n_s16(0);
+                    for (int k = 0; k < 3; k++) {
+                        uint8x8_t v = h ? vget_high_u8(in.val[k]) : vget_low_u8(in.val[k]);
+                        int16x8_t scaled = vreinterpretq_s16_u16(vshll_n_u8(v, 7));
+                        s = vqaddq_s16(s, vqrdmulhq_s16(scaled, coef[3*c + k]));
+                    }
+                    half[h] = vqmovun_s16(vshrq_n_s16(vqaddq_s16(s, round), 4));
+                }
+                out.val[c] = vcombine_u8(half[0], half[1]);
+            }
+            vst3q_u8(dst, out);
+        }
+        color_matrix_scalar(src, dst, pixels - i, m);
+
+    }
+
+    uint64_t sum_lanes(uint16x8_t v) {
+
+        uint64x2_t s = vpaddlq_u32(vpaddlq_u16(v));
+        return vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1);
+
+    }
+
+    void histogram16_neon(const uchar* src, size_t bytes, uint32_t* hist, uint64_t& sum) {
+
+        const uint8x16_t one = vdupq_n_u8(1);
+        uint8x16_t acc[16];
+        for (int b = 0; b < 16; b++)
+            acc[b] = vdupq_n_u8(0);
+        uint16x8_t total = vdupq_n_u16(0);
+
+        size_t i = 0;
+        int pending = 0;
+        for (; i + 16 <= bytes; i += 16) {
+            uint8x16_t v = vld1q_u8(src + i);
+            total = vpadalq_u8(total, v);
+            uint8x16_t bins = vshrq_n_u8(v, 4);
+            for (int b = 0; b < 16; b++)
+                acc[b] = vaddq_u8(acc[b], vandq_u8(vceqq_u8(bins, vdupq_n_u8(b)), one));
+            if (++pending == KERNELS_HIST_FLUSH || i + 32 > bytes) {
+                for (int b = 0; b < 16; b++) {
+                    hist[b] += sum_lanes(vpaddlq_u8(acc[b]));
+                    acc[b] = vdupq_n_u8(0);
+                }
+                sum += sum_lanes(total);
+                total = vdupq_n_u16(0);
+                pending = 0;
+            }
+        }
+        histogram16_scalar(src + i, bytes - i, hist, sum);
+
+    }
+
+#if defined(__aarch64__)
+    // The table sits in 16 registers, four 64 byte lookups per 16 bytes:
+    // TBX leaves the lanes whose index is past its quarter untouched
+    void apply_lut8_neon(const uchar* src, uchar* dst, size_t bytes, const uchar* lut) {
+
+        uint8x16x4_t quarters[4];
+        for (int q = 0; q < 4; q++)
+            for (int k = 0; k < 4; k++)
+                quarters[q].val[k] = vld1q_u8(lut + 64*q + 16*k);
+        const uint8x16_t step = vdupq_n_u8(64);
+
+        size_t i = 0;
+        for (; i + 16 <= bytes; i += 16) {
+            uint8x16_t v = vld1q_u8(src + i);
+            uint8x16_t r = vqtbl4q_u8(quarters[0], v);
+            v = vsubq_u8(v, step);
+            r = vqtbx4q_u8(r, quarters[1], v);
+            v = vsubq_u8(v, step);
+            r = vqtbx4q_u8(r, quarters[2], v);
+            v = vsubq_u8(v, step);
+            r = vqtbx4q_u8(r, quarters[3], v);
+            vst1q_u8(dst + i, r);
+        }
+        apply_lut8_scalar(src + i, dst + i, bytes - i, lut);
+
+    }
+
+    // Same lanes as the SSSE3 version, the table lookup does the shuffle
+    void unpack10p_neon(const uchar* src, ushort* dst, size_t pixels) {
+
+        const uint8_t table[16] = {0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9};
+        const int16_t shifts[8] = {6, 4, 2, 0, 6, 4, 2, 0};
+        const uint8x16_t shuffle = vld1q_u8(table);
+        const int16x8_t shift = vld1q_s16(shifts);
+        const uint16x8_t mask = vdupq_n_u16(0xFFC0);
+
+        size_t i = 0;
+        for (; i*5/4 + 16 <= pixels*5/4; i += 8, src += 10) {
+            uint16x8_t v = vreinterpretq_u16_u8(vqtbl1q_u8(vld1q_u8(src), shuffle));
+            vst1q_u16(dst + i, vandq_u16(vshlq_u16(v, shift), mask));
+        }
+        unpack10p_scalar(src, dst + i, pixels - i);
+
+    }
+#endif
+
+#endif
+
+    bool cpu_supports(const string& isa) {
+
+        if (isa == "scalar")
+            return true;
+#if defined(KERNELS_X86)
+        __builtin_cpu_init();
+        if (isa == "sse2")
+            return __builtin_cpu_supports("sse2");
+        if (isa == "ssse3")
+            return __builtin_cpu_supports("ssse3");
+        if (isa == "avx2")
+            return __builtin_cpu_supports("avx2");
+#elif defined(KERNELS_NEON)
+        if (isa == "neon")
+            return true;
+#endif
+        return false;
+
+    }
+
+    template <typename Fn>
+    struct Variant {
+        const char* isa;
+        Fn fn;
+    };
+
+    // The variants of one kernel, best first and the scalar reference last,
+    // and the first one this CPU runs. Picked once when the library loads.
+    template <typename Fn>
+    struct Kernel {
+        const char* name;
+        vector<Variant<Fn> > variants;
+        Variant<Fn> active;
+
+        Kernel(const char* kernel, const Variant<Fn>* table, size_t count) : name(kernel), variants(table, table + count) {
+            active = variants.back();
+            for (size_t k = 0; k < count; k++)
+                if (cpu_supports(table[k].isa)) {
+                    active = table[k];
+                    break;
+                }
+        }
+
+        const Variant<Fn>& reference() const { return variants.back(); }
+    };
+
+    template <typename Fn>
+    ostream& operator<<(ostream& os, const Kernel<Fn>& kernel) {
+
+        return os << kernel.name << " " << kernel.active.isa;
+
+    }
+
+    #define KERNELS_REGISTER(type, name) \
+        Kernel<type> name##_kernel(#name, name##_variants, sizeof(name##_variants)/sizeof(name##_variants[0]))
+
+    typedef void (*UnpackFn)(const uchar*, ushort*, size_t);
+    typedef void (*Lut8Fn)(const uchar*, uchar*, size_t, const uchar*);
+    typedef void (*Yuv422Fn)(const uchar*, uchar*, size_t);
+    typedef void (*MatrixFn)(const uchar*, uchar*, size_t, const short*);
+    typedef void (*FuseFn)(const uchar*, const uchar*, uchar*, size_t, int);
+    typedef void (*HistogramFn)(const uchar*, size_t, uint32_t*, uint64_t&);
+
+    const Variant<UnpackFn> unpack12p_variants[] = {
+#if defined(KERNELS_X86)
+        {"ssse3", unpack12p_ssse3},
+#elif defined(KERNELS_NEON)
+        {"neon", unpack12p_neon},
+#endif
+        {"scalar", unpack12p_scalar}
+    };
+    KERNELS_REGISTER(UnpackFn, unpack12p);
+
+    const Variant<UnpackFn> unpack10p_variants[] = {
+#if defined(KERNELS_X86)
+        {"ssse3", unpack10p_ssse3},
+#elif defined(KERNELS_NEON) && defined(__aarch64__)
+        {"neon", unpack10p_neon},
+#endif
+        {"scalar", unpack10p_scalar}
+    };
+    KERNELS_REGISTER(UnpackFn, unpack10p);
+
+    // x86 has no byte lookup wider than 16 entries, the unrolled loop is as
+    // fast as emulating one there
+    const Variant<Lut8Fn> apply_lut8_variants[] = {
+#if defined(KERNELS_NEON) && defined(__aarch64__)
+        {"neon", apply_lut8_neon},
+#endif
+        {"scalar", apply_lut8_scalar}
+    };
+    KERNELS_REGISTER(Lut8Fn, apply_lut8);
+
+    const Variant<Yuv422Fn> yuv422_to_bgr_variants[] = {
+#if defined(KERNELS_X86)
+        {"ssse3", yuv422_to_bgr_ssse3},
+#elif defined(KERNELS_NEON)
+        {"neon", yuv422_to_bgr_neon},
+#endif
+        {"scalar", yuv422_to_bgr_scalar}
+    };
+    KERNELS_REGISTER(Yuv422Fn, yuv422_to_bgr);
+
+    const Variant<MatrixFn> color_matrix_variants[] = {
+#if defined(KERNELS_X86)
+        {"ssse3", color_matrix_ssse3},
+#elif defined(KERNELS_NEON)
+        {"neon", color_matrix_neon},
+#endif
+        {"scalar", color_matrix_scalar}
+    };
+    KERNELS_REGISTER(MatrixFn, color_matrix);
+
+    const Variant<FuseFn> fuse_exposures_variants[] = {
+#if defined(KERNELS_X86)
+        {"avx2", fuse_exposures_avx2},
+#endif
+#if defined(__SSE2__)
+        {"sse2", fuse_exposures_sse2},
+#elif defined(KERNELS_NEON)
+        {"neon", fuse_exposures_neon},
+#endif
+        {"scalar", fuse_exposures_scalar}
+    };
+    KERNELS_REGISTER(FuseFn, fuse_exposures);
+
+    const Variant<HistogramFn> histogram16_variants[] = {
+#if defined(KERNELS_X86)
+        {"avx2", histogram16_avx2},
+#endif
+#if defined(__SSE2__)
+        {"sse2", histogram16_sse2},
+#elif defined(KERNELS_NEON)
+        {"neon", histogram16_neon},
+#endif
+        {"scalar", histogram16_scalar}
+    };
+    KERNELS_REGISTER(HistogramFn, histogram16);
+
+    // Self check: every row length up to 67 (all the vector tails) and a few
+    // long ones, random data from a fixed seed. The outputs carry 16 guard
+    // bytes, a variant writing past its row differs there.
+    const size_t CHECK_GUARD = 16;
+
+    vector<size_t> check_lengths() {
+
+        vector<size_t> lengths;
+        for (size_t n = 0; n < 68; n++)
+            lengths.push_back(n);
+        lengths.push_back(255);
+        lengths.push_back(1001);
+        lengths.push_back(4099);
+        return lengths;
+
+    }
+
+    vector<uchar> random_bytes(cv::RNG& rng, size_t n) {
+
+        vector<uchar> v(n);
+        for (size_t k = 0; k < n; k++)
+            v[k] = (uchar)rng.uniform(0, 256);
+        return v;
+
+    }
+
+    bool same_unpack(UnpackFn fn, UnpackFn ref, int bits) {
+
+        cv::RNG rng(bits);
+        vector<size_t> lengths = check_lengths();
+        for (size_t k = 0; k < lengths.size(); k++) {
+            size_t n = lengths[k];
+            vector<uchar> src = random_bytes(rng, (n*bits + 7)/8 + CHECK_GUARD);
+            vector<ushort> a(n + CHECK_GUARD, 0xABCD), b(n + CHECK_GUARD, 0xABCD);
+            fn(&src[0], &a[0], n);
+            ref(&src[0], &b[0], n);
+            if (a != b)
+                return false;
+        }
+        return true;
+
+    }
+
+    bool same_unpack12p(UnpackFn fn, UnpackFn ref) { return same_unpack(fn, ref, 12); }
+    bool same_unpack10p(UnpackFn fn, UnpackFn ref) { return same_unpack(fn, ref, 10); }
+
+    bool same_lut8(Lut8Fn fn, Lut8Fn ref) {
+
+        cv::RNG rng(8);
+        vector<uchar> lut = random_bytes(rng, 256);
+        vector<size_t> lengths = check_lengths();
+        for (size_t k = 0; k < lengths.size(); k++) {
+            size_t n = lengths[k];
+            vector<uchar> src = random_bytes(rng, n + CHECK_GUARD);
+            vector<uchar> a(n + CHECK_GUARD, 0xAB), b(n + CHECK_GUARD, 0xAB);
+            fn(&src[0], &a[0], n, &lut[0]);
+            ref(&src[0], &b[0], n, &lut[0]);
+            if (a != b)
+                return false;
+        }
+        return true;
+
+    }
+
+    bool same_yuv422(Yuv422Fn fn, Yuv422Fn ref) {
+
+        cv::RNG rng(422);
+        vector<size_t> lengths = check_lengths();
+        for (size_t k = 0; k < lengths.size(); k++) {
+            size_t n = lengths[k];
+            vector<uchar> src = random_bytes(rng, (n + 1)/2*4 + CHECK_GUARD);
+            vector<uchar> a(n*3 + CHECK_GUARD, 0xAB), b(n*3 + CHECK_GUARD, 0xAB);
+            fn(&src[0], &a[0], n);
+            ref(&src[0], &b[0], n);
+            if (a != b)
+                return false;
+        }
+        return true;
+
+    }
+
+    bool same_color_matrix(MatrixFn fn, MatrixFn ref) {
+
+        cv::RNG rng(33);
+        vector<size_t> lengths = check_lengths();
+        for (size_t k = 0; k < lengths.size(); k++) {
+            size_t n = lengths[k];
+            // Gains up to 8 and negative cross terms, both saturating
+            short m[9];
+            for (int c = 0; c < 9; c++)
+                m[c] = (short)rng.uniform(-32767, 32768);
+            vector<uchar> src = random_bytes(rng, n*3 + CHECK_GUARD);
+            vector<uchar> a(n*3 + CHECK_GUARD, 0xAB), b(n*3 + CHECK_GUARD, 0xAB);
+            fn(&src[0], &a[0], n, m);
+            ref(&src[0], &b[0], n, m);
+            if (a != b)
+                return false;
+            // In place too
+            vector<uchar> c = src;
+            fn(&c[0], &c[0], n, m);
+            if (!equal(c.begin(), c.begin() + n*3, b.begin()))
+                return false;
+        }
+        return true;
+
+    }
+
+    bool same_fuse(FuseFn fn, FuseFn ref) {
+
+        cv::RNG rng(2);
+        vector<size_t> lengths = check_lengths();
+        for (size_t k = 0; k < lengths.size(); k++) {
+            size_t n = lengths[k];
+            int knee = rng.uniform(0, 255);
+            vector<uchar> s = random_bytes(rng, n + CHECK_GUARD), l = random_bytes(rng, n + CHECK_GUARD);
+            vector<uchar> a(n + CHECK_GUARD, 0xAB), b(n + CHECK_GUARD, 0xAB);
+            fn(&s[0], &l[0], &a[0], n, knee);
+            ref(&s[0], &l[0], &b[0], n, knee);
+            if (a != b)
+                return false;
+        }
+        return true;
+
+    }
+
+    bool same_histogram(HistogramFn fn, HistogramFn ref) {
+
+        cv::RNG rng(16);
+        vector<size_t> lengths = check_lengths();
+        // Past the flush interval of the byte counters too
+        lengths.push_back(KERNELS_HIST_FLUSH*64 + 5);
+        for (size_t k = 0; k < lengths.size(); k++) {
+            size_t n = lengths[k];
+            vector<uchar> src = random_bytes(rng, n + CHECK_GUARD);
+            // Accumulates on top of what is there
+            uint32_t a[16], b[16];
+            for (int bin = 0; bin < 16; bin++)
+                a[bin] = b[bin] = bin;
+            uint64_t sum_a = 7, sum_b = 7;
+            fn(&src[0], n, a, sum_a);
+            ref(&src[0], n, b, sum_b);
+            if (memcmp(a, b, sizeof(a)) || sum_a != sum_b)
+                return false;
+        }
+        return true;
+
+    }
+
+    // Runs the variants this CPU supports against the reference, a failing
+    // one is reported and replaced by the reference if it was active
+    template <typename Fn>
+    void check_kernel(Kernel<Fn>& kernel, bool (*same)(Fn, Fn), vector<string>& failures) {
+
+        for (size_t k = 0; k + 1 < kernel.variants.size(); k++) {
+            const Variant<Fn>& v = kernel.variants[k];
+            if (!cpu_supports(v.isa) || same(v.fn, kernel.reference().fn))
+                continue;
+            failures.push_back(string(kernel.name) + " " + v.isa);
+            if (kernel.active.fn == v.fn)
+                kernel.active = kernel.reference();
+        }
+
+    }
+
+}
+
+void acquisition::kernels::unpack12p(const uchar* src, ushort* dst, size_t pixels) {
+
+    unpack12p_kernel.active.fn(src, dst, pixels);
+
+}
+
+void acquisition::kernels::unpack10p(const uchar* src, ushort* dst, size_t pixels) {
+
+    unpack10p_kernel.active.fn(src, dst, pixels);
+
+}
+
+void acquisition::kernels::unpack_row(int bits, const uchar* src, ushort* dst, size_t pixels) {
+
+    if (bits == 12)
+        unpack12p(src, dst, pixels);
+    else
+        unpack10p(src, dst, pixels);
+
+}
+
+void acquisition::kernels::apply_lut8(const uchar* src, uchar* dst, size_t bytes, const uchar* lut) {
+
+    apply_lut8_kernel.active.fn(src, dst, bytes, lut);
+
+}
+
+void acquisition::kernels::yuv422_to_bgr(const uchar* src, uchar* dst, size_t pixels) {
+
+    yuv422_to_bgr_kernel.active.fn(src, dst, pixels);
+
+}
+
+void acquisition::kernels::color_matrix(const uchar* src, uchar* dst, size_t pixels, const short* m) {
+
+    color_matrix_kernel.active.fn(src, dst, pixels, m);
+
+}
+
+void acquisition::kernels::fuse_exposures(const uchar* short_exp, const uchar* long_exp, uchar* dst, size_t bytes, int knee) {
+
+    fuse_exposures_kernel.active.fn(short_exp, long_exp, dst, bytes, knee);
+
+}
+
+void acquisition::kernels::histogram16(const uchar* src, size_t bytes, uint32_t* hist, uint64_t& sum) {
+
+    histogram16_kernel.active.fn(src, bytes, hist, sum);
+
+}
+
+void acquisition::kernels::apply_tone_lut(const ushort* src, uchar* dst, size_t pixels, const uchar* lut) {
+
+    // A table lookup per pixel, gathers wouldn't beat it on either ISA
+    for (size_t i = 0; i < pixels; i++)
+        dst[i] = lut[src[i] >> 4];
+
+}
+
+bool acquisition::kernels::make_tone_lut(string curve, double gamma, vector<uchar>& lut) {
+
+    lut.resize(4096);
+    if (curve == "linear") {
+        for (int v = 0; v < 4096; v++)
+            lut[v] = v >> 4;
+    } else if (curve == "gamma" && gamma > 0) {
+        for (int v = 0; v < 4096; v++)
+            lut[v] = cv::saturate_cast<uchar>(255*pow(v/4095.0, 1/gamma));
+    } else {
+        lut.clear();
+        return false;
+    }
+    return true;
+
+}
+
+bool acquisition::kernels::make_curve_lut(double gamma, double contrast, vector<uchar>& lut) {
+
+    if (gamma <= 0 || contrast <= 0) {
+        lut.clear();
+        return false;
+    }
+    lut.resize(256);
+    for (int v = 0; v < 256; v++)
+        lut[v] = cv::saturate_cast<uchar>(255*((pow(v/255.0, 1/gamma) - 0.5)*contrast + 0.5));
+    return true;
+
+}
+
+string acquisition::kernels::simd_name() {
+
+    return unpack12p_kernel.active.isa;
+
+}
+
+string acquisition::kernels::selected() {
+
+    stringstream ss;
+    ss << unpack12p_kernel << ", " << unpack10p_kernel << ", " << apply_lut8_kernel << ", "
+       << yuv422_to_bgr_kernel << ", " << color_matrix_kernel << ", " << fuse_exposures_kernel << ", " << histogram16_kernel;
+    return ss.str();
+
+}
+
+bool acquisition::kernels::self_check(vector<string>& failures) {
+
+    size_t before = failures.size();
+    check_kernel(unpack12p_kernel, same_unpack12p, failures);
+    check_kernel(unpack10p_kernel, same_unpack10p, failures);
+    check_kernel(apply_lut8_kernel, same_lut8, failures);
+    check_kernel(yuv422_to_bgr_kernel, same_yuv422, failures);
+    check_kernel(color_matrix_kernel, same_color_matrix, failures);
+    check_kernel(fuse_exposures_kernel, same_fuse, failures);
+    check_kernel(histogram16_kernel, same_histogram, failures);
+    return failures.size() == before;
+
+}
@@ -0,0 +1,174 @@
+#include "spinnaker_sdk_camera_driver/memory_governor.h"
+
+#include <algorithm>
+
+namespace {
+
+    struct ByPriority {
+        bool operator()(const std::pair<int, int>& a, const std::pair<int, int>& b) const { return a.first < b.first; }
+    };
+
+}
+
+acquisition::MemoryGovernor::MemoryGovernor(ros::NodeHandle nh, size_t budget_bytes, float high_watermark, float low_watermark) {
+
+    budget_ = budget_bytes;
+    high_watermark_ = high_watermark;
+    low_watermark_ = low_watermark;
+    max_system_usage_ = 0.95;
+    period_ = 1.0;
+    last_update_ = 0;
+
+    usage_pub_ = nh.advertise<provider_vision::MemoryUsage>("memory_usage", 10);
+
+}
+
+void acquisition::MemoryGovernor::register_component(string name, int priority, UsageFn usage, ShedFn shed, size_t limit) {
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    Component c;
+    c.name = name;
+    c.priority = priority;
+    c.usage = usage;
+    c.shed = shed;
+    c.limit = limit;
+    c.last_usage = 0;
+    c.shed_bytes = 0;
+    components_.push_back(c);
+
+    ROS_DEBUG_STREAM("Memory governor: registered " << name << " with priority " << priority
+                     << (shed ? "" : " (not sheddable)"));
+
+}
+
+void acquisition::MemoryGovernor::set_priority(string name, int priority) {
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    for (int i=0; i<components_.size(); i++)
+        if (components_[i].name == name)
+            components_[i].priority = priority;
+
+}
+
+size_t acquisition::MemoryGovernor::total_usage() {
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    size_t total = 0;
+    for (int i=0; i<components_.size(); i++)
+        total += components_[i].last_usage;
+    return total;
+
+}
+
+void acquisition::MemoryGovernor::update(bool force) {
+
+    double now = ros::Time::now().toSec();
+    if (!force && now - last_update_ < period_)
+        return;
+    last_update_ = now;
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    size_t total = 0;
+    for (int i=0; i<components_.size(); i++) {
+        Component& c = components_[i];
+        c.last_usage = c.usage();
+
+        // Per component hard limits come first
+        if (c.limit > 0 && c.last_usage > c.limit && c.shed) {
+            size_t freed = c.shed(c.last_usage - c.limit);
+            c.shed_bytes += freed;
+            c.last_usage -= min(freed, c.last_usage);
+            ROS_WARN_STREAM_THROTTLE(5, "Memory governor: " << c.name << " over its limit, shed " << freed/1048576.0 << " MB");
+        }
+        total += c.last_usage;
+    }
+
+    float sys_usage = system_usage();
+
+    size_t to_free = 0;
+    if (budget_ > 0 && total > budget_*high_watermark_)
+        to_free = total - budget_*low_watermark_;
+    if (sys_usage > max_system_usage_ && to_free == 0)
+        // The machine itself runs out, give back a quarter of what we hold
+        to_free = total/4;
+
+    if (to_free > 0) {
+        size_t freed = shed(to_free);
+        ROS_WARN_STREAM_THROTTLE(5, "Memory governor: usage " << total/1048576.0 << " MB of " << budget_/1048576.0
+                                 << " MB budget (system " << sys_usage*100 << "%), shed " << freed/1048576.0 << " MB");
+        total -= min(freed, total);
+    }
+
+    publish(sys_usage);
+
+}
+
+size_t acquisition::MemoryGovernor::shed(size_t bytes_to_free) {
+
+    // Lowest priority sheds first
+    vector<pair<int, int> > order;
+    for (int i=0; i<components_.size(); i++)
+        if (components_[i].shed)
+            order.push_back(make_pair(components_[i].priority, i));
+    stable_sort(order.begin(), order.end(), ByPriority());
+
+    size_t freed = 0;
+    for (int k=0; k<order.size() && freed < bytes_to_free; k++) {
+        Component& c = components_[order[k].second];
+        size_t f = c.shed(bytes_to_free - freed);
+        c.shed_bytes += f;
+        c.last_usage -= min(f, c.last_usage);
+        freed += f;
+        ROS_DEBUG_STREAM_COND(f, "Memory governor: " << c.name << " shed " << f << " bytes");
+    }
+    return freed;
+
+}
+
+void acquisition::MemoryGovernor::publish(float sys_usage) {
+
+    provider_vision::MemoryUsage msg;
+    msg.header.stamp = ros::Time::now();
+    msg.budget = budget_;
+    msg.system_usage = sys_usage;
+    msg.total = 0;
+
+    for (int i=0; i<components_.size(); i++) {
+        msg.component.push_back(components_[i].name);
+        msg.priority.push_back(components_[i].priority);
+        msg.bytes.push_back(components_[i].last_usage);
+        msg.limit.push_back(components_[i].limit);
+        msg.shed.push_back(components_[i].shed_bytes);
+        msg.total += components_[i].last_usage;
+    }
+
+    usage_pub_.publish(msg);
+
+}
+
+float acquisition::MemoryGovernor::system_usage() {
+
+    std::string token;
+    std::ifstream file("/proc/meminfo");
+    unsigned long int total = 0, free = 0;
+    while (file >> token) {
+        if (token == "MemTotal:")
+            if (!(file >> total))
+                ROS_FATAL_STREAM("Could not poll total memory!");
+        if (token == "MemAvailable:")
+            if (!(file >> free)) {
+                ROS_FATAL_STREAM("Could not poll free memory!");
+                break;
+            }
+        // ignore rest of the line
+        file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    if (total == 0)
+        return 0;
+    return 1-float(free)/float(total);
+
+}
@@ -0,0 +1,278 @@
+#include "spinnaker_sdk_camera_driver/pipeline.h"
+
+acquisition::Pipeline::Pipeline(string name) {
+
+    name_ = name;
+    running_ = false;
+    raw_frames_ = 0;
+
+}
+
+acquisition::Pipeline::~Pipeline() {
+
+    stop();
+
+}
+
+void acquisition::Pipeline::add_stage(string name, StageFn fn, int queue_size, bool drop_oldest) {
+
+    ROS_ASSERT_MSG(!running_, "Stages must be added before the pipeline starts");
+    ROS_ASSERT_MSG(find(name) < 0, "Duplicate stage name in pipeline");
+
+    boost::shared_ptr<Stage> stage(new Stage());
+    stage->name = name;
+    stage->fn = fn;
+    stage->input.reset(new BoundedQueue<Frame>(queue_size, drop_oldest));
+    stage->has_input = false;
+    stage->inputs = 0;
+    memset(&stage->stats, 0, sizeof(stage->stats));
+    stages_.push_back(stage);
+
+}
+
+bool acquisition::Pipeline::connect(string from, string to) {
+
+    int a = find(from);
+    int b = find(to);
+    if (a < 0 || b < 0) {
+        ROS_ERROR_STREAM("Pipeline " << name_ << ": cannot connect unknown stage " << (a < 0 ? from : to));
+        return false;
+    }
+    // Stages close in graph order, a loop would never close
+    if (reaches(b, a)) {
+        ROS_ERROR_STREAM("Pipeline " << name_ << ": connecting " << from << " to " << to << " makes a loop");
+        return false;
+    }
+    stages_[a]->next.push_back(b);
+    stages_[b]->has_input = true;
+    return true;
+
+}
+
+bool acquisition::Pipeline::reaches(int from, int to) {
+
+    if (from == to)
+        return true;
+    for (int k=0; k<stages_[from]->next.size(); k++)
+        if (reaches(stages_[from]->next[k], to))
+            return true;
+    return false;
+
+}
+
+int acquisition::Pipeline::find(string name) {
+
+    for (int i=0; i<stages_.size(); i++)
+        if (stages_[i]->name == name)
+            return i;
+    return -1;
+
+}
+
+void acquisition::Pipeline::start() {
+
+    if (running_)
+        return;
+    running_ = true;
+
+    int sources = 0;
+    for (int i=0; i<stages_.size(); i++) {
+        stages_[i]->inputs = 0;
+        sources += !stages_[i]->has_input;
+    }
+    for (int i=0; i<stages_.size(); i++)
+        for (int k=0; k<stages_[i]->next.size(); k++)
+            stages_[stages_[i]->next[k]]->inputs++;
+    ROS_WARN_STREAM_COND(sources > 1, "Pipeline " << name_ << ": " << sources
+                         << " source stages, only the first one gets the acquired buffer");
+
+    for (int i=0; i<stages_.size(); i++)
+        threads_.create_thread(boost::bind(&Pipeline::stage_loop, this, i));
+
+    ROS_INFO_STREAM("Pipeline " << describe() << " started");
+
+}
+
+void acquisition::Pipeline::stop() {
+
+    if (!running_)
+        return;
+
+    // The others close as their inputs finish, see stage_done()
+    for (int i=0; i<stages_.size(); i++)
+        if (!stages_[i]->has_input)
+            stages_[i]->input->close();
+    threads_.join_all();
+    running_ = false;
+
+}
+
+void acquisition::Pipeline::push(const Frame& frame) {
+
+    if (frame.raw) {
+        boost::mutex::scoped_lock lock(raw_mutex_);
+        raw_frames_++;
+    }
+
+    Frame copy = frame;
+    for (int i=0; i<stages_.size(); i++) {
+        if (stages_[i]->has_input)
+            continue;
+        enqueue(i, copy);
+        copy.raw = Spinnaker::ImagePtr();
+    }
+    // No source at all, the buffer still goes back
+    release_raw(copy);
+
+}
+
+void acquisition::Pipeline::release_raw(Frame& frame) {
+
+    if (!frame.raw)
+        return;
+    frame.raw->Release();
+    frame.raw = Spinnaker::ImagePtr();
+    raw_released();
+
+}
+
+void acquisition::Pipeline::raw_released() {
+
+    boost::mutex::scoped_lock lock(raw_mutex_);
+    if (--raw_frames_ == 0)
+        raw_cond_.notify_all();
+
+}
+
+void acquisition::Pipeline::wait_raw_released() {
+
+    boost::mutex::scoped_lock lock(raw_mutex_);
+    while (raw_frames_ > 0 && running_)
+        raw_cond_.wait(lock);
+
+}
+
+void acquisition::Pipeline::enqueue(int id, const Frame& frame) {
+
+    Frame dropped;
+    if (!stages_[id]->input->push(frame, &dropped)) {
+        // an acquired buffer must go back to the stream even if never converted
+        release_raw(dropped);
+        boost::mutex::scoped_lock lock(stats_mutex_);
+        stages_[id]->stats.dropped++;
+    }
+
+}
+
+void acquisition::Pipeline::forward(int id, const Frame& frame) {
+
+    Frame copy = frame;
+    for (int k=0; k<stages_[id]->next.size(); k++) {
+        enqueue(stages_[id]->next[k], copy);
+        copy.raw = Spinnaker::ImagePtr();
+    }
+    // A sink that kept the acquired buffer
+    release_raw(copy);
+
+}
+
+// The thread of `id` has finished: successors whose inputs have all
+// finished get no more frames, they drain their queue and follow
+void acquisition::Pipeline::stage_done(int id) {
+
+    for (int k=0; k<stages_[id]->next.size(); k++) {
+        Stage& next = *stages_[stages_[id]->next[k]];
+        bool last;
+        {
+            boost::mutex::scoped_lock lock(stats_mutex_);
+            last = --next.inputs == 0;
+        }
+        if (last)
+            next.input->close();
+    }
+
+}
+
+void acquisition::Pipeline::stage_loop(int id) {
+
+    Stage& stage = *stages_[id];
+    Frame frame;
+
+    while (stage.input->pop(frame)) {
+
+        double t = ros::WallTime::now().toSec();
+        bool raw = frame.raw.IsValid();
+        bool ok = false;
+        try {
+            ok = stage.fn(frame);
+        }
+        catch (const std::exception& e) {
+            ROS_ERROR_STREAM("Pipeline " << name_ << ", stage " << stage.name << ": " << e.what());
+        }
+        t = ros::WallTime::now().toSec() - t;
+
+        {
+            boost::mutex::scoped_lock lock(stats_mutex_);
+            stage.stats.processed++;
+            stage.stats.total_time += t;
+            if (!ok)
+                stage.stats.rejected++;
+        }
+
+        // The stage converted and released it
+        if (raw && !frame.raw)
+            raw_released();
+
+        if (ok)
+            forward(id, frame);
+        else
+            release_raw(frame);
+
+        frame = Frame();
+    }
+
+    stage_done(id);
+
+}
+
+string acquisition::Pipeline::describe() {
+
+    ostringstream ss;
+    ss << name_ << ": ";
+    for (int i=0; i<stages_.size(); i++) {
+        if (i)
+            ss << ", ";
+        ss << stages_[i]->name;
+        if (!stages_[i]->next.empty()) {
+            ss << " -> [";
+            for (int k=0; k<stages_[i]->next.size(); k++)
+                ss << (k ? " " : "") << stages_[stages_[i]->next[k]]->name;
+            ss << "]";
+        }
+    }
+    return ss.str();
+
+}
+
+map<string, acquisition::StageStats> acquisition::Pipeline::stats() {
+
+    map<string, StageStats> out;
+    boost::mutex::scoped_lock lock(stats_mutex_);
+    for (int i=0; i<stages_.size(); i++) {
+        out[stages_[i]->name] = stages_[i]->stats;
+        out[stages_[i]->name].queued = stages_[i]->input->size();
+    }
+    return out;
+
+}
+
+void acquisition::Pipeline::log_stats() {
+
+    map<string, StageStats> s = stats();
+    for (map<string, StageStats>::iterator it = s.begin(); it != s.end(); ++it)
+        ROS_INFO("Pipeline %s, stage %s:- processed: %lu, dropped: %lu, rejected: %lu, queued: %d, avg: %.2f ms",
+                 name_.c_str(), it->first.c_str(), (unsigned long)it->second.processed,
+                 (unsigned long)it->second.dropped, (unsigned long)it->second.rejected, it->second.queued,
+                 it->second.processed ? it->second.total_time*1000/it->second.processed : 0.0);
+
+}
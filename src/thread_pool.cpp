@@ -0,0 +1,297 @@
+#include "spinnaker_sdk_camera_driver/thread_pool.h"
+
+namespace {
+
+    // Index of the pool worker running on this thread, -1 elsewhere
+    thread_local int worker_id = -1;
+    thread_local void* worker_pool = NULL;
+
+}
+
+acquisition::TaskGroup::~TaskGroup() {
+
+    boost::mutex::scoped_lock lock(mutex_);
+    while (pending_.load() > 0)
+        cond_.wait(lock);
+
+}
+
+void acquisition::TaskGroup::done() {
+
+    // Under the lock, a waiter must not see zero and drop the group while
+    // we still touch it
+    boost::mutex::scoped_lock lock(mutex_);
+    if (--pending_ == 0)
+        cond_.notify_all();
+
+}
+
+void acquisition::TaskGroup::fail(std::exception_ptr error) {
+
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!error_)
+        error_ = error;
+
+}
+
+void acquisition::TaskGroup::rethrow() {
+
+    std::exception_ptr error;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        error.swap(error_);
+    }
+    if (error)
+        std::rethrow_exception(error);
+
+}
+
+bool acquisition::TaskGroup::finished() {
+
+    boost::mutex::scoped_lock lock(mutex_);
+    return pending_.load() == 0;
+
+}
+
+void acquisition::TaskGroup::wait_for(int timeout_us) {
+
+    boost::mutex::scoped_lock lock(mutex_);
+    if (pending_.load() > 0)
+        cond_.timed_wait(lock, boost::posix_time::microseconds(timeout_us));
+
+}
+
+acquisition::WorkStealingPool::WorkStealingPool(int num_threads) {
+
+    if (num_threads <= 0)
+        num_threads = boost::thread::hardware_concurrency();
+    if (num_threads <= 0)
+        num_threads = 1;
+
+    queued_ = 0;
+    next_ = 0;
+    stop_ = false;
+
+    for (int i=0; i<num_threads; i++)
+        workers_.push_back(boost::shared_ptr<Worker>(new Worker()));
+    for (int i=0; i<num_threads; i++)
+        threads_.create_thread(boost::bind(&WorkStealingPool::worker_loop, this, i));
+
+    ROS_INFO_STREAM("Worker pool started with " << num_threads << " threads");
+
+}
+
+acquisition::WorkStealingPool::~WorkStealingPool() {
+
+    {
+        boost::mutex::scoped_lock lock(sleep_mutex_);
+        stop_ = true;
+        wake_.notify_all();
+    }
+    threads_.join_all();
+
+}
+
+void acquisition::WorkStealingPool::submit(Task task, string tag, TaskGroup* group) {
+
+    Item item;
+    item.task = task;
+    item.tag = tag;
+    item.group = group;
+    if (group)
+        group->add();
+
+    // Tasks spawned by a worker stay local, others are spread round robin
+    int target = (worker_pool == this && worker_id >= 0) ? worker_id : next_++ % workers_.size();
+    {
+        boost::mutex::scoped_lock lock(workers_[target]->mutex);
+        workers_[target]->tasks.push_back(item);
+    }
+    queued_++;
+
+    boost::mutex::scoped_lock lock(sleep_mutex_);
+    wake_.notify_one();
+
+}
+
+bool acquisition::WorkStealingPool::try_pop(int id, Item& item, bool& stolen) {
+
+    stolen = false;
+
+    if (id >= 0) {
+        boost::mutex::scoped_lock lock(workers_[id]->mutex);
+        if (!workers_[id]->tasks.empty()) {
+            item = workers_[id]->tasks.back();
+            workers_[id]->tasks.pop_back();
+            queued_--;
+            return true;
+        }
+    }
+
+    int n = workers_.size();
+    int start = id >= 0 ? id + 1 : next_.load();
+    for (int k=0; k<n; k++) {
+        int victim = (start + k) % n;
+        if (victim == id)
+            continue;
+        boost::mutex::scoped_lock lock(workers_[victim]->mutex);
+        if (!workers_[victim]->tasks.empty()) {
+            item = workers_[victim]->tasks.front();
+            workers_[victim]->tasks.pop_front();
+            queued_--;
+            stolen = id >= 0;
+            return true;
+        }
+    }
+
+    return false;
+
+}
+
+// Only the tasks of `group`, newest first like the owner would
+bool acquisition::WorkStealingPool::try_pop_group(int id, TaskGroup& group, Item& item) {
+
+    int n = workers_.size();
+    int start = id >= 0 ? id : 0;
+    for (int k=0; k<n; k++) {
+        Worker& w = *workers_[(start + k) % n];
+        boost::mutex::scoped_lock lock(w.mutex);
+        for (deque<Item>::reverse_iterator it = w.tasks.rbegin(); it != w.tasks.rend(); ++it) {
+            if (it->group != &group)
+                continue;
+            item = *it;
+            w.tasks.erase((it + 1).base());
+            queued_--;
+            return true;
+        }
+    }
+
+    return false;
+
+}
+
+void acquisition::WorkStealingPool::run(Item& item, bool stolen) {
+
+    double t = ros::WallTime::now().toSec();
+    try {
+        item.task();
+    }
+    catch (...) {
+        // The waiter gets it, a task nobody waits on can only be logged
+        if (item.group) {
+            item.group->fail(std::current_exception());
+        } else {
+            try {
+                throw;
+            } catch (const std::exception& e) {
+                ROS_ERROR_STREAM("Worker task '" << item.tag << "' failed: " << e.what());
+            } catch (...) {
+                ROS_ERROR_STREAM("Worker task '" << item.tag << "' failed");
+            }
+        }
+    }
+    t = ros::WallTime::now().toSec() - t;
+
+    if (!item.tag.empty()) {
+        boost::mutex::scoped_lock lock(stats_mutex_);
+        TaskStats& s = stats_[item.tag];
+        s.count++;
+        s.stolen += stolen;
+        s.total_time += t;
+        s.max_time = max(s.max_time, t);
+    }
+
+    if (item.group)
+        item.group->done();
+
+}
+
+void acquisition::WorkStealingPool::worker_loop(int id) {
+
+    worker_id = id;
+    worker_pool = this;
+
+    while (true) {
+        Item item;
+        bool stolen;
+        if (try_pop(id, item, stolen)) {
+            run(item, stolen);
+            continue;
+        }
+
+        boost::mutex::scoped_lock lock(sleep_mutex_);
+        if (stop_)
+            break;
+        if (queued_.load() == 0)
+            wake_.wait(lock);
+    }
+
+}
+
+void acquisition::WorkStealingPool::wait(TaskGroup& group) {
+
+    int id = worker_pool == this ? worker_id : -1;
+
+    while (!group.finished()) {
+        Item item;
+        if (try_pop_group(id, group, item))
+            run(item, false);
+        else
+            group.wait_for(200);
+    }
+    group.rethrow();
+
+}
+
+void acquisition::WorkStealingPool::parallel_for_rows(int rows, int min_band, RowTask fn, string tag) {
+
+    if (rows <= 0)
+        return;
+
+    // Two bands per worker leaves room for stealing to even out the load
+    int band = max(max(min_band, 1), (rows + 2*size() - 1) / (2*size()));
+    if (band >= rows) {
+        fn(0, rows);
+        return;
+    }
+
+    TaskGroup group;
+    for (int y = band; y < rows; y += band)
+        submit(boost::bind(fn, y, min(y + band, rows)), tag, &group);
+
+    // The caller takes the first band itself, and still helps with the
+    // others when it fails
+    try {
+        fn(0, band);
+    } catch (...) {
+        wait(group);
+        throw;
+    }
+    wait(group);
+
+}
+
+map<string, acquisition::TaskStats> acquisition::WorkStealingPool::stats() {
+
+    boost::mutex::scoped_lock lock(stats_mutex_);
+    return stats_;
+
+}
+
+void acquisition::WorkStealingPool::reset_stats() {
+
+    boost::mutex::scoped_lock lock(stats_mutex_);
+    stats_.clear();
+
+}
+
+void acquisition::WorkStealingPool::log_stats() {
+
+    map<string, TaskStats> s = stats();
+    for (map<string, TaskStats>::iterator it = s.begin(); it != s.end(); ++it)
+        ROS_INFO("Worker pool task %s:- count: %lu, stolen: %lu, avg: %.2f ms, max: %.2f ms",
+                 it->first.c_str(), (unsigned long)it->second.count, (unsigned long)it->second.stolen,
+                 it->second.count ? it->second.total_time*1000/it->second.count : 0.0,
+                 it->second.max_time*1000);
+
+}
@@ -0,0 +1,27 @@
+#include "spinnaker_sdk_camera_driver/kernels.h"
+
+#include <gtest/gtest.h>
+
+using namespace acquisition;
+
+// Every SIMD variant the CPU running the tests has must match the scalar
+// kernels byte for byte, the startup check only falls back when one doesn't
+TEST(Kernels, SelfCheck) {
+
+    vector<string> failures;
+    bool passed = kernels::self_check(failures);
+
+    string failed;
+    for (int i = 0; i < failures.size(); i++)
+        failed += " " + failures[i];
+    EXPECT_TRUE(failures.empty()) << "Variants differing from the scalar kernels:" << failed;
+    EXPECT_TRUE(passed);
+
+}
+
+int main(int argc, char** argv) {
+
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+
+}